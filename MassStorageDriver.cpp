@@ -39,11 +39,17 @@
 				  ((x >> 8) & 0xff00) |  \
                   ((x << 24) & 0xff000000)
 
+static const usb_match_t mass_storage_match[] = {
+	{USB_MATCH_CLASS | USB_MATCH_SUBCLASS | USB_MATCH_PROTOCOL, 8, 6, 80, 0, 0}, // SCSI, bulk only
+	{0, 0, 0, 0, 0, 0}
+};
+
 void msController::init()
 {
 	contribute_Pipes(mypipes, sizeof(mypipes)/sizeof(Pipe_t));
 	contribute_Transfers(mytransfers, sizeof(mytransfers)/sizeof(Transfer_t));
 	contribute_String_Buffers(mystring_bufs, sizeof(mystring_bufs)/sizeof(strbuf_t));
+	match_list = mass_storage_match;
 	driver_ready_for_device(this);
 }
 
@@ -114,9 +114,13 @@ bool USBSerialEmu::hid_process_out_data(const Transfer_t *transfer)
 
 bool USBSerialEmu::sendPacket() 
 {
+#ifdef SEREMU_PRINT_DEBUG
 	USBHDBGSerial.printf("SEMU: SendPacket\n");
+#endif
 
 	if (!driver_) return false;
+	// a partial packet is padded with zeros, which the device ignores
+	if (tx_head_ < tx_pipe_size_) memset(tx_buffer_ + tx_head_, 0, tx_pipe_size_ - tx_head_);
 	if (!driver_->sendPacket(tx_buffer_)) return false;
 	tx_out_data_pending_++;
 	tx_head_ = 0;
@@ -160,47 +164,62 @@ int USBSerialEmu::availableForWrite()
 
 size_t USBSerialEmu::write(uint8_t c)
 {
-	// Single buffer, as our HID device has double buffers. 
-	if (c >= ' ') USBHDBGSerial.printf("SEMU: %c\n", c);
-	else USBHDBGSerial.printf("SEMU: 0x%x\n", c);
-
-
-	if (!driver_) return 0;
+	return write(&c, 1);
+}
 
-	if (tx_head_ == tx_pipe_size_) {
-		while (!sendPacket()) yield();	// wait until the device above queues this packet 
+// Fill whole packets and send each as soon as it is full.  The timer
+// is only used to send a partial packet left at the end.
+size_t USBSerialEmu::write(const uint8_t *buffer, size_t size)
+{
+#ifdef SEREMU_PRINT_DEBUG
+	USBHDBGSerial.printf("SEMU: write %u\n", size);
+#endif
+	if (!driver_ || !tx_pipe_size_) return 0;
+	driver_->stopTimer();	// the timer must not send while we fill
+	size_t count = size;
+	while (size) {
+		if (tx_head_ == tx_pipe_size_) {
+			while (!sendPacket()) yield();	// wait until the device above queues this packet 
+		}
+		uint32_t n = tx_pipe_size_ - tx_head_;
+		if (n > size) n = size;
+		memcpy(tx_buffer_ + tx_head_, buffer, n);
+		tx_head_ += n;
+		buffer += n;
+		size -= n;
 	}
-	tx_buffer_[tx_head_++] = c;
-
-	// if this character filled it. then try to queue it again
+	// if this filled it, then try to queue it now
 	if (tx_head_ == tx_pipe_size_) sendPacket();
-	driver_->stopTimer();
-	driver_->startTimer(write_timeout_);
-	return 1;
+	if (tx_head_) driver_->startTimer(write_timeout_);
+	return count;
 }
 
 void USBSerialEmu::flush(void) 
 {
 	if (!driver_) return;
 
+#ifdef SEREMU_PRINT_DEBUG
 	USBHDBGSerial.printf("SEMU: flush\n");
+#endif
 	driver_->stopTimer();  		// Stop longer timer.
-	driver_->startTimer(100);		// Start a mimimal timeout
-	if (tx_head_) sendPacket();
+	if (tx_head_ && !sendPacket()) {
+		driver_->startTimer(100);	// Start a mimimal timeout
+	}
 
 	// And wait for HID to say they were all sent.
 	elapsedMillis em = 0;
-	while (tx_out_data_pending_ &&  (em < 10000)) yield(); // wait up to 10 seconds?
+	while ((tx_out_data_pending_ || tx_head_) && (em < 10000)) yield(); // wait up to 10 seconds?
 }
 
 void USBSerialEmu::hid_timer_event(USBDriverTimer *whichTimer)
 {
+#ifdef SEREMU_PRINT_DEBUG
 	USBHDBGSerial.printf("SEMU: Timer\n");
+#endif
 	if (!driver_) return;
 	driver_->stopTimer();
-	if (tx_head_) {
-		memset(tx_buffer_ + tx_head_, 0, tx_pipe_size_ - tx_head_);	// clear the rest of bytes in buffer.
-		sendPacket();
+	if (tx_head_ && !sendPacket()) {
+		driver_->startTimer(100);	// both buffers busy, try again soon
 	}
 }
 
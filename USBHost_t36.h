@@ -78,6 +78,8 @@
 
 // USBHost is a static class controlling the hardware.
 // All common USB functionality is implemented here.
+// Each EHCI controller's own state is kept in a Controller_t,
+// which every Device_t references.
 class USBHost;
 
 // These 3 structures represent the actual USB entities
@@ -91,6 +93,8 @@ class USBHost;
 typedef struct Device_struct       Device_t;
 typedef struct Pipe_struct         Pipe_t;
 typedef struct Transfer_struct     Transfer_t;
+typedef struct Enumeration_struct  Enumeration_t;
+typedef struct Controller_struct   Controller_t;
 typedef enum { CLAIM_NO=0, CLAIM_REPORT, CLAIM_INTERFACE} hidclaim_t;
 
 // All USB device drivers inherit use these classes.
@@ -148,6 +152,40 @@ class USBHIDInput;
 /*  Data Structure Definitions                  */
 /************************************************/
 
+// EHCI_registers_t overlays the host registers of the EHCI controllers
+// used by this library, starting at GPTIMER0LD.  USBHS on Teensy 3.6
+// and USB1 & USB2 on Teensy 4.x all share this layout.  All controller
+// access is through a pointer to this struct, so the same code can run
+// any controller, or a simulated controller in ordinary memory.
+typedef struct {
+	volatile uint32_t GPTIMER0LD;       // 080
+	volatile uint32_t GPTIMER0CTL;      // 084
+	volatile uint32_t GPTIMER1LD;       // 088
+	volatile uint32_t GPTIMER1CTL;      // 08C
+	volatile uint32_t SBUSCFG;          // 090
+	volatile uint32_t unused1[43];
+	volatile uint32_t USBCMD;           // 140
+	volatile uint32_t USBSTS;           // 144
+	volatile uint32_t USBINTR;          // 148
+	volatile uint32_t FRINDEX;          // 14C
+	volatile uint32_t unused2;
+	volatile uint32_t PERIODICLISTBASE; // 154
+	volatile uint32_t ASYNCLISTADDR;    // 158
+	volatile uint32_t unused3[10];
+	volatile uint32_t PORTSC1;          // 184
+	volatile uint32_t unused4[8];
+	volatile uint32_t USBMODE;          // 1A8
+} EHCI_registers_t;
+
+// Number of EHCI controllers usable as USB host.  Teensy 4.x can also
+// use USB1 (normally Teensy's own USB device port, so Tools > USB Type
+// must be "No USB") by defining USBHOST_USE_USB1.
+#if (defined(__IMXRT1052__) || defined(__IMXRT1062__)) && defined(USBHOST_USE_USB1)
+#define USBHOST_CONTROLLERS 2
+#else
+#define USBHOST_CONTROLLERS 1
+#endif
+
 // setup_t holds the 8 byte USB SETUP packet data.
 // These unions & structs allow convenient access to
 // the setup fields.
@@ -170,14 +208,60 @@ typedef union {
  };
 } setup_t;
 
+// Each strbuf_t holds a device's manufacturer, product and serial number
+// strings packed end to end, so short strings leave room for long ones.
+// Up to 255 bytes.  Strings are read after drivers claim the device, so
+// they may still be empty just after it connects.
+#if defined(USBHOST_STRING_BUF_SIZE)
+#define DEVICE_STRUCT_STRING_BUF_SIZE (USBHOST_STRING_BUF_SIZE)
+#else
+#define DEVICE_STRUCT_STRING_BUF_SIZE 50
+#endif
+
 typedef struct {
-	enum {STRING_BUF_SIZE=50};
+	enum {STRING_BUF_SIZE=DEVICE_STRUCT_STRING_BUF_SIZE};
 	enum {STR_ID_MAN=0, STR_ID_PROD, STR_ID_SERIAL, STR_ID_CNT};
 	uint8_t iStrings[STR_ID_CNT];	// Index into array for the three indexes
 	uint8_t buffer[STRING_BUF_SIZE];
 } strbuf_t;
 
-#define DEVICE_STRUCT_STRING_BUF_SIZE 50
+// usb_quirk_t is one known device in quirks.cpp: the driver it is for,
+// the device type within that driver and any special handling it needs.
+// An idProduct of 0 matches every product of the vendor.
+typedef struct {
+	uint32_t vidpid;	// idVendor << 16 | idProduct
+	uint8_t  driver;	// QUIRK_DRIVER_*
+	uint8_t  type;		// driver's own type, eg joytype_t
+	uint16_t flags;		// QUIRK_*
+} usb_quirk_t;
+
+enum { QUIRK_DRIVER_HID=1, QUIRK_DRIVER_JOYSTICK, QUIRK_DRIVER_KEYBOARD,
+	QUIRK_DRIVER_SERIAL, QUIRK_DRIVER_BLUETOOTH };
+#define QUIRK_HID_DEVICE		0x0001	// joystick reached through USBHIDParser
+#define QUIRK_CLAIM_INTERFACE		0x0002	// claim at interface, not device level
+#define QUIRK_PS3_FEATURE_F4		0x0004	// needs feature report 0xF4 to start
+#define QUIRK_XBOXONE_S_INIT		0x0008	// XBox One S/Elite leave bluetooth mode
+#define QUIRK_XBOXONE_PDP_INIT		0x0010	// PDP aftermarket init packets
+#define QUIRK_FORCE_BOOT_PROTOCOL	0x0020	// keyboard only works in boot protocol
+
+// usb_match_t is one device or interface a driver can claim.  Drivers
+// which set match_list are only offered devices and interfaces matching
+// one of its entries.  The list ends with an entry whose match is 0.
+typedef struct {
+	uint8_t  match;		// USB_MATCH_* fields to compare
+	uint8_t  bClass;	// device or interface class, subclass, protocol
+	uint8_t  bSubClass;
+	uint8_t  bProtocol;
+	uint16_t idVendor;
+	uint16_t idProduct;
+} usb_match_t;
+
+#define USB_MATCH_DEVICE	0x01	// device level (type 0), else interface
+#define USB_MATCH_CLASS		0x02
+#define USB_MATCH_SUBCLASS	0x04
+#define USB_MATCH_PROTOCOL	0x08
+#define USB_MATCH_VENDOR	0x10
+#define USB_MATCH_PRODUCT	0x20
 
 // Device_t holds all the information about a USB device
 struct Device_struct {
@@ -186,10 +270,15 @@ struct Device_struct {
 	Device_t *next;
 	USBDriver *drivers;
 	strbuf_t *strbuf;
+	Enumeration_t *enumeration; // buffers used only while enumerating
+	Controller_t *controller; // EHCI controller this device is connected to
 	uint8_t  speed; // 0=12, 1=1.5, 2=480 Mbit/sec
 	uint8_t  address;
 	uint8_t  hub_address;
 	uint8_t  hub_port;
+	uint8_t  tt_address; // high speed hub with the transaction translator
+	uint8_t  tt_port;    // port on that hub, selects the TT on Multi-TT hubs
+	uint8_t  tt_multi;   // 1 if the hub has a separate TT for each port
 	uint8_t  enum_state;
 	uint8_t  bDeviceClass;
 	uint8_t  bDeviceSubClass;
@@ -272,9 +361,12 @@ struct Transfer_struct {
 
 class USBHost {
 public:
-	static void begin();
+	static void begin(uint32_t controller_num = 0);
 	static void Task();
 	static void countFree(uint32_t &devices, uint32_t &pipes, uint32_t &trans, uint32_t &strs);
+	// Forget the descriptors and strings kept to quickly enumerate
+	// devices which disconnect and reconnect.
+	static void clearEnumerationCache();
 protected:
 	static Pipe_t * new_Pipe(Device_t *dev, uint32_t type, uint32_t endpoint,
 		uint32_t direction, uint32_t maxlen, uint32_t interval=0);
@@ -282,11 +374,13 @@ protected:
 		void *buf, USBDriver *driver);
 	static bool queue_Data_Transfer(Pipe_t *pipe, void *buffer,
 		uint32_t len, USBDriver *driver);
-	static Device_t * new_Device(uint32_t speed, uint32_t hub_addr, uint32_t hub_port);
+	static Device_t * new_Device(Controller_t *controller, uint32_t speed,
+		uint32_t hub_addr, uint32_t hub_port);
 	static void disconnect_Device(Device_t *dev);
 	static void enumeration(const Transfer_t *transfer);
 	static void driver_ready_for_device(USBDriver *driver);
-	static volatile bool enumeration_busy;
+	static void mask_interrupts(bool mask);
+	static bool enumeration_busy(Controller_t *controller);
 public: // Maybe others may want/need to contribute memory example HID devices may want to add transfers.
 	static void contribute_Devices(Device_t *devices, uint32_t num);
 	static void contribute_Pipes(Pipe_t *pipes, uint32_t num);
@@ -294,11 +388,19 @@ public: // Maybe others may want/need to contribute memory example HID devices m
 	static void contribute_String_Buffers(strbuf_t *strbuf, uint32_t num);
 private:
 	static void isr();
+#if USBHOST_CONTROLLERS > 1
+	static void isr2();
+#endif
+	static void controller_isr(Controller_t *c);
 	static void convertStringDescriptorToASCIIString(uint8_t string_index, Device_t *dev, const Transfer_t *transfer);
 	static void claim_drivers(Device_t *dev);
-	static uint32_t assign_address(void);
+	static void find_transaction_translator(Device_t *dev);
+	static uint32_t assign_address(Controller_t *controller);
 	static bool queue_Transfer(Pipe_t *pipe, Transfer_t *transfer);
 	static void init_Device_Pipe_Transfer_memory(void);
+	static void init_Enumeration_memory(void);
+	static Enumeration_t * allocate_enumeration(void);
+	static void free_enumeration(Enumeration_t *e);
 	static Device_t * allocate_Device(void);
 	static void delete_Pipe(Pipe_t *pipe);
 	static void free_Device(Device_t *q);
@@ -312,8 +414,9 @@ private:
 		uint32_t maxlen, uint32_t interval);
 	static void add_qh_to_periodic_schedule(Pipe_t *pipe);
 	static bool followup_Transfer(Transfer_t *transfer);
-	static void followup_Error(void);
+	static void followup_Error(Controller_t *c);
 protected:
+	static const usb_quirk_t * find_quirk(uint16_t idVendor, uint16_t idProduct, uint8_t driver);
 #ifdef USBHOST_PRINT_DEBUG
 	static void print_(const Transfer_t *transfer);
 	static void print_(const Transfer_t *first, const Transfer_t *last);
@@ -431,7 +534,7 @@ public:
 		return &dev->strbuf->buffer[dev->strbuf->iStrings[strbuf_t::STR_ID_SERIAL]];
 	}
 protected:
-	USBDriver() : next(NULL), device(NULL) {}
+	USBDriver() : next(NULL), device(NULL), match_list(NULL) {}
 	// Check if a driver wishes to claim a device or interface or group
 	// of interfaces within a device.  When this function returns true,
 	// the driver is considered bound or loaded for that device.  When
@@ -481,6 +584,11 @@ protected:
 	// wish to claim any device or interface (eg, if getting data
 	// from the HID parser).
 	Device_t *device;
+
+	// Optional list of what this driver can claim, so enumeration.cpp
+	// need not call claim() for devices and interfaces it would reject.
+	// When NULL, claim() is called for everything.
+	const usb_match_t *match_list;
 	friend class USBHost;
 };
 
@@ -510,6 +618,13 @@ private:
 // HID input data fully decoded by the USBHIDParser driver
 class USBHIDParser;
 
+// hidevent_t is one HID input field, as stored in a driver's event queue
+typedef struct {
+	uint32_t micros;	// when its report arrived
+	uint32_t usage;		// usage page << 16 | usage
+	int32_t  value;
+} hidevent_t;
+
 class USBHIDInput {
 public:
 	operator bool() { return (mydevice != nullptr); }
@@ -522,8 +637,26 @@ public:
 	const uint8_t *serialNumber()
 		{  return  ((mydevice == nullptr) || (mydevice->strbuf == nullptr)) ? nullptr : &mydevice->strbuf->buffer[mydevice->strbuf->iStrings[strbuf_t::STR_ID_SERIAL]]; }
 
+	// Optional queue of every input field with its arrival time, so no
+	// presses or motion are lost when the sketch reads more slowly than
+	// reports arrive.  The sketch provides the buffer.  Events are added
+	// from the USB interrupt and read by readEvent(), without locking.
+	void attachEventQueue(hidevent_t *buffer, uint16_t size);
+	uint16_t eventsAvailable();
+	bool readEvent(hidevent_t &event);
+	uint32_t eventsDropped() { return event_dropped; }
 
 private:
+	void input_data(uint32_t usage, int32_t value, uint32_t us) {
+		if (event_buffer) queue_event(usage, value, us);
+		hid_input_data(usage, value);
+	}
+	void queue_event(uint32_t usage, int32_t value, uint32_t us);
+	hidevent_t *event_buffer = NULL;
+	uint16_t event_size = 0;
+	volatile uint16_t event_head = 0;
+	volatile uint16_t event_tail = 0;
+	uint32_t event_dropped = 0;
 	virtual hidclaim_t claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage);
 	virtual bool hid_process_in_data(const Transfer_t *transfer) {return false;}
 	virtual bool hid_process_out_data(const Transfer_t *transfer) {return false;}
@@ -533,11 +666,17 @@ private:
 	virtual void hid_input_end();
 	virtual void disconnect_collection(Device_t *dev);
 	virtual void hid_timer_event(USBDriverTimer *whichTimer) { }
+	virtual void hid_feature_report(uint8_t report_id, const uint8_t *data, uint32_t len) { }
 	void add_to_list();
 	USBHIDInput *next = NULL;
 	friend class USBHIDParser;
 protected:
 	Device_t *mydevice = NULL;
+	// Drivers which keep state (not relative motion) may set this to
+	// receive only the fields which changed since the prior report with
+	// the same report ID.  Identical reports give no callbacks at all.
+	// Array fields are given in full when any of their items change.
+	bool hid_changes_only = false;
 };
 
 
@@ -583,12 +722,12 @@ class USBHub : public USBDriver {
 public:
 	USBHub(USBHost &host) : debouncetimer(this), resettimer(this) { init(); }
 	USBHub(USBHost *host) : debouncetimer(this), resettimer(this) { init(); }
-	// Hubs with more more than 7 ports are built from two tiers of hubs
-	// using 4 or 7 port hub chips.  While the USB spec seems to allow
-	// hubs to have up to 255 ports, in practice all hub chips on the
-	// market are only 2, 3, 4 or 7 ports.
-	enum { MAXPORTS = 7 };
-	typedef uint8_t portbitmask_t;
+	// Most hubs with more than 7 ports are built from two tiers of hubs
+	// using 4 or 7 port hub chips, but some industrial hubs use 10 port
+	// chips.  The number of ports in use is read from the hub descriptor.
+	// Port bitmasks and the status change endpoint limit us to 15 ports.
+	enum { MAXPORTS = 15 };
+	typedef uint16_t portbitmask_t;
 	enum {
 		PORT_OFF =        0,
 		PORT_DISCONNECT = 1,
@@ -601,13 +740,22 @@ public:
 		PORT_RECOVERY =   8,
 		PORT_ACTIVE =     9
 	};
+	enum { DEBOUNCE_MICROS = 100000, DEBOUNCE_MISS_LIMIT = 3 };
+	// Read every debouncing port's status every 20 ms, rather than
+	// waiting for the status change pipe.  Needed by a few hubs.
+	void debounceByPolling(bool polling) {
+		debounce_polling_user = polling;
+		debounce_polling = polling;
+	}
 protected:
 	virtual bool claim(Device_t *dev, int type, const uint8_t *descriptors, uint32_t len);
 	virtual void control(const Transfer_t *transfer);
 	virtual void timer_event(USBDriverTimer *whichTimer);
 	virtual void disconnect();
 	void init();
-	bool can_send_control_now();
+	setup_t * can_send_control_now();
+	bool queue_hub_control(setup_t *s, void *buf);
+	void send_pending();
 	void send_poweron(uint32_t port);
 	void send_getstatus(uint32_t port);
 	void send_clearstatus_connect(uint32_t port);
@@ -622,18 +770,24 @@ protected:
 	void new_port_status(uint32_t port, uint32_t status);
 	void start_debounce_timer(uint32_t port);
 	void stop_debounce_timer(uint32_t port);
+	void schedule_debounce_timer();
+	bool begin_port_reset(uint32_t port);
 private:
+	// number of hub requests which may be queued at once, each
+	// needs up to 3 Transfer_t while in the EHCI async schedule
+	enum { CONTROL_SLOTS = 4 };
 	Device_t mydevices[MAXPORTS];
 	Pipe_t mypipes[2] __attribute__ ((aligned(32)));
-	Transfer_t mytransfers[4] __attribute__ ((aligned(32)));
+	Transfer_t mytransfers[CONTROL_SLOTS*3 + 2] __attribute__ ((aligned(32)));
 	strbuf_t mystring_bufs[1];
 	USBDriverTimer debouncetimer;
 	USBDriverTimer resettimer;
-	setup_t setup;
+	setup_t setup[CONTROL_SLOTS];
 	Pipe_t *changepipe;
 	Device_t *devicelist[MAXPORTS];
 	uint32_t changebits;
-	uint32_t statusbits;
+	uint32_t statusbits[CONTROL_SLOTS];
+	uint32_t change_micros;
 	uint8_t  hub_desc[16];
 	uint8_t  interface_count;
 	uint8_t  interface_number;
@@ -641,10 +795,13 @@ private:
 	uint8_t  protocol;
 	uint8_t  endpoint;
 	uint8_t  interval;
+	uint8_t  changesize;
 	uint8_t  numports;
 	uint8_t  characteristics;
 	uint8_t  powertime;
-	uint8_t  sending_control_transfer;
+	uint8_t  control_busy; // bitmask of setup[] slots in use
+	uint8_t  control_order[CONTROL_SLOTS]; // slots in the order queued
+	uint8_t  control_queued;	// number of slots in control_order
 	uint8_t  port_doing_reset;
 	uint8_t  port_doing_reset_speed;
 	uint8_t  portstate[MAXPORTS];
@@ -657,17 +814,56 @@ private:
 	portbitmask_t send_pending_clearstatus_reset;
 	portbitmask_t send_pending_setreset;
 	portbitmask_t debounce_in_use;
+	portbitmask_t debounce_checking; // deadline status read in progress
+	bool     debounce_polling;       // hub needs 20 ms status polling
+	bool     debounce_polling_user = false; // debounceByPolling() setting
+	uint8_t  debounce_misses;        // bounces the status change pipe missed
+	uint32_t debounce_micros[MAXPORTS]; // time of last connection change
 	static volatile bool reset_busy;
 };
 
 //--------------------------------------------------------------------------
 
 
+// hidfield_t is one Input item of a HID report descriptor, compiled
+// at claim time so incoming reports don't need the descriptor parsed.
+typedef struct {
+	uint16_t bitindex;	// first bit, within its report
+	uint16_t count;		// Report Count
+	uint16_t type;		// Input item data: bit 0 const, bit 1 variable
+	uint16_t usage_page;
+	uint16_t usage_min;	// first usage, or index into usage list
+	uint16_t usage_max;	// last usage, or number in usage list
+	int32_t  logical_min;
+	int32_t  logical_max;
+	uint8_t  size;		// Report Size, in bits
+	uint8_t  report_id;
+	uint8_t  topusage_index;
+	uint8_t  op;		// HIDFIELD_* below
+} hidfield_t;
+#define HIDFIELD_USAGE_LIST	0 // usages from a list
+#define HIDFIELD_USAGE_RANGE	1 // usages from min to max
+#define HIDFIELD_ARRAY		2 // array, each item is a usage number
+#define HIDFIELD_END_COLLECTION	3 // end of a claimed top level collection
+#define HIDFIELD_OUTPUT		0x10 // flag: Output item, not Input
+#define HIDFIELD_FEATURE	0x20 // flag: Feature item, not Input
+
+// A capture function receives the report descriptor once (CAPTURE_DESCRIPTOR),
+// then every input report (CAPTURE_REPORT) with its arrival time and the
+// cycles the parser and drivers spent on it.  Saved, these can be given
+// back to replayReport() to time or compare drivers without the device.
+enum { CAPTURE_DESCRIPTOR=0, CAPTURE_REPORT=1 };
+typedef void (*capture_function_t)(USBHIDParser *parser, uint8_t type,
+	const uint8_t *data, uint32_t len, uint32_t micros, uint32_t cycles);
+
 class USBHIDParser : public USBDriver {
 public:
 	USBHIDParser(USBHost &host) : hidTimer(this) { init(); }
 	static void driver_ready_for_hid_collection(USBHIDInput *driver);
 	bool sendPacket(const uint8_t *buffer, int cb=-1);
+	// Send directly from the caller's buffer, which must not change until
+	// hid_process_out_data() is called with it.  Any number may be queued.
+	bool sendPacketInPlace(const uint8_t *buffer, int cb=-1);
 	void setTXBuffers(uint8_t *buffer1, uint8_t *buffer2, uint8_t cb);
 
 	bool sendControlPacket(uint32_t bmRequestType, uint32_t bRequest,
@@ -680,9 +876,47 @@ public:
 	void startTimer(uint32_t microseconds) {hidTimer.start(microseconds);}
 	void stopTimer() {hidTimer.stop();}
 	uint8_t interfaceNumber() { return bInterfaceNumber;}
+
+	// Output and Feature reports, laid out from the report descriptor.
+	// Fields are set by usage (page << 16 | usage).  Setting a field in
+	// a different report ID starts a new report.  Sending is done with
+	// SET_REPORT on the control pipe.  requestFeature() reads a Feature
+	// report with GET_REPORT, and calls the driver's hid_feature_report()
+	// when it arrives, after which getFeature() reads its fields.
+	bool setOutput(uint32_t usage, int32_t value);
+	bool sendOutput();
+	bool setFeature(uint32_t usage, int32_t value);
+	bool sendFeature();
+	bool requestFeature(uint8_t report_id, USBHIDInput *driver=nullptr);
+	int32_t getFeature(uint32_t usage);
+	uint32_t enableResolutionMultiplier();
+
+	// The report descriptor, field table and report buffers of every
+	// USBHIDParser come from one shared arena, USBHOST_HID_ARENA_SIZE
+	// bytes unless more memory is contributed.  memoryUsage() gives the
+	// bytes in use, free, and the largest free block (fragmentation).
+	static void contribute_Memory(void *mem, uint32_t size);
+	static void memoryUsage(uint32_t &used, uint32_t &available, uint32_t &largest);
+
+	// Capture and replay of input reports.  Attach the capture before
+	// the device connects to also receive its report descriptor.
+	// replayReport() parses a report as if the device had sent it,
+	// returning the cycles taken (micros without a cycle counter).  The
+	// USB interrupt is masked meanwhile, so the device's own reports wait
+	// and are not mixed into the drivers' state.
+	void attachCapture(capture_function_t f);
+	uint32_t replayReport(const uint8_t *data, uint32_t len);
+	uint32_t maxReportCycles() { return max_report_cycles; }
 protected:
-	enum { TOPUSAGE_LIST_LEN = 4 };
-	enum { USAGE_LIST_LEN = 24 };
+	enum { TOPUSAGE_LIST_LEN = 8 };
+	enum { USAGE_LIST_LEN = 32 };
+	enum { FIELD_LIST_LEN = 32 };
+	enum { FIELD_USAGE_LEN = 64 };
+	enum { PRIOR_REPORT_COUNT = 2 };
+	enum { REPORT_FIELD_LIST_LEN = 16 };
+	// IN transfers kept queued, so the next is always armed while the
+	// current report is processed, even at 8 kHz high speed polling
+	enum { IN_REPORT_COUNT = 3 };
 	virtual bool claim(Device_t *device, int type, const uint8_t *descriptors, uint32_t len);
 	virtual void control(const Transfer_t *transfer);
 	virtual void disconnect();
@@ -695,7 +929,16 @@ protected:
 	void parse();
 	USBHIDInput * find_driver(uint32_t topusage);
 	void parse(uint16_t type_and_report_id, const uint8_t *data, uint32_t len);
+	void compile_fields();
+	void parse_fields(uint8_t report_id, const uint8_t *data, uint32_t len);
+	const hidfield_t * find_report_field(uint32_t kind, uint32_t usage, uint32_t *item);
+	uint32_t report_length(uint32_t kind, uint32_t report_id);
+	uint32_t max_report_length(uint32_t kind);
+	bool set_report_field(uint32_t kind, uint8_t *buf, uint32_t bufsize,
+		uint8_t &report_id, uint32_t usage, int32_t value);
 	void init();
+	bool alloc_buffers(uint32_t insize);
+	void free_buffers();
 
 
 	uint8_t activeSendMask(void) {return txstate;} 
@@ -704,29 +947,77 @@ private:
 	Pipe_t *in_pipe;
 	Pipe_t *out_pipe;
 	static USBHIDInput *available_hid_drivers_list;
-	//uint32_t topusage_list[TOPUSAGE_LIST_LEN];
+	uint32_t topusage_list[TOPUSAGE_LIST_LEN];
 	USBHIDInput *topusage_drivers[TOPUSAGE_LIST_LEN];
 	uint16_t in_size;
 	uint16_t out_size;
 	setup_t setup;
-	uint8_t descriptor[800];
-	uint8_t report[64];
-	uint8_t report2[64];
+	uint8_t *descriptor = nullptr;	// from the arena, until the fields compile
+	uint8_t *reports[IN_REPORT_COUNT] = {nullptr, nullptr, nullptr};
 	uint16_t descsize;
 	bool use_report_id;
+	bool fields_compiled;
+	uint8_t field_count;
+	// compiled into the scratch arrays, then copied to the arena
+	hidfield_t *fields = nullptr;
+	uint16_t *field_usages = nullptr;
+	uint8_t *layout = nullptr;
+	uint16_t layout_size = 0;
+	static hidfield_t scratch_fields[FIELD_LIST_LEN];
+	static hidfield_t scratch_report_fields[REPORT_FIELD_LIST_LEN];
+	static uint16_t scratch_field_usages[FIELD_USAGE_LEN];
+	// prior reports, for drivers using hid_changes_only, each in_size
+	// bytes in the arena
+	uint8_t *prior_report = nullptr;
+	uint8_t prior_report_id[PRIOR_REPORT_COUNT];
+	uint16_t prior_report_len[PRIOR_REPORT_COUNT];
+	uint8_t prior_report_next;
+	// Output & Feature report layout and buffers
+	hidfield_t *report_fields = nullptr;
+	uint8_t report_field_count;
+	uint8_t output_report_id;
+	uint8_t feature_report_id;
+	uint8_t resolution_multiplier;	// wheel counts per detent, 0 if none
+	// sized for the longest report of each kind, in the arena
+	uint8_t *output_report = nullptr;
+	uint8_t *feature_report = nullptr;
+	uint16_t output_report_size = 0;
+	uint16_t feature_report_size = 0;
+	setup_t output_setup;
+	setup_t feature_setup;
+	USBHIDInput *feature_driver;
 	Pipe_t mypipes[3] __attribute__ ((aligned(32)));
-	Transfer_t mytransfers[5] __attribute__ ((aligned(32)));
+	Transfer_t mytransfers[3+IN_REPORT_COUNT] __attribute__ ((aligned(32)));
 	strbuf_t mystring_bufs[1];
 	uint8_t txstate = 0;
 	uint8_t *tx1 = nullptr;
 	uint8_t *tx2 = nullptr;
+	bool tx_from_arena = false;
 	bool hid_driver_claimed_control_ = false;
+	capture_function_t capture_ = nullptr;
+	uint32_t max_report_cycles = 0;
+	uint32_t process_report(const Transfer_t *transfer);
 	USBDriverTimer hidTimer;
 	uint8_t bInterfaceNumber = 0;
 };
 
 //--------------------------------------------------------------------------
 
+// A keyboard layout gives the character for each key (usage below 0x40)
+// with no modifier, Shift, AltGr and Shift+AltGr, or 1 to 7 for a dead
+// key.  What a dead key does to the next key is in a short list.  Both
+// may be const, so a layout can stay in flash.
+typedef struct {
+	uint16_t code;		// dead key << 8 | modifier class << 6 | key
+	uint8_t  ch;
+} keyboard_deadkey_t;
+
+typedef struct {
+	uint8_t keys[4][64];
+	uint8_t deadkey_count;
+	const keyboard_deadkey_t *deadkeys;
+} keyboard_layout_t;
+
 class KeyboardController : public USBDriver , public USBHIDInput, public BTHIDInput {
 public:
 typedef union {
@@ -740,9 +1031,15 @@ typedef union {
         };
     uint8_t byte;
 } KBDLeds_t;
+typedef struct {
+	uint8_t keycode;	// Keyboard page usage, 0xE0-0xE7 are modifiers
+	uint8_t modifiers;
+	uint8_t pressed;	// 1 = press, 0 = release
+	uint8_t repeat;		// 1 = generated by key repeat
+} keyevent_t;
 public:
-	KeyboardController(USBHost &host) { init(); }
-	KeyboardController(USBHost *host) { init(); }
+	KeyboardController(USBHost &host) : keyRepeatTimer((USBDriver *)this) { init(); }
+	KeyboardController(USBHost *host) : keyRepeatTimer((USBDriver *)this) { init(); }
 
 	// need their own versions as both USBDriver and USBHIDInput provide
 	uint16_t idVendor();
@@ -775,12 +1072,22 @@ public:
 	void     attachExtrasRelease(void (*f)(uint32_t top, uint16_t code)) { extrasKeyReleasedFunction = f; }
 	void	 forceBootProtocol();
 	enum {MAX_KEYS_DOWN=4};
+	// Every press and release, boot or N-key rollover, is also queued
+	// for readKeyEvent().  Key repeat is off until setKeyRepeat().
+	bool	 readKeyEvent(keyevent_t &event);
+	void	 setKeyRepeat(uint16_t delay_ms, uint16_t rate_ms);
+	enum {KEY_EVENT_LEN=32};
+	// Layout used to convert keys to characters, by default the one
+	// Teensyduino was built with
+	void	 setLayout(const keyboard_layout_t *layout) { layout_ = layout; dead_key_ = 0; }
+	static const keyboard_layout_t * defaultLayout();
 
 
 protected:
 	virtual bool claim(Device_t *device, int type, const uint8_t *descriptors, uint32_t len);
 	virtual void control(const Transfer_t *transfer);
 	virtual void disconnect();
+	virtual void timer_event(USBDriverTimer *whichTimer);
 	static void callback(const Transfer_t *transfer);
 	void new_data(const Transfer_t *transfer);
 	void init();
@@ -814,7 +1121,6 @@ private:
 	uint16_t keyCode;
 	uint8_t modifiers;
 	uint8_t keyOEM;
-	uint8_t prev_report[8];
 	KBDLeds_t leds_ = {0};
 	Pipe_t mypipes[2] __attribute__ ((aligned(32)));
 	Transfer_t mytransfers[4] __attribute__ ((aligned(32)));
@@ -831,6 +1137,27 @@ private:
 	uint16_t keys_down[MAX_KEYS_DOWN];
 	bool 	force_boot_protocol;  // User or VID/PID said force boot protocol?
 	bool control_queued;
+
+	// Key state, one bit per Keyboard page usage, from the boot report and
+	// from an N-key rollover bitmap report through USBHIDParser
+	bool boot_report_to_keys(const uint8_t *data, uint32_t len);
+	void update_keys();
+	void key_event(uint32_t key, uint32_t mod, bool pressed);
+	void queue_key_event(uint32_t key, uint32_t mod, bool pressed, bool repeat);
+	USBHIDParser *hiddriver_ = nullptr;
+	uint32_t boot_keys[8];
+	uint32_t hid_keys[8];
+	uint32_t hid_keys_new[8];
+	uint32_t keys_reported[8];
+	keyevent_t key_events[KEY_EVENT_LEN];
+	volatile uint8_t key_event_head = 0;
+	volatile uint8_t key_event_tail = 0;
+	USBDriverTimer keyRepeatTimer;
+	uint8_t  repeat_key_ = 0;
+	const keyboard_layout_t *layout_ = nullptr;
+	uint8_t  dead_key_ = 0;		// dead key waiting for the next key
+	uint16_t repeat_delay_ = 0;
+	uint16_t repeat_rate_ = 0;
 };
 
 
@@ -838,12 +1165,21 @@ class MouseController : public USBHIDInput, public BTHIDInput {
 public:
 	MouseController(USBHost &host) { init(); }
 	bool	available() { return mouseEvent; }
+	// Motion and wheel are summed over every report since the prior
+	// mouseDataClear(), which removes only the amounts already read.
+	// Absolute positions (tablets) stay until the next one arrives.
 	void	mouseDataClear();
 	uint8_t getButtons() { return buttons; }
-	int     getMouseX() { return mouseX; }
-	int     getMouseY() { return mouseY; }
-	int     getWheel() { return wheel; }
-	int     getWheelH() { return wheelH; }
+	int     getMouseX() { return read_motion(MOTION_X); }
+	int     getMouseY() { return read_motion(MOTION_Y); }
+	int     getWheel() { return read_motion(MOTION_WHEEL); }
+	int     getWheelH() { return read_motion(MOTION_WHEELH); }
+	// Wheels with a Resolution Multiplier report fractions of a detent.
+	// getWheel() and getWheelH() give whole detents, these give the
+	// counts, wheelResolution() per detent.
+	int     getWheelHiRes() { return read_motion(MOTION_WHEEL_HIRES); }
+	int     getWheelHHiRes() { return read_motion(MOTION_WHEELH_HIRES); }
+	uint32_t wheelResolution() { return wheel_multiplier; }
 protected:
 	virtual hidclaim_t claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage);
 	virtual void hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax);
@@ -861,20 +1197,41 @@ private:
 	void init();
 	BluetoothController *btdriver_ = nullptr;
 
+	enum { MOTION_X=0, MOTION_Y, MOTION_WHEEL, MOTION_WHEELH,
+		MOTION_WHEEL_HIRES, MOTION_WHEELH_HIRES, MOTION_COUNT };
+	int read_motion(uint32_t axis);
+	void add_motion(uint32_t axis, int32_t value);
+	void set_motion(uint32_t axis, int32_t value);
+	void add_wheel(uint32_t which, int32_t value);
+	USBHIDParser *driver_ = nullptr;
+	bool resolution_pending_ = false;
+	uint8_t wheel_multiplier = 1;	// wheel counts per detent
+	int32_t wheel_remainder[2] = {0, 0};	// counts toward the next detent
 	uint8_t collections_claimed = 0;
 	volatile bool mouseEvent = false;
 	volatile bool hid_input_begin_ = false;
+	bool relative_ = true;		// current Input item is relative
+	uint8_t motion_absolute = 0;	// bitmask of axes last given absolute
 	uint8_t buttons = 0;
-	int     mouseX = 0;
-	int     mouseY = 0;
-	int     wheel = 0;
-	int     wheelH = 0;
+	uint8_t motion_read = 0;	// bitmask of axes read since mouseDataClear
+	volatile int32_t motion[MOTION_COUNT] = {0, 0, 0, 0, 0, 0};
+	int32_t motion_seen[MOTION_COUNT];	// amount each read returned
 };
 
 //--------------------------------------------------------------------------
 
+// touch_t is one finger on a multi-touch digitizer
+typedef struct {
+	uint8_t  id;		// Contact Identifier
+	uint8_t  event;		// TOUCH_DOWN, TOUCH_MOVE or TOUCH_UP, for events
+	int32_t  x;
+	int32_t  y;
+} touch_t;
+
 class DigitizerController : public USBHIDInput, public BTHIDInput {
 public:
+	enum { TOUCH_DOWN=1, TOUCH_MOVE=2, TOUCH_UP=3 };
+	enum { MAX_CONTACTS=10, TOUCH_EVENT_LEN=32 };
 	DigitizerController(USBHost &host) { init(); }
 	bool	available() { return digitizerEvent; }
 	void	digitizerDataClear();
@@ -884,6 +1241,12 @@ public:
 	int     getWheel() { return wheel; }
 	int     getWheelH() { return wheelH; }
 	int		getAxis(uint32_t index) { return (index < (sizeof(digiAxes)/sizeof(digiAxes[0]))) ? digiAxes[index] : 0; }
+	// Multi-touch panels: getTouches() copies the fingers currently down,
+	// as of the last complete frame.  readTouchEvent() gives each finger's
+	// down, move and up in order.  Neither disables interrupts.
+	uint32_t getTouches(touch_t *list, uint32_t max);
+	bool	readTouchEvent(touch_t &event);
+	uint32_t touchEventsDropped() { return touch_event_dropped; }
 
 protected:
 	virtual hidclaim_t claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage);
@@ -905,6 +1268,32 @@ private:
 	int     wheel = 0;
 	int     wheelH = 0;
 	int     digiAxes[16];
+
+	// contact tracking, only touched by the USB interrupt
+	void stage_contact();
+	void commit_contact(const touch_t &contact, uint32_t tip);
+	void end_touch_frame();
+	void queue_touch_event(const touch_t &t, uint8_t event);
+	bool    touch_report = false;	// current report is from a 0x0D page collection
+	uint8_t contact_fields = 0;	// which of tip, id, x, y are in contact
+	uint8_t contact_tip = 0;
+	touch_t contact;		// contact being received
+	uint8_t slot_count = 0;		// contacts received in this report
+	uint8_t slot_tip[MAX_CONTACTS];
+	touch_t slots[MAX_CONTACTS];
+	uint8_t frame_expected = 0;	// Contact Count of the current frame
+	uint8_t frame_received = 0;
+	uint8_t contact_count = 0;
+	uint16_t contact_seen = 0;	// bitmask of contacts[] in this frame
+	touch_t contacts[MAX_CONTACTS];
+	// published copy of contacts[], guarded by touch_seq (odd while writing)
+	volatile uint32_t touch_seq = 0;
+	uint8_t touch_count = 0;
+	touch_t touch_list[MAX_CONTACTS];
+	touch_t touch_events[TOUCH_EVENT_LEN];
+	volatile uint8_t touch_event_head = 0;
+	volatile uint8_t touch_event_tail = 0;
+	uint32_t touch_event_dropped = 0;
 };
 
 
@@ -912,7 +1301,7 @@ private:
 
 class JoystickController : public USBDriver, public USBHIDInput, public BTHIDInput {
 public:
-	JoystickController(USBHost &host) : JoystickPeriodicTimer(this)
+	JoystickController(USBHost &host) : JoystickPeriodicTimer((USBDriver *)this)
 		{ init(); }
 
 	USBDriverTimer JoystickPeriodicTimer;
@@ -929,10 +1318,17 @@ public:
 	void    joystickDataClear();
 	uint32_t getButtons() { return buttons; }
 	int		getAxis(uint32_t index) { return (index < (sizeof(axis)/sizeof(axis[0]))) ? axis[index] : 0; }
-	uint64_t axisMask() {return axis_mask_;}
+	uint64_t axisMask() {return axis_mask_ | axis_present_;}
 	uint64_t axisChangedMask() { return axis_changed_mask_;}
 	uint64_t axisChangeNotifyMask() {return axis_change_notify_mask_;}
 	void 	 axisChangeNotifyMask(uint64_t notify_mask) {axis_change_notify_mask_ = notify_mask;}
+	// HID joysticks: standard axes scaled from their logical range to
+	// -32768 to 32767, with values within the deadzone of center as 0,
+	// and the hat switch as HAT_UP | HAT_RIGHT... (0 when centered)
+	int16_t getAxisNormalized(uint32_t index) { return (index < STANDARD_AXIS_COUNT) ? axis_norm_[index] : 0; }
+	void	setDeadzone(uint16_t deadzone);
+	uint8_t	getHat() { return hat_; }
+	enum { HAT_UP=1, HAT_RIGHT=2, HAT_DOWN=4, HAT_LEFT=8 };
 
 	//Send a custom buffer of data to txpipe
 	bool sendRaw(uint8_t *data, uint8_t len);
@@ -1009,9 +1405,22 @@ private:
 	uint32_t buttons = 0;
 	int axis[TOTAL_AXIS_COUNT] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 	uint64_t axis_mask_ = 0;	// which axis have valid data
+	uint64_t axis_present_ = 0;	// HID axes seen, kept by joystickDataClear()
 	uint64_t axis_changed_mask_ = 0;
 	uint64_t axis_change_notify_mask_ = 0x3ff;	// assume the low 10 values only. 
 
+	// HID axis scaling, computed when each axis first arrives
+	int16_t normalize_axis(uint32_t index, int32_t value);
+	int32_t field_lgmin_ = 0;	// logical range of the field being received
+	int32_t field_lgmax_ = 0;
+	int32_t axis_lgmin_[STANDARD_AXIS_COUNT];
+	int32_t axis_lgmax_[STANDARD_AXIS_COUNT];
+	uint32_t axis_scale_[STANDARD_AXIS_COUNT];	// 16.16 fixed point, 0 = not yet known
+	int16_t axis_norm_[STANDARD_AXIS_COUNT] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	uint16_t deadzone_ = 0;
+	uint32_t deadzone_scale_ = 0x10000;	// 16.16, stretches the rest to full range
+	uint8_t hat_ = 0;
+
 	uint16_t additional_axis_usage_page_ = 0;
 	uint16_t additional_axis_usage_start_ = 0;
 	uint16_t additional_axis_usage_count_ = 0;
@@ -1045,15 +1454,6 @@ private:
 	uint8_t 		rxbuf_[64];	// receive circular buffer
 	uint8_t			txbuf_[64];		// buffer to use to send commands to joystick 
 	volatile bool 		send_Control_packet_active_;
-	// Mapping table to say which devices we handle
-	typedef struct {
-		uint16_t 	idVendor;
-		uint16_t 	idProduct;
-		joytype_t	joyType;
-		bool 		hidDevice;
-	} product_vendor_mapping_t;
-	static product_vendor_mapping_t pid_vid_mapping[];
-
 };
 
 
@@ -1433,6 +1833,7 @@ class USBSerialBase: public USBDriver, public Stream {
 
 	// FIXME: need different USBSerial, with bigger buffers for 480 Mbit & faster speed
 	enum { BUFFER_SIZE = 648 }; // must hold at least 6 max size packets, plus 2 extra bytes
+	typedef enum { UNKNOWN=0, CDCACM, FTDI, PL2303, CH341, CP210X } sertype_t;
 	enum { DEFAULT_WRITE_TIMEOUT = 3500};
 
 	USBSerialBase(USBHost &host, uint32_t *big_buffer, uint16_t buffer_size, 
@@ -1515,18 +1916,7 @@ private:
 	uint8_t interface;
 	uint8_t dtr_rts_;		// save logical state for the two of them. 
 	volatile bool 	control_queued;	// Is there already a queued control messaged
-	typedef enum { UNKNOWN=0, CDCACM, FTDI, PL2303, CH341, CP210X } sertype_t;
-
 	sertype_t sertype;
-
-	typedef struct {
-		uint16_t 	idVendor;
-		uint16_t 	idProduct;
-		sertype_t 	sertype;
-		int			claim_at_type;
-	} product_vendor_mapping_t;
-	static product_vendor_mapping_t pid_vid_mapping[];
-
 };
 
 class USBSerial : public USBSerialBase {
@@ -1773,12 +2163,40 @@ private:
 
 //--------------------------------------------------------------------------
 
+// Size of the RawHID queue packets.  Full speed devices send at most 64
+// bytes, high speed ones up to 1024, so define USBHOST_RAWHID_PACKET_SIZE
+// to the device's report size to queue bigger packets.
+#if defined(USBHOST_RAWHID_PACKET_SIZE)
+#define RAWHID_PACKET_SIZE (USBHOST_RAWHID_PACKET_SIZE)
+#else
+#define RAWHID_PACKET_SIZE 64
+#endif
+
 class RawHIDController : public USBHIDInput {
 public:
 	RawHIDController(USBHost &host, uint32_t usage = 0) : fixed_usage_(usage) { init(); }
 	uint32_t usage(void) {return usage_;}
 	void attachReceive(bool (*f)(uint32_t usage, const uint8_t *data, uint32_t len)) {receiveCB = f;}
 	bool sendPacket(const uint8_t *buffer);
+
+	// Optional packet queues, with memory provided by the sketch.  With a
+	// receive queue, packets are kept for readPacket() instead of calling
+	// the receive function from the USB interrupt.  With a transmit queue,
+	// sendPacket() copies into it and several packets are sent at once.
+	// Packets longer than MAX_PACKET_SIZE are cut short and counted.
+	enum { MAX_PACKET_SIZE = RAWHID_PACKET_SIZE, TX_IN_FLIGHT = 4 };
+	typedef struct {
+		uint16_t len;
+		uint8_t  data[MAX_PACKET_SIZE];
+	} packet_t;
+	void attachRxQueue(packet_t *buffer, uint16_t count);
+	void attachTxQueue(packet_t *buffer, uint16_t count);
+	uint32_t packetsAvailable();
+	uint32_t readPacket(uint8_t *buffer, uint32_t size);
+	uint32_t rxOverruns() { return rx_overruns_; }
+	uint32_t txOverruns() { return tx_overruns_; }
+	uint32_t rxTruncated() { return rx_truncated_; }
+	uint32_t txTruncated() { return tx_truncated_; }
 protected:
 	virtual hidclaim_t claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage);
 	virtual bool hid_process_in_data(const Transfer_t *transfer);
@@ -1789,8 +2207,8 @@ protected:
 	virtual void disconnect_collection(Device_t *dev);
 private:
 	void init();
+	void tx_submit();
 	USBHIDParser *driver_;
-	enum { MAX_PACKET_SIZE = 64 };
 	bool (*receiveCB)(uint32_t usage, const uint8_t *data, uint32_t len) = nullptr;
 	uint8_t collections_claimed = 0;
 	//volatile bool hid_input_begin_ = false;
@@ -1798,8 +2216,22 @@ private:
 	uint32_t usage_ = 0;
 
 	// See if we can contribute transfers
-	Transfer_t mytransfers[2] __attribute__ ((aligned(32)));
-
+	Transfer_t mytransfers[2+TX_IN_FLIGHT] __attribute__ ((aligned(32)));
+
+	packet_t *rx_queue_ = nullptr;
+	uint16_t rx_count_ = 0;
+	volatile uint16_t rx_head_ = 0;		// written by the USB interrupt
+	volatile uint16_t rx_tail_ = 0;		// written by readPacket()
+	uint32_t rx_overruns_ = 0;
+	uint32_t rx_truncated_ = 0;
+	packet_t *tx_queue_ = nullptr;
+	uint16_t tx_count_ = 0;
+	volatile uint16_t tx_head_ = 0;		// last packet added
+	volatile uint16_t tx_next_ = 0;		// last packet given to the parser
+	volatile uint16_t tx_tail_ = 0;		// last packet sent
+	uint8_t tx_active_ = 0;
+	uint32_t tx_overruns_ = 0;
+	uint32_t tx_truncated_ = 0;
 };
 
 //--------------------------------------------------------------------------
@@ -1817,6 +2249,7 @@ public:
 	virtual int read(void);
 	virtual int availableForWrite();
 	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t *buffer, size_t size);
 	virtual void flush(void);
 
 	using Print::write;
@@ -2012,13 +2445,6 @@ private:
 	USBDriverTimer 	delayTimer_;
     uint8_t 		my_bdaddr_[6];	// The bluetooth dongles Bluetooth address.
     uint8_t			features[8];	// remember our local features.
-
-	typedef struct {
-		uint16_t 	idVendor;
-		uint16_t 	idProduct;
-	} product_vendor_mapping_t;
-	static product_vendor_mapping_t pid_vid_mapping[];
-
 };
 
 class ADK: public USBDriver {
@@ -49,11 +49,18 @@
 #endif
 
 
+static const usb_match_t antplus_match[] = {
+	{USB_MATCH_VENDOR | USB_MATCH_PRODUCT, 0, 0, 0, ANTPLUS_VID, ANTPLUS_2_PID},
+	{USB_MATCH_VENDOR | USB_MATCH_PRODUCT, 0, 0, 0, ANTPLUS_VID, ANTPLUS_M_PID},
+	{0, 0, 0, 0, 0, 0}
+};
+
 void AntPlus::init()
 {
 	contribute_Pipes(mypipes, sizeof(mypipes)/sizeof(Pipe_t));
 	contribute_Transfers(mytransfers, sizeof(mytransfers)/sizeof(Transfer_t));
 	contribute_String_Buffers(mystring_bufs, sizeof(mystring_bufs)/sizeof(strbuf_t));
+	match_list = antplus_match;
 	driver_ready_for_device(this);
 	user_onStatusChange = NULL;
 	user_onDeviceID = NULL;
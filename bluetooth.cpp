@@ -188,12 +188,6 @@ BTHIDInput * BluetoothController::find_driver(uint32_t device_type, uint8_t *rem
 	}
 	return NULL;
 }
-//12 01 00 02 FF 01 01 40 5C 0A E8 21 12 01 01 02 03 01
-//VendorID = 0A5C, ProductID = 21E8, Version = 0112
-//Class/Subclass/Protocol = 255 / 1 / 1
-BluetoothController::product_vendor_mapping_t BluetoothController::pid_vid_mapping[] = {
-	{ 0xA5C, 0x21E8 }};
-
 /************************************************************/
 //  Initialization and claiming of devices & interfaces
 /************************************************************/
@@ -216,14 +210,8 @@ bool BluetoothController::claim(Device_t *dev, int type, const uint8_t *descript
 	// Lets try to support the main USB Bluetooth class...
 	// http://www.usb.org/developers/defined_class/#BaseClassE0h
 	if (dev->bDeviceClass != 0xe0)  {
-		bool special_case_device = false;
-		for (uint8_t i=0; i < (sizeof(pid_vid_mapping)/sizeof(pid_vid_mapping[0])); i++) {
-			if ((pid_vid_mapping[i].idVendor == dev->idVendor) && (pid_vid_mapping[i].idProduct == dev->idProduct)) {
-				special_case_device = true;
-				break;
-			}
-		}
-		if (!special_case_device) return false;
+		// special case devices, listed in quirks.cpp
+		if (!find_quirk(dev->idVendor, dev->idProduct, QUIRK_DRIVER_BLUETOOTH)) return false;
 	}
 	if ((dev->bDeviceSubClass != 1) || (dev->bDeviceProtocol != 1)) return false; // Bluetooth Programming Interface
 
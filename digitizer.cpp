@@ -33,8 +33,9 @@ void DigitizerController::init()
 
 hidclaim_t DigitizerController::claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage)
 {
-	// only claim Desktop/Mouse
-	if (topusage != 0xff0d0001) return CLAIM_NO;
+	// only claim Mike's vendor digitizer, Touch Screen and Touch Pad
+	if ((topusage != 0xff0d0001) && (topusage != 0x000D0004)
+	  && (topusage != 0x000D0005)) return CLAIM_NO;
 	// only claim from one physical device
 	if (mydevice != NULL && dev != mydevice) return CLAIM_NO;
 	mydevice = dev;
@@ -53,6 +54,9 @@ void DigitizerController::hid_input_begin(uint32_t topusage, uint32_t type, int
 {
 	// TODO: check if absolute coordinates
 	hid_input_begin_ = true;
+	// Called before each Input item, so a finger's fields must not be
+	// reset here.  hid_input_end() commits the last one of the report.
+	touch_report = ((topusage >> 16) == 0x0D);
 }
 
 void DigitizerController::hid_input_data(uint32_t usage, int32_t value)
@@ -61,6 +65,33 @@ void DigitizerController::hid_input_data(uint32_t usage, int32_t value)
 	uint32_t usage_page = usage >> 16;
 	usage &= 0xFFFF;
 	USBHDBGSerial.printf("Digitizer: &usage=%X, usage_page=%x\n", usage, usage_page);
+
+	if (touch_report) {
+		// Each finger is a logical collection of Tip Switch, Contact
+		// Identifier, X and Y, in any order.  A field seen twice means
+		// the next finger has begun.  Fingers are only staged here,
+		// since Contact Count may follow them in the report.
+		uint32_t field = 0;
+		if (usage_page == 0x0D && usage == 0x42) field = 1;
+		else if (usage_page == 0x0D && usage == 0x51) field = 2;
+		else if (usage_page == 1 && usage == 0x30) field = 4;
+		else if (usage_page == 1 && usage == 0x31) field = 8;
+		if (field) {
+			if (contact_fields & field) stage_contact();
+			contact_fields |= field;
+			if (field == 1) contact_tip = value;
+			else if (field == 2) contact.id = value;
+			else if (field == 4) contact.x = value;
+			else contact.y = value;
+			return;
+		}
+		if (usage_page == 0x0D && usage == 0x54 && value > 0) {
+			// Contact Count is only non-zero in the first report of a
+			// frame.  Hybrid mode panels send the rest in later reports.
+			frame_expected = value;
+			return;
+		}
+	}
 	
 	// This is Mikes version...
 	if (usage_page == 0xff00 && usage >= 100 && usage <= 0x108) {
@@ -118,6 +149,18 @@ void DigitizerController::hid_input_data(uint32_t usage, int32_t value)
 
 void DigitizerController::hid_input_end()
 {
+	if (touch_report) {
+		if (contact_fields) stage_contact();
+		// Fixed slot panels zero fill the unused slots, so only the
+		// number of fingers given by Contact Count are used.
+		for (uint32_t i=0; i < slot_count; i++) {
+			if (frame_expected > 0 && frame_received >= frame_expected) break;
+			commit_contact(slots[i], slot_tip[i]);
+		}
+		slot_count = 0;
+		// without a Contact Count, every report is a whole frame
+		if (frame_received >= frame_expected) end_touch_frame();
+	}
 	if (hid_input_begin_) {
 		digitizerEvent = true;
 		hid_input_begin_ = false;
@@ -132,3 +175,115 @@ void DigitizerController::digitizerDataClear() {
 	wheel   = 0;
 	wheelH  = 0;
 }
+
+// Save the finger just received, until the end of the report
+void DigitizerController::stage_contact()
+{
+	uint32_t fields = contact_fields;
+	contact_fields = 0;
+	if (!(fields & 2)) contact.id = 0; // single touch, no Contact Identifier
+	if (slot_count >= MAX_CONTACTS) return;
+	slots[slot_count] = contact;
+	slot_tip[slot_count] = (fields & 1) ? contact_tip : 1;
+	slot_count++;
+}
+
+// Update contacts[] with a finger from the report
+void DigitizerController::commit_contact(const touch_t &contact, uint32_t tip)
+{
+	uint32_t i;
+	for (i=0; i < contact_count; i++) {
+		if (contacts[i].id == contact.id) break;
+	}
+	if (!tip) {
+		// finger lifted, or an empty slot if we never saw it down
+		if (i < contact_count) {
+			frame_received++;
+			queue_touch_event(contacts[i], TOUCH_UP);
+			contacts[i] = contacts[--contact_count];
+			uint32_t last = 1 << contact_count;
+			contact_seen = (contact_seen & ~(1 << i) & ~last)
+				| ((contact_seen & last) ? (1 << i) : 0);
+		}
+		return;
+	}
+	frame_received++;
+	if (i < contact_count) {
+		if (contacts[i].x != contact.x || contacts[i].y != contact.y) {
+			contacts[i].x = contact.x;
+			contacts[i].y = contact.y;
+			queue_touch_event(contacts[i], TOUCH_MOVE);
+		}
+	} else if (contact_count < MAX_CONTACTS) {
+		contacts[i] = contact;
+		contact_count++;
+		queue_touch_event(contacts[i], TOUCH_DOWN);
+	} else {
+		return; // more fingers than we can track
+	}
+	contact_seen |= (1 << i);
+}
+
+// A frame is complete: any finger not reported is up, then publish
+void DigitizerController::end_touch_frame()
+{
+	if (frame_expected > 0) {
+		uint32_t i = 0;
+		while (i < contact_count) {
+			if (contact_seen & (1 << i)) {
+				i++;
+				continue;
+			}
+			queue_touch_event(contacts[i], TOUCH_UP);
+			contacts[i] = contacts[--contact_count];
+			if (contact_seen & (1 << contact_count)) contact_seen |= (1 << i);
+		}
+	}
+	frame_expected = 0;
+	frame_received = 0;
+	contact_seen = 0;
+	touch_seq = touch_seq + 1;
+	__asm__ volatile("" ::: "memory");
+	memcpy(touch_list, contacts, contact_count * sizeof(touch_t));
+	touch_count = contact_count;
+	__asm__ volatile("" ::: "memory");
+	touch_seq = touch_seq + 1;
+}
+
+void DigitizerController::queue_touch_event(const touch_t &t, uint8_t event)
+{
+	uint32_t head = touch_event_head + 1;
+	if (head >= TOUCH_EVENT_LEN) head = 0;
+	if (head == touch_event_tail) {
+		touch_event_dropped++;
+		return;
+	}
+	touch_events[head] = t;
+	touch_events[head].event = event;
+	touch_event_head = head;
+}
+
+uint32_t DigitizerController::getTouches(touch_t *list, uint32_t max)
+{
+	uint32_t seq, count;
+	do {
+		// retry if the USB interrupt published a frame while copying
+		seq = touch_seq;
+		__asm__ volatile("" ::: "memory");
+		count = touch_count;
+		if (count > max) count = max;
+		memcpy(list, touch_list, count * sizeof(touch_t));
+		__asm__ volatile("" ::: "memory");
+	} while ((seq & 1) || seq != touch_seq);
+	return count;
+}
+
+bool DigitizerController::readTouchEvent(touch_t &event)
+{
+	uint32_t tail = touch_event_tail;
+	if (tail == touch_event_head) return false;
+	if (++tail >= TOUCH_EVENT_LEN) tail = 0;
+	event = touch_events[tail];
+	touch_event_tail = tail;
+	return true;
+}
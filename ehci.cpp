@@ -60,32 +60,63 @@
 #define PERIODIC_LIST_SIZE  32
 #endif
 
-// The EHCI periodic schedule, used for interrupt pipes/endpoints
-static uint32_t periodictable[PERIODIC_LIST_SIZE] __attribute__ ((aligned(4096), used));
-static uint8_t  uframe_bandwidth[PERIODIC_LIST_SIZE*8];
-
-// State of the 1 and only physical USB host port on Teensy 3.6
-static uint8_t  port_state;
+// State of the 1 and only physical USB host port on each controller
 #define PORT_STATE_DISCONNECTED   0
 #define PORT_STATE_DEBOUNCE       1
 #define PORT_STATE_RESET          2
 #define PORT_STATE_RECOVERY       3
 #define PORT_STATE_ACTIVE         4
 
-// The device currently connected, or NULL when no device
-static Device_t   *rootdev=NULL;
+// Everything specific to one EHCI controller.  Devices, pipes and
+// transfers all come from the shared memory pools, but each controller
+// has its own schedules, root port and followup lists.
+struct Controller_struct {
+	// The controller's registers, and its PHY's CTRL set & clear
+	EHCI_registers_t *regs;
+	volatile uint32_t *phy_ctrl_set;
+	volatile uint32_t *phy_ctrl_clr;
+
+	// The EHCI periodic schedule, used for interrupt pipes/endpoints
+	uint32_t *periodictable;
+	uint8_t  *uframe_bandwidth;
+
+	// The device currently connected, or NULL when no device
+	Device_t *rootdev;
+
+	// List of all queued transfers in the asychronous schedule (control & bulk).
+	// When the EHCI completes these transfers, this list is how we locate them
+	// in memory.
+	Transfer_t *async_followup_first;
+	Transfer_t *async_followup_last;
+
+	// List of all queued transfers in the asychronous schedule (interrupt endpoints)
+	// When the EHCI completes these transfers, this list is how we locate them
+	// in memory.
+	Transfer_t *periodic_followup_first;
+	Transfer_t *periodic_followup_last;
+
+	uint8_t  port_state;
+};
+
+static uint32_t periodictable[PERIODIC_LIST_SIZE] __attribute__ ((aligned(4096), used));
+static uint8_t  uframe_bandwidth[PERIODIC_LIST_SIZE*8];
+#if USBHOST_CONTROLLERS > 1
+static uint32_t periodictable2[PERIODIC_LIST_SIZE] __attribute__ ((aligned(4096), used));
+static uint8_t  uframe_bandwidth2[PERIODIC_LIST_SIZE*8];
+#endif
 
-// List of all queued transfers in the asychronous schedule (control & bulk).
-// When the EHCI completes these transfers, this list is how we locate them
-// in memory.
-static Transfer_t *async_followup_first=NULL;
-static Transfer_t *async_followup_last=NULL;
+static Controller_t controllers[USBHOST_CONTROLLERS] = {
+	{(EHCI_registers_t *)&USBHS_GPTIMER0LD, &USBPHY_CTRL_SET, &USBPHY_CTRL_CLR,
+	  periodictable, uframe_bandwidth, NULL, NULL, NULL, NULL, NULL, 0},
+#if USBHOST_CONTROLLERS > 1
+	{(EHCI_registers_t *)&USB1_GPTIMER0LD, &USBPHY1_CTRL_SET, &USBPHY1_CTRL_CLR,
+	  periodictable2, uframe_bandwidth2, NULL, NULL, NULL, NULL, NULL, 0},
+#endif
+};
 
-// List of all queued transfers in the asychronous schedule (interrupt endpoints)
-// When the EHCI completes these transfers, this list is how we locate them
-// in memory.
-static Transfer_t *periodic_followup_first=NULL;
-static Transfer_t *periodic_followup_last=NULL;
+// The controller whose GPTIMER1 runs all USBDriverTimer instances,
+// the first one started by begin()
+static Controller_t *timer_controller=NULL;
 
 // List of all pending timers.  This double linked list is stored in
 // chronological order.  Each timer is stored with the number of
@@ -96,16 +127,22 @@ static USBDriverTimer *active_timers=NULL;
 
 static void init_qTD(volatile Transfer_t *t, void *buf, uint32_t len,
               uint32_t pid, uint32_t data01, bool irq);
-static void add_to_async_followup_list(Transfer_t *first, Transfer_t *last);
-static void remove_from_async_followup_list(Transfer_t *transfer);
-static void add_to_periodic_followup_list(Transfer_t *first, Transfer_t *last);
-static void remove_from_periodic_followup_list(Transfer_t *transfer);
+static void add_to_async_followup_list(Controller_t *c, Transfer_t *first, Transfer_t *last);
+static void remove_from_async_followup_list(Controller_t *c, Transfer_t *transfer);
+static void add_to_periodic_followup_list(Controller_t *c, Transfer_t *first, Transfer_t *last);
+static void remove_from_periodic_followup_list(Controller_t *c, Transfer_t *transfer);
 
 #define print   USBHost::print_
 #define println USBHost::println_
 
-void USBHost::begin()
+// Controllers whose interrupt has been enabled by begin()
+static uint8_t controllers_started = 0;
+
+void USBHost::begin(uint32_t controller_num)
 {
+	if (controller_num >= USBHOST_CONTROLLERS) return;
+	Controller_t *c = &controllers[controller_num];
+	EHCI_registers_t *regs = c->regs;
 #if defined(__MK66FX1M0__)
 	// Teensy 3.6 has USB host power controlled by PTE6
 	PORTE_PCR6 = PORT_PCR_MUX(1);
@@ -165,81 +202,129 @@ void USBHost::begin()
 
 
 #elif defined(__IMXRT1052__) || defined(__IMXRT1062__)
-	// Teensy 4.0 PLL & USB PHY powerup
-	while (1) {
-		uint32_t n = CCM_ANALOG_PLL_USB2;
-		if (n & CCM_ANALOG_PLL_USB2_DIV_SELECT) {
-			CCM_ANALOG_PLL_USB2_CLR = 0xC000; // get out of 528 MHz mode
-			CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_BYPASS;
-			CCM_ANALOG_PLL_USB2_CLR = CCM_ANALOG_PLL_USB2_POWER |
-				CCM_ANALOG_PLL_USB2_DIV_SELECT |
-				CCM_ANALOG_PLL_USB2_ENABLE |
-				CCM_ANALOG_PLL_USB2_EN_USB_CLKS;
-			continue;
-		}
-		if (!(n & CCM_ANALOG_PLL_USB2_ENABLE)) {
-			CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_ENABLE; // enable
-			continue;
-		}
-		if (!(n & CCM_ANALOG_PLL_USB2_POWER)) {
-			CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_POWER; // power up
-			continue;
-		}
-		if (!(n & CCM_ANALOG_PLL_USB2_LOCK)) {
-			continue; // wait for lock
-		}
-		if (n & CCM_ANALOG_PLL_USB2_BYPASS) {
-			CCM_ANALOG_PLL_USB2_CLR = CCM_ANALOG_PLL_USB2_BYPASS; // turn off bypass
-			continue;
+	if (controller_num == 0) {
+		// Teensy 4.0 PLL & USB PHY powerup
+		while (1) {
+			uint32_t n = CCM_ANALOG_PLL_USB2;
+			if (n & CCM_ANALOG_PLL_USB2_DIV_SELECT) {
+				CCM_ANALOG_PLL_USB2_CLR = 0xC000; // get out of 528 MHz mode
+				CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_BYPASS;
+				CCM_ANALOG_PLL_USB2_CLR = CCM_ANALOG_PLL_USB2_POWER |
+					CCM_ANALOG_PLL_USB2_DIV_SELECT |
+					CCM_ANALOG_PLL_USB2_ENABLE |
+					CCM_ANALOG_PLL_USB2_EN_USB_CLKS;
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB2_ENABLE)) {
+				CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_ENABLE; // enable
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB2_POWER)) {
+				CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_POWER; // power up
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB2_LOCK)) {
+				continue; // wait for lock
+			}
+			if (n & CCM_ANALOG_PLL_USB2_BYPASS) {
+				CCM_ANALOG_PLL_USB2_CLR = CCM_ANALOG_PLL_USB2_BYPASS; // turn off bypass
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB2_EN_USB_CLKS)) {
+				CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_EN_USB_CLKS; // enable
+				continue;
+			}
+			println("USB2 PLL running");
+			break; // USB2 PLL up and running
 		}
-		if (!(n & CCM_ANALOG_PLL_USB2_EN_USB_CLKS)) {
-			CCM_ANALOG_PLL_USB2_SET = CCM_ANALOG_PLL_USB2_EN_USB_CLKS; // enable
-			continue;
+		// turn on USB clocks (should already be on)
+		CCM_CCGR6 |= CCM_CCGR6_USBOH3(CCM_CCGR_ON);
+		// turn on USB2 PHY
+		USBPHY2_CTRL_CLR = USBPHY_CTRL_SFTRST | USBPHY_CTRL_CLKGATE;
+		USBPHY2_CTRL_SET = USBPHY_CTRL_ENUTMILEVEL2 | USBPHY_CTRL_ENUTMILEVEL3;
+		USBPHY2_PWD = 0;
+		#ifdef ARDUINO_TEENSY41
+		IOMUXC_SW_MUX_CTL_PAD_GPIO_EMC_40 = 5;
+		IOMUXC_SW_PAD_CTL_PAD_GPIO_EMC_40 = 0x0008; // slow speed, weak 150 ohm drive
+		GPIO8_GDIR |= 1<<26;
+		GPIO8_DR_SET = 1<<26;
+		#endif
+#if USBHOST_CONTROLLERS > 1
+	} else {
+		// Teensy 4.x USB1 PLL & PHY powerup
+		while (1) {
+			uint32_t n = CCM_ANALOG_PLL_USB1;
+			if (n & CCM_ANALOG_PLL_USB1_DIV_SELECT) {
+				CCM_ANALOG_PLL_USB1_CLR = 0xC000; // get out of 528 MHz mode
+				CCM_ANALOG_PLL_USB1_SET = CCM_ANALOG_PLL_USB1_BYPASS;
+				CCM_ANALOG_PLL_USB1_CLR = CCM_ANALOG_PLL_USB1_POWER |
+					CCM_ANALOG_PLL_USB1_DIV_SELECT |
+					CCM_ANALOG_PLL_USB1_ENABLE |
+					CCM_ANALOG_PLL_USB1_EN_USB_CLKS;
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB1_ENABLE)) {
+				CCM_ANALOG_PLL_USB1_SET = CCM_ANALOG_PLL_USB1_ENABLE; // enable
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB1_POWER)) {
+				CCM_ANALOG_PLL_USB1_SET = CCM_ANALOG_PLL_USB1_POWER; // power up
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB1_LOCK)) {
+				continue; // wait for lock
+			}
+			if (n & CCM_ANALOG_PLL_USB1_BYPASS) {
+				CCM_ANALOG_PLL_USB1_CLR = CCM_ANALOG_PLL_USB1_BYPASS; // turn off bypass
+				continue;
+			}
+			if (!(n & CCM_ANALOG_PLL_USB1_EN_USB_CLKS)) {
+				CCM_ANALOG_PLL_USB1_SET = CCM_ANALOG_PLL_USB1_EN_USB_CLKS; // enable
+				continue;
+			}
+			println("USB1 PLL running");
+			break; // USB1 PLL up and running
 		}
-		println("USB2 PLL running");
-		break; // USB2 PLL up and running
+		CCM_CCGR6 |= CCM_CCGR6_USBOH3(CCM_CCGR_ON);
+		USBPHY1_CTRL_CLR = USBPHY_CTRL_SFTRST | USBPHY_CTRL_CLKGATE;
+		USBPHY1_CTRL_SET = USBPHY_CTRL_ENUTMILEVEL2 | USBPHY_CTRL_ENUTMILEVEL3;
+		USBPHY1_PWD = 0;
+#endif
 	}
-	// turn on USB clocks (should already be on)
-	CCM_CCGR6 |= CCM_CCGR6_USBOH3(CCM_CCGR_ON);
-	// turn on USB2 PHY
-	USBPHY2_CTRL_CLR = USBPHY_CTRL_SFTRST | USBPHY_CTRL_CLKGATE;
-	USBPHY2_CTRL_SET = USBPHY_CTRL_ENUTMILEVEL2 | USBPHY_CTRL_ENUTMILEVEL3;
-	USBPHY2_PWD = 0;
-	#ifdef ARDUINO_TEENSY41
-	IOMUXC_SW_MUX_CTL_PAD_GPIO_EMC_40 = 5;
-	IOMUXC_SW_PAD_CTL_PAD_GPIO_EMC_40 = 0x0008; // slow speed, weak 150 ohm drive
-	GPIO8_GDIR |= 1<<26;
-	GPIO8_DR_SET = 1<<26;
-	#endif
 #endif
 	delay(10);
 
 	// now with the PHY up and running, start up USBHS
 	//print("begin ehci reset");
-	USBHS_USBCMD |= USBHS_USBCMD_RST;
+	regs->USBCMD |= USBHS_USBCMD_RST;
 	int reset_count = 0;
-	while (USBHS_USBCMD & USBHS_USBCMD_RST) {
+	while (regs->USBCMD & USBHS_USBCMD_RST) {
 		reset_count++;
 	}
 	println(" reset waited ", reset_count);
 
-	init_Device_Pipe_Transfer_memory();
+	if (timer_controller == NULL) {
+		// first controller started, memory pools & timers begin here
+		init_Device_Pipe_Transfer_memory();
+		init_Enumeration_memory();
+		timer_controller = c;
+	}
 	for (int i=0; i < PERIODIC_LIST_SIZE; i++) {
-		periodictable[i] = 1;
+		c->periodictable[i] = 1;
 	}
-	memset(uframe_bandwidth, 0, sizeof(uframe_bandwidth));
-	port_state = PORT_STATE_DISCONNECTED;
+	memset(c->uframe_bandwidth, 0, PERIODIC_LIST_SIZE*8);
+	c->port_state = PORT_STATE_DISCONNECTED;
 
-	USBHS_USB_SBUSCFG = 1; //  System Bus Interface Configuration
+	regs->SBUSCFG = 1; //  System Bus Interface Configuration
 
 	// turn on the USBHS controller
-	//USBHS_USBMODE = USBHS_USBMODE_TXHSD(5) | USBHS_USBMODE_CM(3); // host mode
-	USBHS_USBMODE = USBHS_USBMODE_CM(3); // host mode
-	USBHS_USBINTR = 0;
-	USBHS_PERIODICLISTBASE = (uint32_t)periodictable;
-	USBHS_FRINDEX = 0;
-	USBHS_ASYNCLISTADDR = 0;
-	USBHS_USBCMD = USBHS_USBCMD_ITC(1) | USBHS_USBCMD_RS |
+	//regs->USBMODE = USBHS_USBMODE_TXHSD(5) | USBHS_USBMODE_CM(3); // host mode
+	regs->USBMODE = USBHS_USBMODE_CM(3); // host mode
+	regs->USBINTR = 0;
+	regs->PERIODICLISTBASE = (uint32_t)c->periodictable;
+	regs->FRINDEX = 0;
+	regs->ASYNCLISTADDR = 0;
+	regs->USBCMD = USBHS_USBCMD_ITC(1) | USBHS_USBCMD_RS |
 		USBHS_USBCMD_ASP(3) | USBHS_USBCMD_ASPE | USBHS_USBCMD_PSE |
 		#if PERIODIC_LIST_SIZE == 8
 		USBHS_USBCMD_FS2 | USBHS_USBCMD_FS(3);
@@ -262,21 +347,30 @@ void USBHost::begin()
 		#endif
 
 	// turn on the USB port
-	//USBHS_PORTSC1 = USBHS_PORTSC_PP;
-	USBHS_PORTSC1 |= USBHS_PORTSC_PP;
-	USBHS_PORTSC1 |= USBHS_PORTSC_PFSC; // force 12 Mbit/sec
-	//USBHS_PORTSC1 |= USBHS_PORTSC_PHCD; // phy off
+	//regs->PORTSC1 = USBHS_PORTSC_PP;
+	regs->PORTSC1 |= USBHS_PORTSC_PP;
+	regs->PORTSC1 |= USBHS_PORTSC_PFSC; // force 12 Mbit/sec
+	//regs->PORTSC1 |= USBHS_PORTSC_PHCD; // phy off
 
-	println("USBHS_ASYNCLISTADDR = ", USBHS_ASYNCLISTADDR, HEX);
-	println("USBHS_PERIODICLISTBASE = ", USBHS_PERIODICLISTBASE, HEX);
-	println("periodictable = ", (uint32_t)periodictable, HEX);
+	println("ASYNCLISTADDR = ", regs->ASYNCLISTADDR, HEX);
+	println("PERIODICLISTBASE = ", regs->PERIODICLISTBASE, HEX);
+	println("periodictable = ", (uint32_t)c->periodictable, HEX);
 
 	// enable interrupts, after this point interruts to all the work
-	attachInterruptVector(IRQ_USBHS, isr);
-	NVIC_ENABLE_IRQ(IRQ_USBHS);
-	USBHS_USBINTR = USBHS_USBINTR_PCE | USBHS_USBINTR_TIE0 | USBHS_USBINTR_TIE1;
-	USBHS_USBINTR |= USBHS_USBINTR_UEE | USBHS_USBINTR_SEE;
-	USBHS_USBINTR |= USBHS_USBINTR_UPIE | USBHS_USBINTR_UAIE;
+#if USBHOST_CONTROLLERS > 1
+	if (controller_num == 1) {
+		attachInterruptVector(IRQ_USB1, isr2);
+		NVIC_ENABLE_IRQ(IRQ_USB1);
+	} else
+#endif
+	{
+		attachInterruptVector(IRQ_USBHS, isr);
+		NVIC_ENABLE_IRQ(IRQ_USBHS);
+	}
+	controllers_started |= (1 << controller_num);
+	regs->USBINTR = USBHS_USBINTR_PCE | USBHS_USBINTR_TIE0 | USBHS_USBINTR_TIE1;
+	regs->USBINTR |= USBHS_USBINTR_UEE | USBHS_USBINTR_SEE;
+	regs->USBINTR |= USBHS_USBINTR_UPIE | USBHS_USBINTR_UAIE;
 
 }
 
@@ -302,8 +396,21 @@ void USBHost::begin()
 
 void USBHost::isr()
 {
-	uint32_t stat = USBHS_USBSTS;
-	USBHS_USBSTS = stat; // clear pending interrupts
+	controller_isr(&controllers[0]);
+}
+
+#if USBHOST_CONTROLLERS > 1
+void USBHost::isr2()
+{
+	controller_isr(&controllers[1]);
+}
+#endif
+
+void USBHost::controller_isr(Controller_t *c)
+{
+	EHCI_registers_t *regs = c->regs;
+	uint32_t stat = regs->USBSTS;
+	regs->USBSTS = stat; // clear pending interrupts
 	//stat &= USBHS_USBINTR; // mask away unwanted interrupts
 #if 0
 	println();
@@ -330,13 +437,13 @@ void USBHost::isr()
 
 	if (stat & USBHS_USBSTS_UAI) { // completed qTD(s) from the async schedule
 		//println("Async Followup");
-		//print(async_followup_first, async_followup_last);
-		Transfer_t *p = async_followup_first;
+		//print(c->async_followup_first, async_followup_last);
+		Transfer_t *p = c->async_followup_first;
 		while (p) {
 			if (followup_Transfer(p)) {
 				// transfer completed
 				Transfer_t *next = p->next_followup;
-				remove_from_async_followup_list(p);
+				remove_from_async_followup_list(c, p);
 				free_Transfer(p);
 				p = next;
 			} else {
@@ -344,16 +451,16 @@ void USBHost::isr()
 				p = p->next_followup;
 			}
 		}
-		//print(async_followup_first, async_followup_last);
+		//print(c->async_followup_first, async_followup_last);
 	}
 	if (stat & USBHS_USBSTS_UPI) { // completed qTD(s) from the periodic schedule
 		//println("Periodic Followup");
-		Transfer_t *p = periodic_followup_first;
+		Transfer_t *p = c->periodic_followup_first;
 		while (p) {
 			if (followup_Transfer(p)) {
 				// transfer completed
 				Transfer_t *next = p->next_followup;
-				remove_from_periodic_followup_list(p);
+				remove_from_periodic_followup_list(c, p);
 				free_Transfer(p);
 				p = next;
 			} else {
@@ -363,48 +470,48 @@ void USBHost::isr()
 		}
 	}
 	if (stat & USBHS_USBSTS_UEI) {
-		followup_Error();
+		followup_Error(c);
 	}
 
 	if (stat & USBHS_USBSTS_PCI) { // port change detected
-		const uint32_t portstat = USBHS_PORTSC1;
+		const uint32_t portstat = regs->PORTSC1;
 		println("port change: ", portstat, HEX);
-		USBHS_PORTSC1 = portstat | (USBHS_PORTSC_OCC|USBHS_PORTSC_PEC|USBHS_PORTSC_CSC);
+		regs->PORTSC1 = portstat | (USBHS_PORTSC_OCC|USBHS_PORTSC_PEC|USBHS_PORTSC_CSC);
 		if (portstat & USBHS_PORTSC_OCC) {
 			println("  overcurrent change");
 		}
 		if (portstat & USBHS_PORTSC_CSC) {
 			if (portstat & USBHS_PORTSC_CCS) {
 				println("    connect");
-				if (port_state == PORT_STATE_DISCONNECTED
-				  || port_state == PORT_STATE_DEBOUNCE) {
+				if (c->port_state == PORT_STATE_DISCONNECTED
+				  || c->port_state == PORT_STATE_DEBOUNCE) {
 					// 100 ms debounce (USB 2.0: TATTDB, page 150 & 188)
-					port_state = PORT_STATE_DEBOUNCE;
-					USBHS_GPTIMER0LD = 100000; // microseconds
-					USBHS_GPTIMER0CTL =
+					c->port_state = PORT_STATE_DEBOUNCE;
+					regs->GPTIMER0LD = 100000; // microseconds
+					regs->GPTIMER0CTL =
 						USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
 					stat &= ~USBHS_USBSTS_TI0;
 				}
 			} else {
 				println("    disconnect");
-				port_state = PORT_STATE_DISCONNECTED;
-				USBPHY_CTRL_CLR = USBPHY_CTRL_ENHOSTDISCONDETECT;
-				disconnect_Device(rootdev);
-				rootdev = NULL;
+				c->port_state = PORT_STATE_DISCONNECTED;
+				*c->phy_ctrl_clr = USBPHY_CTRL_ENHOSTDISCONDETECT;
+				disconnect_Device(c->rootdev);
+				c->rootdev = NULL;
 			}
 		}
 		if (portstat & USBHS_PORTSC_PEC) {
 			// PEC bit only detects disable
 			println("  disable");
-		} else if (port_state == PORT_STATE_RESET && portstat & USBHS_PORTSC_PE) {
+		} else if (c->port_state == PORT_STATE_RESET && portstat & USBHS_PORTSC_PE) {
 			println("  port enabled");
-			port_state = PORT_STATE_RECOVERY;
+			c->port_state = PORT_STATE_RECOVERY;
 			// 10 ms reset recover (USB 2.0: TRSTRCY, page 151 & 188)
-			USBHS_GPTIMER0LD = 10000; // microseconds
-			USBHS_GPTIMER0CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
-			if (USBHS_PORTSC1 & USBHS_PORTSC_HSP) {
+			regs->GPTIMER0LD = 10000; // microseconds
+			regs->GPTIMER0CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
+			if (regs->PORTSC1 & USBHS_PORTSC_HSP) {
 				// turn on high-speed disconnect detector
-				USBPHY_CTRL_SET = USBPHY_CTRL_ENHOSTDISCONDETECT;
+				*c->phy_ctrl_set = USBPHY_CTRL_ENHOSTDISCONDETECT;
 			}
 		}
 		if (portstat & USBHS_PORTSC_FPR) {
@@ -414,24 +521,31 @@ void USBHost::isr()
 	}
 	if (stat & USBHS_USBSTS_TI0) { // timer 0 - used for built-in port events
 		//println("timer0");
-		if (port_state == PORT_STATE_DEBOUNCE) {
-			port_state = PORT_STATE_RESET;
+		if (c->port_state == PORT_STATE_DEBOUNCE) {
+			c->port_state = PORT_STATE_RESET;
 			// Since we have only 1 port, no other device can
 			// be in reset or enumeration.  If multiple ports
 			// are ever supported, we would need to remain in
 			// debounce if any other port was resetting or
 			// enumerating a device.
-			USBHS_PORTSC1 |= USBHS_PORTSC_PR; // begin reset sequence
+			regs->PORTSC1 |= USBHS_PORTSC_PR; // begin reset sequence
 			println("  begin reset");
-		} else if (port_state == PORT_STATE_RECOVERY) {
-			port_state = PORT_STATE_ACTIVE;
+		} else if (c->port_state == PORT_STATE_RECOVERY) {
+			c->port_state = PORT_STATE_ACTIVE;
 			println("  end recovery");
 			//  HCSPARAMS  TTCTRL  page 1671
-			uint32_t speed = (USBHS_PORTSC1 >> 26) & 3;
-			rootdev = new_Device(speed, 0, 0);
+			uint32_t speed = (regs->PORTSC1 >> 26) & 3;
+			c->rootdev = new_Device(c, speed, 0, 0);
+			if (!c->rootdev) {
+				// devices on the other port may be using all the
+				// enumeration buffers, so try again later
+				c->port_state = PORT_STATE_RECOVERY;
+				regs->GPTIMER0LD = 20000; // microseconds
+				regs->GPTIMER0CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
+			}
 		}
 	}
-	if (stat & USBHS_USBSTS_TI1) { // timer 1 - used for USBDriverTimer
+	if ((stat & USBHS_USBSTS_TI1) && c == timer_controller) { // timer 1 - used for USBDriverTimer
 		//println("timer1");
 		USBDriverTimer *timer = active_timers;
 		if (timer) {
@@ -440,8 +554,8 @@ void USBHost::isr()
 			if (next) {
 				// more timers scheduled
 				next->prev = NULL;
-				USBHS_GPTIMER1LD = next->usec - 1;
-				USBHS_GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
+				regs->GPTIMER1LD = next->usec - 1;
+				regs->GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
 			}
 			// TODO: call multiple timers if 0 elapsed between them?
 			timer->driver->timer_event(timer); // call driver's timer()
@@ -449,6 +563,24 @@ void USBHost::isr()
 	}
 }
 
+// Keep the USB interrupts of all started controllers from running, so
+// the main program may call code which normally runs only from them.
+// Only these interrupts are masked, so code they call may still use
+// __disable_irq() and __enable_irq().
+void USBHost::mask_interrupts(bool mask)
+{
+	if (controllers_started & 1) {
+		if (mask) NVIC_DISABLE_IRQ(IRQ_USBHS);
+		else NVIC_ENABLE_IRQ(IRQ_USBHS);
+	}
+#if USBHOST_CONTROLLERS > 1
+	if (controllers_started & 2) {
+		if (mask) NVIC_DISABLE_IRQ(IRQ_USB1);
+		else NVIC_ENABLE_IRQ(IRQ_USB1);
+	}
+#endif
+}
+
 void USBDriverTimer::start(uint32_t microseconds)
 {
 #if 0
@@ -461,6 +593,8 @@ void USBDriverTimer::start(uint32_t microseconds)
 #endif
 	if (!driver) return;
 	if (microseconds < 100) return; // minimum timer duration
+	if (!timer_controller) return;
+	EHCI_registers_t *regs = timer_controller->regs;
 	started_micros = micros();
 	if (active_timers == NULL) {
 		// schedule is empty, just add this timer
@@ -468,26 +602,26 @@ void USBDriverTimer::start(uint32_t microseconds)
 		next = NULL;
 		prev = NULL;
 		active_timers = this;
-		USBHS_GPTIMER1LD = microseconds - 1;
-		USBHS_GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
+		regs->GPTIMER1LD = microseconds - 1;
+		regs->GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
 		return;
 	}
-	uint32_t remain = USBHS_GPTIMER1CTL & 0xFFFFFF;
+	uint32_t remain = regs->GPTIMER1CTL & 0xFFFFFF;
 	//USBHDBGSerial.print("remain = ");
 	//USBHDBGSerial.println(remain);
 	if (microseconds < remain) {
 		// this timer event is before any on the schedule
 		__disable_irq();
-		USBHS_GPTIMER1CTL = 0;
-		USBHS_USBSTS = USBHS_USBSTS_TI1; // TODO: UPI & UAI safety?!
+		regs->GPTIMER1CTL = 0;
+		regs->USBSTS = USBHS_USBSTS_TI1; // TODO: UPI & UAI safety?!
 		usec = microseconds;
 		next = active_timers;
 		prev = NULL;
 		active_timers->usec = remain - microseconds;
 		active_timers->prev = this;
 		active_timers = this;
-		USBHS_GPTIMER1LD = microseconds - 1;
-		USBHS_GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
+		regs->GPTIMER1LD = microseconds - 1;
+		regs->GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
 		__enable_irq();
 		return;
 	}
@@ -517,16 +651,18 @@ void USBDriverTimer::start(uint32_t microseconds)
 
 void USBDriverTimer::stop()
 {
+	if (!timer_controller) return;
+	EHCI_registers_t *regs = timer_controller->regs;
 	__disable_irq();
 	if (active_timers) {
 		if (active_timers == this) {
-			USBHS_GPTIMER1CTL = 0;
+			regs->GPTIMER1CTL = 0;
 			if (next) {
-				uint32_t usec_til_next = USBHS_GPTIMER1CTL & 0xFFFFFF;
+				uint32_t usec_til_next = regs->GPTIMER1CTL & 0xFFFFFF;
 				usec_til_next += next->usec;
 				next->usec = usec_til_next;
-				USBHS_GPTIMER1LD = usec_til_next;
-				USBHS_GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
+				regs->GPTIMER1LD = usec_til_next;
+				regs->GPTIMER1CTL = USBHS_GPTIMERCTL_RST | USBHS_GPTIMERCTL_RUN;
 				next->prev = NULL;
 				active_timers = next;
 			} else {
@@ -582,7 +718,7 @@ Pipe_t * USBHost::new_Pipe(Device_t *dev, uint32_t type, uint32_t endpoint,
 {
 	Pipe_t *pipe;
 	Transfer_t *halt;
-	uint32_t c=0, dtc=0;
+	uint32_t cflag=0, dtc=0;
 
 	println("new_Pipe");
 	pipe = allocate_Pipe();
@@ -621,7 +757,7 @@ Pipe_t * USBHost::new_Pipe(Device_t *dev, uint32_t type, uint32_t endpoint,
 	}
 	if (type == 0) {
 		// control
-		if (dev->speed < 2) c = 1;
+		if (dev->speed < 2) cflag = 1;
 		dtc = 1;
 	} else if (type == 2) {
 		// bulk
@@ -629,19 +765,20 @@ Pipe_t * USBHost::new_Pipe(Device_t *dev, uint32_t type, uint32_t endpoint,
 		// interrupt
 		//pipe->qh.token = 0x80000000; // TODO: OUT starts with DATA0 or DATA1?
 	}
-	pipe->qh.capabilities[0] = QH_capabilities1(15, c, maxlen, 0,
+	pipe->qh.capabilities[0] = QH_capabilities1(15, cflag, maxlen, 0,
 		dtc, dev->speed, endpoint, 0, dev->address);
-	pipe->qh.capabilities[1] = QH_capabilities2(1, dev->hub_port,
-		dev->hub_address, pipe->complete_mask, pipe->start_mask);
+	pipe->qh.capabilities[1] = QH_capabilities2(1, dev->tt_port,
+		dev->tt_address, pipe->complete_mask, pipe->start_mask);
 
 	if (type == 0 || type == 2) {
 		// control or bulk: add to async queue
-		Pipe_t *list = (Pipe_t *)USBHS_ASYNCLISTADDR;
+		Controller_t *c = dev->controller;
+		Pipe_t *list = (Pipe_t *)c->regs->ASYNCLISTADDR;
 		if (list == NULL) {
 			pipe->qh.capabilities[0] |= 0x8000; // H bit
 			pipe->qh.horizontal_link = (uint32_t)&(pipe->qh) | 2; // 2=QH
-			USBHS_ASYNCLISTADDR = (uint32_t)&(pipe->qh);
-			USBHS_USBCMD |= USBHS_USBCMD_ASE; // enable async schedule
+			c->regs->ASYNCLISTADDR = (uint32_t)&(pipe->qh);
+			c->regs->USBCMD |= USBHS_USBCMD_ASE; // enable async schedule
 			//println("  first in async list");
 		} else {
 			// EHCI 1.0: section 4.8.1, page 72
@@ -834,12 +971,13 @@ bool USBHost::queue_Transfer(Pipe_t *pipe, Transfer_t *transfer)
 	p->next_followup = NULL;
 	//print(halt, p);
 	// add them to a followup list
+	Controller_t *c = pipe->device->controller;
 	if (pipe->type == 0 || pipe->type == 2) {
 		// control or bulk
-		add_to_async_followup_list(halt, p);
+		add_to_async_followup_list(c, halt, p);
 	} else {
 		// interrupt
-		add_to_periodic_followup_list(halt, p);
+		add_to_periodic_followup_list(c, halt, p);
 	}
 	// old halt becomes new transfer, this commits all new qTDs to QH
 	halt->qtd.token = token;
@@ -867,15 +1005,15 @@ bool USBHost::followup_Transfer(Transfer_t *transfer)
 	return false;
 }
 
-void USBHost::followup_Error(void)
+void USBHost::followup_Error(Controller_t *c)
 {
 	println("ERROR Followup");
-	Transfer_t *p = async_followup_first;
+	Transfer_t *p = c->async_followup_first;
 	while (p) {
 		if (followup_Transfer(p)) {
 			// transfer completed
 			Transfer_t *next = p->next_followup;
-			remove_from_async_followup_list(p);
+			remove_from_async_followup_list(c, p);
 			println("    remove from followup list");
 			if (p->qtd.token & 0x40) {
 				Pipe_t *haltedpipe = p->pipe;
@@ -890,7 +1028,7 @@ void USBHost::followup_Error(void)
 					Transfer_t *next2 = p->next_followup;
 					if (p->pipe == haltedpipe) {
 						println("    stray halted ", (uint32_t)p, HEX);
-						remove_from_async_followup_list(p);
+						remove_from_async_followup_list(c, p);
 						if (first == NULL) {
 							first = p;
 							last = p;
@@ -952,61 +1090,61 @@ void USBHost::followup_Error(void)
 	// TODO: handle errors from periodic schedule!
 }
 
-static void add_to_async_followup_list(Transfer_t *first, Transfer_t *last)
+static void add_to_async_followup_list(Controller_t *c, Transfer_t *first, Transfer_t *last)
 {
 	last->next_followup = NULL; // always add to end of list
-	if (async_followup_last == NULL) {
+	if (c->async_followup_last == NULL) {
 		first->prev_followup = NULL;
-		async_followup_first = first;
+		c->async_followup_first = first;
 	} else {
-		first->prev_followup = async_followup_last;
-		async_followup_last->next_followup = first;
+		first->prev_followup = c->async_followup_last;
+		c->async_followup_last->next_followup = first;
 	}
-	async_followup_last = last;
+	c->async_followup_last = last;
 }
 
-static void remove_from_async_followup_list(Transfer_t *transfer)
+static void remove_from_async_followup_list(Controller_t *c, Transfer_t *transfer)
 {
 	Transfer_t *next = transfer->next_followup;
 	Transfer_t *prev = transfer->prev_followup;
 	if (prev) {
 		prev->next_followup = next;
 	} else {
-		async_followup_first = next;
+		c->async_followup_first = next;
 	}
 	if (next) {
 		next->prev_followup = prev;
 	} else {
-		async_followup_last = prev;
+		c->async_followup_last = prev;
 	}
 }
 
-static void add_to_periodic_followup_list(Transfer_t *first, Transfer_t *last)
+static void add_to_periodic_followup_list(Controller_t *c, Transfer_t *first, Transfer_t *last)
 {
 	last->next_followup = NULL; // always add to end of list
-	if (periodic_followup_last == NULL) {
+	if (c->periodic_followup_last == NULL) {
 		first->prev_followup = NULL;
-		periodic_followup_first = first;
+		c->periodic_followup_first = first;
 	} else {
-		first->prev_followup = periodic_followup_last;
-		periodic_followup_last->next_followup = first;
+		first->prev_followup = c->periodic_followup_last;
+		c->periodic_followup_last->next_followup = first;
 	}
-	periodic_followup_last = last;
+	c->periodic_followup_last = last;
 }
 
-static void remove_from_periodic_followup_list(Transfer_t *transfer)
+static void remove_from_periodic_followup_list(Controller_t *c, Transfer_t *transfer)
 {
 	Transfer_t *next = transfer->next_followup;
 	Transfer_t *prev = transfer->prev_followup;
 	if (prev) {
 		prev->next_followup = next;
 	} else {
-		periodic_followup_first = next;
+		c->periodic_followup_first = next;
 	}
 	if (next) {
 		next->prev_followup = prev;
 	} else {
-		periodic_followup_last = prev;
+		c->periodic_followup_last = prev;
 	}
 }
 
@@ -1061,6 +1199,7 @@ static uint32_t round_to_power_of_two(uint32_t n, uint32_t maxnum)
 //
 bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, uint32_t interval)
 {
+	Controller_t *c = pipe->device->controller;
 	println("allocate_interrupt_pipe_bandwidth");
 	if (interval == 0) interval = 1;
 	maxlen = (maxlen * 76459) >> 16; // worst case bit stuffing
@@ -1080,7 +1219,7 @@ bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, u
 			// for each possible uframe offset, find the worst uframe bandwidth
 			uint32_t max_bandwidth = 0;
 			for (uint32_t i=offset; i < PERIODIC_LIST_SIZE*8; i += interval) {
-				uint32_t bandwidth = uframe_bandwidth[i] + stime;
+				uint32_t bandwidth = c->uframe_bandwidth[i] + stime;
 				if (bandwidth > max_bandwidth) max_bandwidth = bandwidth;
 			}
 			// remember which uframe offset is the best
@@ -1101,7 +1240,7 @@ bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, u
 		pipe->bandwidth_offset = best_offset;
 		pipe->bandwidth_stime = stime;
 		for (uint32_t i=best_offset; i < PERIODIC_LIST_SIZE*8; i += interval) {
-			uframe_bandwidth[i] += stime;
+			c->uframe_bandwidth[i] += stime;
 		}
 		if (interval == 1) {
 			pipe->start_mask = 0xFF;
@@ -1132,6 +1271,8 @@ bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, u
 		}
 		// TODO: should we take Single-TT hubs into account, avoid
 		// scheduling overlapping SSPLIT & CSPLIT to the same hub?
+		// device->tt_address, tt_port & tt_multi identify which TT
+		// will carry this pipe's full/low speed transactions.
 		// TODO: even if Multi-TT, do we need to worry about packing
 		// too many into the same uframe?
 		uint32_t best_shift = 0;
@@ -1145,10 +1286,10 @@ bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, u
 					// at each location, find worst uframe usage
 					// for SSPLIT+CSPLITs
 					uint32_t n = (i << 3) + j;
-					uint32_t bw1 = uframe_bandwidth[n+0] + stime;
-					uint32_t bw2 = uframe_bandwidth[n+2] + ctime;
-					uint32_t bw3 = uframe_bandwidth[n+3] + ctime;
-					uint32_t bw4 = uframe_bandwidth[n+4] + ctime;
+					uint32_t bw1 = c->uframe_bandwidth[n+0] + stime;
+					uint32_t bw2 = c->uframe_bandwidth[n+2] + ctime;
+					uint32_t bw3 = c->uframe_bandwidth[n+3] + ctime;
+					uint32_t bw4 = c->uframe_bandwidth[n+4] + ctime;
 					max_bandwidth = max4(bw1, bw2, bw3, bw4);
 					// remember the best usage found
 					if (max_bandwidth < best_bandwidth) {
@@ -1176,10 +1317,10 @@ bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, u
 		pipe->bandwidth_ctime = ctime;
 		for (uint32_t i=best_offset; i < PERIODIC_LIST_SIZE; i += interval) {
 			uint32_t n = (i << 3) + best_shift;
-			uframe_bandwidth[n+0] += stime;
-			uframe_bandwidth[n+2] += ctime;
-			uframe_bandwidth[n+3] += ctime;
-			uframe_bandwidth[n+4] += ctime;
+			c->uframe_bandwidth[n+0] += stime;
+			c->uframe_bandwidth[n+2] += ctime;
+			c->uframe_bandwidth[n+3] += ctime;
+			c->uframe_bandwidth[n+4] += ctime;
 		}
 		pipe->start_mask = 0x01 << best_shift;
 		pipe->complete_mask = 0x1C << best_shift;
@@ -1193,12 +1334,13 @@ bool USBHost::allocate_interrupt_pipe_bandwidth(Pipe_t *pipe, uint32_t maxlen, u
 //
 void USBHost::add_qh_to_periodic_schedule(Pipe_t *pipe)
 {
+	Controller_t *c = pipe->device->controller;
 	// quick hack for testing, just put it into the first table entry
 	//println("add_qh_to_periodic_schedule: ", (uint32_t)pipe, HEX);
 #if 0
-	pipe->qh.horizontal_link = periodictable[0];
-	periodictable[0] = (uint32_t)&(pipe->qh) | 2; // 2=QH
-	println("init periodictable with ", periodictable[0], HEX);
+	pipe->qh.horizontal_link = c->periodictable[0];
+	c->periodictable[0] = (uint32_t)&(pipe->qh) | 2; // 2=QH
+	println("init periodictable with ", c->periodictable[0], HEX);
 #else
 	uint32_t interval = pipe->periodic_interval;
 	uint32_t offset = pipe->periodic_offset;
@@ -1209,13 +1351,13 @@ void USBHost::add_qh_to_periodic_schedule(Pipe_t *pipe)
 	for (uint32_t i=offset; i < PERIODIC_LIST_SIZE; i += interval) {
 		//print("    old slot ", i);
 		//print(": ");
-		//print_qh_list((Pipe_t *)(periodictable[i] & 0xFFFFFFE0));
-		uint32_t num = periodictable[i];
+		//print_qh_list((Pipe_t *)(c->periodictable[i] & 0xFFFFFFE0));
+		uint32_t num = c->periodictable[i];
 		Pipe_t *node = (Pipe_t *)(num & 0xFFFFFFE0);
 		if ((num & 1) || ((num & 6) == 2 && node->periodic_interval < interval)) {
 			//println("  add to slot ", i);
 			pipe->qh.horizontal_link = num;
-			periodictable[i] = (uint32_t)&(pipe->qh) | 2; // 2=QH
+			c->periodictable[i] = (uint32_t)&(pipe->qh) | 2; // 2=QH
 		} else {
 			//println("  traverse list ", i);
 			// TODO: skip past iTD, siTD when/if we support isochronous
@@ -1245,7 +1387,7 @@ void USBHost::add_qh_to_periodic_schedule(Pipe_t *pipe)
 		nextslot:
 		//print("    new slot ", i);
 		//print(": ");
-		//print_qh_list((Pipe_t *)(periodictable[i] & 0xFFFFFFE0));
+		//print_qh_list((Pipe_t *)(c->periodictable[i] & 0xFFFFFFE0));
 		{}
 	}
 #endif
@@ -1255,7 +1397,7 @@ void USBHost::add_qh_to_periodic_schedule(Pipe_t *pipe)
 		if (i < 10) print(" ");
 		print(i);
 		print(": ");
-		print_qh_list((Pipe_t *)(periodictable[i] & 0xFFFFFFE0));
+		print_qh_list((Pipe_t *)(c->periodictable[i] & 0xFFFFFFE0));
 	}
 #endif
 }
@@ -1264,6 +1406,7 @@ void USBHost::add_qh_to_periodic_schedule(Pipe_t *pipe)
 void USBHost::delete_Pipe(Pipe_t *pipe)
 {
 	println("delete_Pipe ", (uint32_t)pipe, HEX);
+	Controller_t *c = pipe->device->controller;
 
 	// halt pipe, find and free all Transfer_t
 
@@ -1287,9 +1430,9 @@ void USBHost::delete_Pipe(Pipe_t *pipe)
 		if (next == pipe) {
 			// removing the only QH, so just shut down the async schedule
 			println("  shut down async schedule");
-			USBHS_USBCMD &= ~USBHS_USBCMD_ASE; // disable async schedule
-			while (USBHS_USBSTS & USBHS_USBSTS_AS) ; // busy loop wait
-			USBHS_ASYNCLISTADDR = 0;
+			c->regs->USBCMD &= ~USBHS_USBCMD_ASE; // disable async schedule
+			while (c->regs->USBSTS & USBHS_USBSTS_AS) ; // busy loop wait
+			c->regs->ASYNCLISTADDR = 0;
 		} else {
 			// find the previous QH in the async schedule loop
 			println("  remove QH from async schedule");
@@ -1307,20 +1450,20 @@ void USBHost::delete_Pipe(Pipe_t *pipe)
 			prev->qh.horizontal_link = pipe->qh.horizontal_link;
 			// do the Async Advance Doorbell handshake to wait to be
 			// sure the EHCI no longer references the removed QH
-			USBHS_USBCMD |= USBHS_USBCMD_IAA;
-			while (!(USBHS_USBSTS & USBHS_USBSTS_AAI)) ; // busy loop wait
-			USBHS_USBSTS = USBHS_USBSTS_AAI;
+			c->regs->USBCMD |= USBHS_USBCMD_IAA;
+			while (!(c->regs->USBSTS & USBHS_USBSTS_AAI)) ; // busy loop wait
+			c->regs->USBSTS = USBHS_USBSTS_AAI;
 			// TODO: does this write interfere UPI & UAI (bits 18 & 19) ??
 		}
 		// find & free all the transfers which completed
 		println("  Free transfers");
-		Transfer_t *t = async_followup_first;
+		Transfer_t *t = c->async_followup_first;
 		while (t) {
 			print("    * ", (uint32_t)t);
 			Transfer_t *next = t->next_followup;
 			if (t->pipe == pipe) {
 				print(" * remove");
-				remove_from_async_followup_list(t);
+				remove_from_async_followup_list(c, t);
 
 				// Only free if not in QH list
 				Transfer_t *tr = (Transfer_t *)(pipe->qh.next);
@@ -1341,11 +1484,11 @@ void USBHost::delete_Pipe(Pipe_t *pipe)
 	} else {
 		// remove from the periodic schedule
 		for (uint32_t i=0; i < PERIODIC_LIST_SIZE; i++) {
-			uint32_t num = periodictable[i];
+			uint32_t num = c->periodictable[i];
 			if (num & 1) continue;
 			Pipe_t *node = (Pipe_t *)(num & 0xFFFFFFE0);
 			if (node == pipe) {
-				periodictable[i] = pipe->qh.horizontal_link;
+				c->periodictable[i] = pipe->qh.horizontal_link;
 				continue;
 			}
 			Pipe_t *prev = node;
@@ -1366,7 +1509,7 @@ void USBHost::delete_Pipe(Pipe_t *pipe)
 			uint32_t offset = pipe->bandwidth_offset;
 			uint32_t stime = pipe->bandwidth_stime;
 			for (uint32_t i=offset; i < PERIODIC_LIST_SIZE*8; i += interval) {
-				uframe_bandwidth[i] -= stime;
+				c->uframe_bandwidth[i] -= stime;
 			}
 		} else {
 			uint32_t interval = pipe->bandwidth_interval;
@@ -1376,22 +1519,22 @@ void USBHost::delete_Pipe(Pipe_t *pipe)
 			uint32_t ctime = pipe->bandwidth_ctime;
 			for (uint32_t i=offset; i < PERIODIC_LIST_SIZE; i += interval) {
 				uint32_t n = (i << 3) + shift;
-				uframe_bandwidth[n+0] -= stime;
-				uframe_bandwidth[n+2] -= ctime;
-				uframe_bandwidth[n+3] -= ctime;
-				uframe_bandwidth[n+4] -= ctime;
+				c->uframe_bandwidth[n+0] -= stime;
+				c->uframe_bandwidth[n+2] -= ctime;
+				c->uframe_bandwidth[n+3] -= ctime;
+				c->uframe_bandwidth[n+4] -= ctime;
 			}
 		}
 
 		// find & free all the transfers which completed
 		println("  Free transfers");
-		Transfer_t *t = periodic_followup_first;
+		Transfer_t *t = c->periodic_followup_first;
 		while (t) {
 			print("    * ", (uint32_t)t);
 			Transfer_t *next = t->next_followup;
 			if (t->pipe == pipe) {
 				print(" * remove");
-				remove_from_periodic_followup_list(t);
+				remove_from_periodic_followup_list(c, t);
 
 				// Only free if not in QH list
 				Transfer_t *tr = (Transfer_t *)(pipe->qh.next);
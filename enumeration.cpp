@@ -41,18 +41,75 @@ static Device_t  *devlist=NULL;
 // devices.
 static USBDriver *available_drivers = NULL;
 
-// Static buffers used during enumeration.  One a single USB device
-// may enumerate at once, because USB address zero is used, and
-// because this static buffer & state info can't be shared.
-static uint8_t enumbuf[512] __attribute__ ((aligned(16)));
-static setup_t enumsetup __attribute__ ((aligned(16)));
-static uint16_t enumlen;
-
-// True while any device is present but not yet fully configured.
-// Only one USB device may be in this state at a time (responding
-// to address zero) and using the enumeration static buffer.
-volatile bool USBHost::enumeration_busy = false;
-
+// Buffers used during enumeration.  Each device being enumerated is
+// given one of these, so descriptors and strings for several devices
+// can be read at the same time.  They are returned to the free pool
+// when enumeration completes, so only a few are needed.
+#if defined(USBHOST_ENUMERATION_CONTEXTS)
+#define ENUMERATION_CONTEXTS (USBHOST_ENUMERATION_CONTEXTS)
+#else
+#define ENUMERATION_CONTEXTS  3
+#endif
+typedef struct enum_cache_struct enum_cache_t;
+struct Enumeration_struct {
+	uint8_t  buf[512] __attribute__ ((aligned(16)));
+	setup_t  setup __attribute__ ((aligned(16)));
+	uint16_t len;
+	uint32_t start_micros;
+	uint8_t  devdesc[18];
+	uint8_t  istr[3];	// manufacturer, product, serial string index
+	enum_cache_t *cache;	// device seen before, if not NULL
+	enum_cache_t *saving;	// entry being filled for this device
+	Enumeration_t *next;
+};
+static Enumeration_t enumdata[ENUMERATION_CONTEXTS];
+static Enumeration_t *free_enumdata_list = NULL;
+
+// Descriptors and strings of recently enumerated devices.  When a device
+// reappears (hub power blip, device reset) with an identical device
+// descriptor and serial number, its strings and configuration descriptor
+// are taken from here, skipping most of the control transfers.  An
+// entry in use by an enumeration is pinned, so it can't be replaced
+// until that enumeration is done with it, and an entry only becomes
+// valid once its strings have been read.
+#if defined(USBHOST_ENUMERATION_CACHE)
+#define ENUMERATION_CACHE (USBHOST_ENUMERATION_CACHE)
+#else
+#define ENUMERATION_CACHE  2
+#endif
+#define ENUMERATION_CACHE_CONFIG_SIZE 256
+struct enum_cache_struct {
+	uint8_t  devdesc[18];
+	uint8_t  valid;
+	uint8_t  pinned;	// number of enumerations using this entry
+	uint16_t LanguageID;
+	uint16_t len;
+	strbuf_t strings;
+	uint8_t  config[ENUMERATION_CACHE_CONFIG_SIZE];
+};
+#if ENUMERATION_CACHE > 0
+static enum_cache_t enum_cache[ENUMERATION_CACHE];
+static uint8_t enum_cache_next = 0;
+#endif
+
+// Controllers with a device responding to address zero.  Only one USB
+// device per bus may be in this state at a time, from port reset until
+// its SET_ADDRESS completes.
+static Controller_t *address0_busy[USBHOST_CONTROLLERS];
+
+static void set_address0_busy(Controller_t *controller, bool busy)
+{
+	for (uint32_t i=0; i < USBHOST_CONTROLLERS; i++) {
+		if (address0_busy[i] == controller) address0_busy[i] = NULL;
+	}
+	if (!busy) return;
+	for (uint32_t i=0; i < USBHOST_CONTROLLERS; i++) {
+		if (address0_busy[i] == NULL) {
+			address0_busy[i] = controller;
+			return;
+		}
+	}
+}
 
 
 static void pipe_set_maxlen(Pipe_t *pipe, uint32_t maxlen);
@@ -93,9 +150,101 @@ void USBHost::driver_ready_for_device(USBDriver *driver)
 	}
 }
 
+void USBHost::clearEnumerationCache()
+{
+#if ENUMERATION_CACHE > 0
+	__disable_irq();
+	for (uint32_t i=0; i < ENUMERATION_CACHE; i++) {
+		enum_cache[i].valid = 0;
+	}
+	__enable_irq();
+#endif
+}
+
+static enum_cache_t * find_enum_cache(const uint8_t *devdesc)
+{
+#if ENUMERATION_CACHE > 0
+	for (uint32_t i=0; i < ENUMERATION_CACHE; i++) {
+		enum_cache_t *c = &enum_cache[i];
+		if (c->valid && memcmp(c->devdesc, devdesc, 18) == 0) {
+			c->pinned++;
+			return c;
+		}
+	}
+#endif
+	return NULL;
+}
+
+static void release_enum_cache(Enumeration_t *e)
+{
+	if (e->cache) e->cache->pinned--;
+	if (e->saving) e->saving->pinned--;
+	e->cache = NULL;
+	e->saving = NULL;
+}
+
+// Compare a serial number string descriptor with the ASCII copy saved
+// in a cache entry, converted the same way as the device's strbuf.
+static bool enum_cache_serial_matches(const enum_cache_t *c, const uint8_t *desc)
+{
+	const uint8_t *ascii = &c->strings.buffer[c->strings.iStrings[strbuf_t::STR_ID_SERIAL]];
+	if (desc[1] != 3) return false;
+	uint32_t i;
+	for (i = 2; i + 1 < desc[0]; i += 2) {
+		if (*ascii++ != desc[i]) return false;
+	}
+	return *ascii == 0;
+}
+
+// Remember the config desc of a newly enumerated device, replacing its
+// old entry or else the oldest one not pinned.  Long configuration
+// descriptors are not kept.
+static void save_enum_cache(Enumeration_t *e, const Device_t *dev)
+{
+#if ENUMERATION_CACHE > 0
+	if (!dev->strbuf || e->len > ENUMERATION_CACHE_CONFIG_SIZE) return;
+	enum_cache_t *c = NULL;
+	for (uint32_t i=0; i < ENUMERATION_CACHE; i++) {
+		if (memcmp(enum_cache[i].devdesc, e->devdesc, 18) == 0) {
+			c = &enum_cache[i];
+			break;
+		}
+	}
+	if (!c) {
+		for (uint32_t i=0; i < ENUMERATION_CACHE; i++) {
+			enum_cache_t *n = &enum_cache[enum_cache_next];
+			if (++enum_cache_next >= ENUMERATION_CACHE) enum_cache_next = 0;
+			if (!n->pinned) {
+				c = n;
+				break;
+			}
+		}
+	}
+	if (!c || c->pinned) return;
+	c->valid = 0;
+	c->pinned = 1;
+	e->saving = c;
+	memcpy(c->devdesc, e->devdesc, 18);
+	c->len = e->len;
+	memcpy(c->config, e->buf, e->len);
+#endif
+}
+
+// The strings are read after the config desc was saved, so the entry
+// becomes valid only now.
+static void save_enum_cache_strings(const Enumeration_t *e, const Device_t *dev)
+{
+	enum_cache_t *c = e->saving;
+	if (!c) return;
+	c->LanguageID = dev->LanguageID;
+	c->strings = *dev->strbuf;
+	c->valid = 1;
+}
+
 // Create a new device and begin the enumeration process
 //
-Device_t * USBHost::new_Device(uint32_t speed, uint32_t hub_addr, uint32_t hub_port)
+Device_t * USBHost::new_Device(Controller_t *controller, uint32_t speed,
+	uint32_t hub_addr, uint32_t hub_port)
 {
 	Device_t *dev;
 
@@ -110,23 +259,35 @@ Device_t * USBHost::new_Device(uint32_t speed, uint32_t hub_addr, uint32_t hub_p
 	dev = allocate_Device();
 	if (!dev) return NULL;
 	memset(dev, 0, sizeof(Device_t));
+	dev->controller = controller;
 	dev->speed = speed;
 	dev->address = 0;
 	dev->hub_address = hub_addr;
 	dev->hub_port = hub_port;
+	if (speed < 2) find_transaction_translator(dev);
 	dev->control_pipe = new_Pipe(dev, 0, 0, 0, 8);
 	if (!dev->control_pipe) {
 		free_Device(dev);
 		return NULL;
 	}
+	Enumeration_t *e = allocate_enumeration();
+	if (!e) {
+		delete_Pipe(dev->control_pipe);
+		free_Device(dev);
+		return NULL;
+	}
+	dev->enumeration = e;
+	e->start_micros = micros();
+	e->cache = NULL;
+	e->saving = NULL;
 	dev->strbuf = allocate_string_buffer();  // try to allocate a string buffer; 
 	dev->control_pipe->callback_function = &enumeration;
 	dev->control_pipe->direction = 1; // 1=IN
 	// Here is where the enumeration process officially begins.
-	// Only a single device can enumerate at a time.
-	USBHost::enumeration_busy = true;
-	mk_setup(enumsetup, 0x80, 6, 0x0100, 0, 8); // 6=GET_DESCRIPTOR
-	queue_Control_Transfer(dev, &enumsetup, enumbuf, NULL);
+	// Only a single device can use address zero at a time.
+	set_address0_busy(controller, true);
+	mk_setup(e->setup, 0x80, 6, 0x0100, 0, 8); // 6=GET_DESCRIPTOR
+	queue_Control_Transfer(dev, &e->setup, e->buf, NULL);
 	if (devlist == NULL) {
 		devlist = dev;
 	} else {
@@ -138,6 +299,36 @@ Device_t * USBHost::new_Device(uint32_t speed, uint32_t hub_addr, uint32_t hub_p
 }
 
 
+// Full and low speed devices behind a high speed hub are reached using
+// split transactions, which must be addressed to the hub's transaction
+// translator (TT).  Single-TT hubs have one TT shared by all ports, and
+// Multi-TT hubs have one TT per port.  USBHub always selects the Multi-TT
+// alternate setting when the hub offers it (bDeviceProtocol is 2).  Full
+// speed hubs have no TT, so their devices use the TT their hub uses.  Devices
+// on the EHCI root port use the built-in TT, so address and port are zero.
+//
+void USBHost::find_transaction_translator(Device_t *dev)
+{
+	for (Device_t *hub = devlist; hub; hub = hub->next) {
+		if (hub->address != dev->hub_address || hub->address == 0) continue;
+		if (hub->controller != dev->controller) continue;
+		if (hub->speed == 2) {
+			dev->tt_address = hub->address;
+			dev->tt_port = dev->hub_port;
+			dev->tt_multi = (hub->bDeviceProtocol == 2) ? 1 : 0;
+		} else {
+			dev->tt_address = hub->tt_address;
+			dev->tt_port = hub->tt_port;
+			dev->tt_multi = hub->tt_multi;
+		}
+		println("  TT hub address = ", dev->tt_address);
+		print("  TT port = ", dev->tt_port);
+		println(dev->tt_multi ? " (Multi-TT)" : " (Single-TT)");
+		return;
+	}
+}
+
+
 // Control transfer callback function.  ALL control transfers from all
 // devices call this function when they complete.  When control transfers
 // are created by drivers, the driver is called to handle the result.
@@ -147,6 +338,7 @@ Device_t * USBHost::new_Device(uint32_t speed, uint32_t hub_addr, uint32_t hub_p
 void USBHost::enumeration(const Transfer_t *transfer)
 {
 	Device_t *dev;
+	Enumeration_t *e;
 	uint32_t len;
 
 	// If a driver created this control transfer, allow it to process the result
@@ -159,6 +351,8 @@ void USBHost::enumeration(const Transfer_t *transfer)
 	//print_hexbytes(transfer->buffer, transfer->length);
 	//print(transfer);
 	dev = transfer->pipe->device;
+	e = dev->enumeration;
+	if (!e) return;
 
 	while (1) {
 		// Within this large switch/case, "break" means we've done
@@ -170,121 +364,159 @@ void USBHost::enumeration(const Transfer_t *transfer)
 		// enumeration is complete and no more communication is needed.
 		switch (dev->enum_state) {
 		case 0: // read 8 bytes of device desc, set max packet, and send set address
-			pipe_set_maxlen(dev->control_pipe, enumbuf[7]);
-			mk_setup(enumsetup, 0, 5, assign_address(), 0, 0); // 5=SET_ADDRESS
-			queue_Control_Transfer(dev, &enumsetup, NULL, NULL);
+			pipe_set_maxlen(dev->control_pipe, e->buf[7]);
+			mk_setup(e->setup, 0, 5, assign_address(dev->controller), 0, 0); // 5=SET_ADDRESS
+			queue_Control_Transfer(dev, &e->setup, NULL, NULL);
 			dev->enum_state = 1;
 			return;
 		case 1: // request all 18 bytes of device descriptor
-			dev->address = enumsetup.wValue;
-			pipe_set_addr(dev->control_pipe, enumsetup.wValue);
-			mk_setup(enumsetup, 0x80, 6, 0x0100, 0, 18); // 6=GET_DESCRIPTOR
-			queue_Control_Transfer(dev, &enumsetup, enumbuf, NULL);
+			dev->address = e->setup.wValue;
+			pipe_set_addr(dev->control_pipe, e->setup.wValue);
+			// device no longer uses address zero, so another device
+			// may now be reset while this one continues enumerating
+			set_address0_busy(dev->controller, false);
+			mk_setup(e->setup, 0x80, 6, 0x0100, 0, 18); // 6=GET_DESCRIPTOR
+			queue_Control_Transfer(dev, &e->setup, e->buf, NULL);
 			dev->enum_state = 2;
 			return;
 		case 2: // parse 18 device desc bytes
-			print_device_descriptor(enumbuf);
-			dev->bDeviceClass = enumbuf[4];
-			dev->bDeviceSubClass = enumbuf[5];
-			dev->bDeviceProtocol = enumbuf[6];
-			dev->idVendor = enumbuf[8] | (enumbuf[9] << 8);
-			dev->idProduct = enumbuf[10] | (enumbuf[11] << 8);
-			enumbuf[0] = enumbuf[14];
-			enumbuf[1] = enumbuf[15];
-			enumbuf[2] = enumbuf[16];
-			if ((enumbuf[0] | enumbuf[1] | enumbuf[2]) > 0) {
-				dev->enum_state = 3;
+			print_device_descriptor(e->buf);
+			dev->bDeviceClass = e->buf[4];
+			dev->bDeviceSubClass = e->buf[5];
+			dev->bDeviceProtocol = e->buf[6];
+			dev->idVendor = e->buf[8] | (e->buf[9] << 8);
+			dev->idProduct = e->buf[10] | (e->buf[11] << 8);
+			memcpy(e->devdesc, e->buf, 18);
+			e->cache = dev->strbuf ? find_enum_cache(e->devdesc) : NULL;
+			e->istr[0] = e->buf[14];
+			e->istr[1] = e->buf[15];
+			e->istr[2] = e->buf[16];
+			if (e->cache) {
+				// seen before, only the serial number needs checking
+				println("enumeration cache hit");
+				dev->LanguageID = e->cache->LanguageID;
+				dev->enum_state = e->istr[2] ? 9 : 16;
 			} else {
+				// strings are read after the drivers claim the device
 				dev->enum_state = 11;
 			}
 			break;
 		case 3: // request Language ID
-			len = sizeof(enumbuf) - 4;
-			mk_setup(enumsetup, 0x80, 6, 0x0300, 0, len); // 6=GET_DESCRIPTOR
-			queue_Control_Transfer(dev, &enumsetup, enumbuf + 4, NULL);
+			len = sizeof(e->buf) - 4;
+			mk_setup(e->setup, 0x80, 6, 0x0300, 0, len); // 6=GET_DESCRIPTOR
+			queue_Control_Transfer(dev, &e->setup, e->buf + 4, NULL);
 			dev->enum_state = 4;
 			return;
 		case 4: // parse Language ID
-			if (enumbuf[4] < 4 || enumbuf[5] != 3) {
-				dev->enum_state = 11;
+			if (e->buf[4] < 4 || e->buf[5] != 3) {
+				dev->enum_state = 17;
 			} else {
-				dev->LanguageID = enumbuf[6] | (enumbuf[7] << 8);
-				if (enumbuf[0]) dev->enum_state = 5;
-				else if (enumbuf[1]) dev->enum_state = 7;
-				else if (enumbuf[2]) dev->enum_state = 9;
-				else dev->enum_state = 11;
+				dev->LanguageID = e->buf[6] | (e->buf[7] << 8);
+				if (e->istr[0]) dev->enum_state = 5;
+				else if (e->istr[1]) dev->enum_state = 7;
+				else if (e->istr[2]) dev->enum_state = 9;
+				else dev->enum_state = 17;
 			}
 			break;
 		case 5: // request Manufacturer string
-			len = sizeof(enumbuf) - 4;
-			mk_setup(enumsetup, 0x80, 6, 0x0300 | enumbuf[0], dev->LanguageID, len);
-			queue_Control_Transfer(dev, &enumsetup, enumbuf + 4, NULL);
+			len = sizeof(e->buf) - 4;
+			mk_setup(e->setup, 0x80, 6, 0x0300 | e->istr[0], dev->LanguageID, len);
+			queue_Control_Transfer(dev, &e->setup, e->buf + 4, NULL);
 			dev->enum_state = 6;
 			return;
 		case 6: // parse Manufacturer string
-			print_string_descriptor("Manufacturer: ", enumbuf + 4);
+			print_string_descriptor("Manufacturer: ", e->buf + 4);
 			convertStringDescriptorToASCIIString(0, dev, transfer);
-			// TODO: receive the string...
-			if (enumbuf[1]) dev->enum_state = 7;
-			else if (enumbuf[2]) dev->enum_state = 9;
-			else dev->enum_state = 11;
+			if (e->istr[1]) dev->enum_state = 7;
+			else if (e->istr[2]) dev->enum_state = 9;
+			else dev->enum_state = 17;
 			break;
 		case 7: // request Product string
-			len = sizeof(enumbuf) - 4;
-			mk_setup(enumsetup, 0x80, 6, 0x0300 | enumbuf[1], dev->LanguageID, len);
-			queue_Control_Transfer(dev, &enumsetup, enumbuf + 4, NULL);
+			len = sizeof(e->buf) - 4;
+			mk_setup(e->setup, 0x80, 6, 0x0300 | e->istr[1], dev->LanguageID, len);
+			queue_Control_Transfer(dev, &e->setup, e->buf + 4, NULL);
 			dev->enum_state = 8;
 			return;
 		case 8: // parse Product string
-			print_string_descriptor("Product: ", enumbuf + 4);
+			print_string_descriptor("Product: ", e->buf + 4);
 			convertStringDescriptorToASCIIString(1, dev, transfer);
-			if (enumbuf[2]) dev->enum_state = 9;
-			else dev->enum_state = 11;
+			if (e->istr[2]) dev->enum_state = 9;
+			else dev->enum_state = 17;
 			break;
 		case 9: // request Serial Number string
-			len = sizeof(enumbuf) - 4;
-			mk_setup(enumsetup, 0x80, 6, 0x0300 | enumbuf[2], dev->LanguageID, len);
-			queue_Control_Transfer(dev, &enumsetup, enumbuf + 4, NULL);
+			len = sizeof(e->buf) - 4;
+			mk_setup(e->setup, 0x80, 6, 0x0300 | e->istr[2], dev->LanguageID, len);
+			queue_Control_Transfer(dev, &e->setup, e->buf + 4, NULL);
 			dev->enum_state = 10;
 			return;
 		case 10: // parse Serial Number string
-			print_string_descriptor("Serial Number: ", enumbuf + 4);
+			print_string_descriptor("Serial Number: ", e->buf + 4);
+			if (e->cache) {
+				if (enum_cache_serial_matches(e->cache, e->buf + 4)) {
+					dev->enum_state = 16;
+				} else {
+					// a different unit of the same product
+					release_enum_cache(e);
+					dev->enum_state = 11;
+				}
+				break;
+			}
 			convertStringDescriptorToASCIIString(2, dev, transfer);
-			dev->enum_state = 11;
+			dev->enum_state = 17;
 			break;
 		case 11: // request first 9 bytes of config desc
-			mk_setup(enumsetup, 0x80, 6, 0x0200, 0, 9); // 6=GET_DESCRIPTOR
-			queue_Control_Transfer(dev, &enumsetup, enumbuf, NULL);
+			mk_setup(e->setup, 0x80, 6, 0x0200, 0, 9); // 6=GET_DESCRIPTOR
+			queue_Control_Transfer(dev, &e->setup, e->buf, NULL);
 			dev->enum_state = 12;
 			return;
 		case 12: // read 9 bytes, request all of config desc
-			enumlen = enumbuf[2] | (enumbuf[3] << 8);
-			println("Config data length = ", enumlen);
-			if (enumlen > sizeof(enumbuf)) {
-				enumlen = sizeof(enumbuf);
+			e->len = e->buf[2] | (e->buf[3] << 8);
+			println("Config data length = ", e->len);
+			if (e->len > sizeof(e->buf)) {
+				e->len = sizeof(e->buf);
 				// TODO: how to handle device with too much config data
 			}
-			mk_setup(enumsetup, 0x80, 6, 0x0200, 0, enumlen); // 6=GET_DESCRIPTOR
-			queue_Control_Transfer(dev, &enumsetup, enumbuf, NULL);
+			mk_setup(e->setup, 0x80, 6, 0x0200, 0, e->len); // 6=GET_DESCRIPTOR
+			queue_Control_Transfer(dev, &e->setup, e->buf, NULL);
 			dev->enum_state = 13;
 			return;
 		case 13: // read all config desc, send set config
-			print_config_descriptor(enumbuf, sizeof(enumbuf));
-			dev->bmAttributes = enumbuf[7];
-			dev->bMaxPower = enumbuf[8];
+			print_config_descriptor(e->buf, sizeof(e->buf));
+			if (!e->cache) save_enum_cache(e, dev);
+			dev->bmAttributes = e->buf[7];
+			dev->bMaxPower = e->buf[8];
 			// TODO: actually do something with interface descriptor?
-			mk_setup(enumsetup, 0, 9, enumbuf[5], 0, 0); // 9=SET_CONFIGURATION
-			queue_Control_Transfer(dev, &enumsetup, NULL, NULL);
+			mk_setup(e->setup, 0, 9, e->buf[5], 0, 0); // 9=SET_CONFIGURATION
+			queue_Control_Transfer(dev, &e->setup, NULL, NULL);
 			dev->enum_state = 14;
 			return;
 		case 14: // device is now configured
 			claim_drivers(dev);
+			println("enumeration time, us = ", micros() - e->start_micros);
+			// Strings are read now, so they no longer delay the
+			// drivers.  The config desc is not needed anymore, so
+			// its buffer is reused for them.
+			if (!e->cache && dev->strbuf && (e->istr[0] | e->istr[1] | e->istr[2])) {
+				dev->enum_state = 3;
+			} else {
+				dev->enum_state = 17;
+			}
+			break;
+		case 16: // use strings and config desc from the cache
+			*dev->strbuf = e->cache->strings;
+			e->len = e->cache->len;
+			memcpy(e->buf, e->cache->config, e->len);
+			dev->enum_state = 13;
+			break;
+		case 17: // strings done, enumeration complete
+			save_enum_cache_strings(e, dev);
 			dev->enum_state = 15;
-			// unlock exclusive access to enumeration process.  If any
-			// more devices are waiting, the hub driver is responsible
-			// for resetting their ports and starting their enumeration
-			// when the port enables.
-			USBHost::enumeration_busy = false;
+			// return the enumeration buffer.  If any more devices are
+			// waiting, the hub driver is responsible for resetting
+			// their ports and starting their enumeration when the
+			// port enables.
+			dev->enumeration = NULL;
+			free_enumeration(e);
 			return;
 		case 15: // control transfers for other stuff?
 			// TODO: handle other standard control: set/clear feature, etc
@@ -324,14 +556,40 @@ void  USBHost::convertStringDescriptorToASCIIString(uint8_t string_index, Device
 }
 
 
+// Check a driver's match_list against the device (iface NULL) or one
+// of its interface descriptors.  Drivers without a list match anything.
+static bool match_driver(const usb_match_t *m, const Device_t *dev, const uint8_t *iface)
+{
+	if (m == NULL) return true;
+	uint8_t level = iface ? 0 : USB_MATCH_DEVICE;
+	uint8_t bClass = iface ? iface[5] : dev->bDeviceClass;
+	uint8_t bSubClass = iface ? iface[6] : dev->bDeviceSubClass;
+	uint8_t bProtocol = iface ? iface[7] : dev->bDeviceProtocol;
+	for (; m->match; m++) {
+		if ((m->match & USB_MATCH_DEVICE) != level) continue;
+		if ((m->match & USB_MATCH_CLASS) && m->bClass != bClass) continue;
+		if ((m->match & USB_MATCH_SUBCLASS) && m->bSubClass != bSubClass) continue;
+		if ((m->match & USB_MATCH_PROTOCOL) && m->bProtocol != bProtocol) continue;
+		if ((m->match & USB_MATCH_VENDOR) && m->idVendor != dev->idVendor) continue;
+		if ((m->match & USB_MATCH_PRODUCT) && m->idProduct != dev->idProduct) continue;
+		return true;
+	}
+	return false;
+}
+
 void USBHost::claim_drivers(Device_t *dev)
 {
 	USBDriver *driver, *prev=NULL;
+	const uint8_t *buf = dev->enumeration->buf;
+	const uint32_t len = dev->enumeration->len;
 
 	// first check if any driver wishes to claim the entire device
 	for (driver=available_drivers; driver != NULL; driver = driver->next) {
-		if (driver->device != NULL) continue;
-		if (driver->claim(dev, 0, enumbuf + 9, enumlen - 9)) {
+		if (driver->device != NULL || !match_driver(driver->match_list, dev, NULL)) {
+			prev = driver;
+			continue;
+		}
+		if (driver->claim(dev, 0, buf + 9, len - 9)) {
 			if (prev) {
 				prev->next = driver->next;
 			} else {
@@ -345,8 +603,8 @@ void USBHost::claim_drivers(Device_t *dev)
 		prev = driver;
 	}
 	// parse interfaces from config descriptor
-	const uint8_t *p = enumbuf + 9;
-	const uint8_t *end = enumbuf + enumlen;
+	const uint8_t *p = buf + 9;
+	const uint8_t *end = buf + len;
 	while (p < end) {
 		uint8_t desclen = *p;
 		uint8_t desctype = *(p+1);
@@ -368,7 +626,10 @@ void USBHost::claim_drivers(Device_t *dev)
 			// found an interface, ask available drivers if they want it
 			prev = NULL;
 			for (driver=available_drivers; driver != NULL; driver = driver->next) {
-				if (driver->device != NULL) continue;
+				if (driver->device != NULL || !match_driver(driver->match_list, dev, p)) {
+					prev = driver;
+					continue;
+				}
 				// TODO: should parse ahead and give claim()
 				// an accurate length.  (end - p) is the rest
 				// of ALL descriptors, likely more interfaces
@@ -385,7 +646,9 @@ void USBHost::claim_drivers(Device_t *dev)
 					driver->next = dev->drivers;
 					dev->drivers = driver;
 					driver->device = dev;
-					// not done, may be more interface for more drivers
+					// not done, may be more interface for more drivers,
+					// but no other driver gets this one
+					break;
 				}
 				prev = driver;
 			}
@@ -394,21 +657,58 @@ void USBHost::claim_drivers(Device_t *dev)
 	}
 }
 
-static bool address_in_use(uint32_t addr)
+void USBHost::init_Enumeration_memory(void)
+{
+	free_enumdata_list = NULL;
+	for (uint32_t i=0; i < ENUMERATION_CONTEXTS; i++) {
+		free_enumeration(&enumdata[i]);
+	}
+	for (uint32_t i=0; i < USBHOST_CONTROLLERS; i++) {
+		address0_busy[i] = NULL;
+	}
+}
+
+Enumeration_t * USBHost::allocate_enumeration(void)
+{
+	Enumeration_t *e = free_enumdata_list;
+	if (e) free_enumdata_list = e->next;
+	return e;
+}
+
+void USBHost::free_enumeration(Enumeration_t *e)
+{
+	release_enum_cache(e);
+	e->next = free_enumdata_list;
+	free_enumdata_list = e;
+}
+
+// True while a device on this controller is using address zero, or all
+// enumeration buffers are in use.  The hub driver must wait before
+// resetting a port when this is true.
+bool USBHost::enumeration_busy(Controller_t *controller)
+{
+	if (free_enumdata_list == NULL) return true;
+	for (uint32_t i=0; i < USBHOST_CONTROLLERS; i++) {
+		if (address0_busy[i] == controller) return true;
+	}
+	return false;
+}
+
+static bool address_in_use(Controller_t *controller, uint32_t addr)
 {
 	for (Device_t *p = devlist; p; p = p->next) {
-		if (p->address == addr) return true;
+		if (p->address == addr && p->controller == controller) return true;
 	}
 	return false;
 }
 
-uint32_t USBHost::assign_address(void)
+uint32_t USBHost::assign_address(Controller_t *controller)
 {
 	static uint8_t last_assigned_address=0;
 	uint32_t addr = last_assigned_address;
 	while (1) {
 		if (++addr > 127) addr = 1;
-		if (!address_in_use(addr)) {
+		if (!address_in_use(controller, addr)) {
 			last_assigned_address = addr;
 			return addr;
 		}
@@ -455,6 +755,13 @@ void USBHost::disconnect_Device(Device_t *dev)
 	}
 	delete_Pipe(dev->control_pipe);
 
+	// if still enumerating, release the enumeration buffer and address zero
+	if (dev->enumeration) {
+		if (dev->enum_state <= 1) set_address0_busy(dev->controller, false);
+		free_enumeration(dev->enumeration);
+		dev->enumeration = NULL;
+	}
+
 	// remove device from devlist and free its Device_t
 	Device_t *prev_dev = NULL;
 	for (Device_t *p = devlist; p; p = p->next) {
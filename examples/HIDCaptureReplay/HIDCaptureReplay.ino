@@ -0,0 +1,148 @@
+// Capture and replay of HID input reports
+//
+// Connect a mouse or joystick and move it.  The report descriptor and
+// the first reports are captured.  Then send 'r' to replay them: each
+// replay must give the drivers exactly the same input fields, and the
+// time taken to parse each report is printed.  Send 'd' to print the
+// captured descriptor and reports, to keep them for later comparison.
+//
+// This example is in the public domain
+
+#include "USBHost_t36.h"
+
+USBHost myusb;
+USBHub hub1(myusb);
+USBHIDParser hid1(myusb);
+USBHIDParser hid2(myusb);
+MouseController mouse1(myusb);
+JoystickController joystick1(myusb);
+USBHIDInput *hiddrivers[] = {&mouse1, &joystick1};
+
+#define MAX_REPORTS 200
+#define MAX_REPORT_SIZE 64
+
+// written by the USB interrupt, until the capture is full
+USBHIDParser *captured_parser = nullptr;
+uint8_t descriptor[512];
+uint32_t descriptor_len = 0;
+uint8_t reports[MAX_REPORTS][MAX_REPORT_SIZE];
+uint8_t report_len[MAX_REPORTS];
+uint32_t report_micros[MAX_REPORTS];
+volatile uint32_t report_count = 0;
+
+hidevent_t mouse_events[64];
+hidevent_t joystick_events[64];
+
+void capture(USBHIDParser *parser, uint8_t type, const uint8_t *data,
+  uint32_t len, uint32_t us, uint32_t cycles)
+{
+  if (type == CAPTURE_DESCRIPTOR) {
+    if (captured_parser) return;
+    captured_parser = parser;
+    if (len > sizeof(descriptor)) len = sizeof(descriptor);
+    memcpy(descriptor, data, len);
+    descriptor_len = len;
+    return;
+  }
+  if (parser != captured_parser) return;
+  uint32_t n = report_count;
+  if (n >= MAX_REPORTS) return;
+  if (len > MAX_REPORT_SIZE) len = MAX_REPORT_SIZE;
+  memcpy(reports[n], data, len);
+  report_len[n] = len;
+  report_micros[n] = us;
+  report_count = n + 1;
+}
+
+// Checksum of every field the drivers received, without arrival times
+uint32_t drain_events()
+{
+  uint32_t sum = 0;
+  hidevent_t e;
+  while (mouse1.readEvent(e)) sum = sum * 31 + e.usage * 7 + e.value;
+  while (joystick1.readEvent(e)) sum = sum * 31 + e.usage * 7 + e.value;
+  return sum;
+}
+
+uint32_t replay(bool show)
+{
+  uint32_t count = report_count;
+  uint32_t sum = 0;
+  uint32_t total = 0, most = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t cycles = captured_parser->replayReport(reports[i], report_len[i]);
+    total += cycles;
+    if (cycles > most) most = cycles;
+    // drain after every report, so the queues never fill
+    sum = sum * 31 + drain_events();
+  }
+  if (show) {
+    Serial.printf("Replayed %u reports, average %u, max %u cycles\n",
+      count, count ? total / count : 0, most);
+  }
+  return sum;
+}
+
+// The same format is read by the host tests, in the library's tests folder
+void dump()
+{
+  for (USBHIDInput *driver : hiddrivers) {
+    if (*driver) {
+      Serial.printf("device %04x:%04x\n", driver->idVendor(), driver->idProduct());
+      break;
+    }
+  }
+  Serial.printf("descriptor %u:", descriptor_len);
+  for (uint32_t i = 0; i < descriptor_len; i++) Serial.printf(" %02X", descriptor[i]);
+  Serial.println();
+  uint32_t count = report_count;
+  for (uint32_t i = 0; i < count; i++) {
+    Serial.printf("%u:", report_micros[i] - report_micros[0]);
+    for (uint32_t j = 0; j < report_len[i]; j++) Serial.printf(" %02X", reports[i][j]);
+    Serial.println();
+  }
+}
+
+void setup()
+{
+  while (!Serial) ; // wait for Arduino Serial Monitor
+  Serial.println("\n\nHID Capture and Replay");
+  hid1.attachCapture(capture);
+  hid2.attachCapture(capture);
+  mouse1.attachEventQueue(mouse_events, sizeof(mouse_events) / sizeof(mouse_events[0]));
+  joystick1.attachEventQueue(joystick_events, sizeof(joystick_events) / sizeof(joystick_events[0]));
+  myusb.begin();
+}
+
+void loop()
+{
+  static uint32_t last_count = 0;
+  myusb.Task();
+  drain_events();
+
+  uint32_t count = report_count;
+  if (count != last_count && (count == MAX_REPORTS || count - last_count >= 20)) {
+    Serial.printf("%u reports captured\n", count);
+    last_count = count;
+  }
+
+  if (Serial.available()) {
+    int ch = Serial.read();
+    while (Serial.read() != -1) ;
+    if (!captured_parser || report_count == 0) {
+      Serial.println("Nothing captured yet");
+    } else if (ch == 'r') {
+      // Both replays start from the same state, the last report
+      // replayed, so they must give the same fields.
+      replay(false);
+      uint32_t first = replay(true);
+      uint32_t second = replay(false);
+      Serial.printf("Events checksum %08X %08X: %s\n", first, second,
+        (first == second) ? "PASS" : "FAIL");
+      Serial.printf("Longest report while connected: %u cycles\n",
+        captured_parser->maxReportCycles());
+    } else if (ch == 'd') {
+      dump();
+    }
+  }
+}
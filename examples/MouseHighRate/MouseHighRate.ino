@@ -0,0 +1,180 @@
+// High report rate test of MouseController
+//
+// Connect a mouse (a gaming mouse at 1000 to 8000 reports per second is
+// best) and move it and scroll the wheel until the capture is full.
+// Then leave it still.  The captured reports are replayed many times as
+// fast as the driver takes them, with the sketch reading about every 8
+// reports and sometimes a report given between the reads and
+// mouseDataClear(), as the USB interrupt would.  The totals read must be
+// exactly the same as reading after every report, so no motion or wheel
+// counts are lost or counted twice.
+//
+// This example is in the public domain
+
+#include "USBHost_t36.h"
+
+USBHost myusb;
+USBHub hub1(myusb);
+USBHIDParser hid1(myusb);
+USBHIDParser hid2(myusb);
+MouseController mouse1(myusb);
+USBHIDInput *mouse_hid = &mouse1;	// connected when true
+
+#define MAX_REPORTS 500
+#define MAX_REPORT_SIZE 16
+#define PASSES 20
+
+// written by the USB interrupt, until the capture is full
+USBHIDParser *captured_parser = nullptr;
+uint8_t reports[MAX_REPORTS][MAX_REPORT_SIZE];
+uint8_t report_len[MAX_REPORTS];
+uint32_t report_micros[MAX_REPORTS];
+volatile uint32_t report_count = 0;
+volatile uint32_t live_reports = 0;	// arrived after the capture was full
+
+void capture(USBHIDParser *parser, uint8_t type, const uint8_t *data,
+  uint32_t len, uint32_t us, uint32_t cycles)
+{
+  if (type == CAPTURE_DESCRIPTOR) return;
+  if (!captured_parser) {
+    if (!*mouse_hid) return;
+    captured_parser = parser;
+  }
+  if (parser != captured_parser) return;
+  uint32_t n = report_count;
+  if (n >= MAX_REPORTS) {
+    live_reports++;
+    return;
+  }
+  if (len > MAX_REPORT_SIZE) len = MAX_REPORT_SIZE;
+  memcpy(reports[n], data, len);
+  report_len[n] = len;
+  report_micros[n] = us;
+  report_count = n + 1;
+}
+
+typedef struct {
+  int32_t x, y, wheel, wheelH, wheelHiRes, wheelHHiRes;
+} totals_t;
+
+void read_mouse(totals_t &t)
+{
+  t.x += mouse1.getMouseX();
+  t.y += mouse1.getMouseY();
+  t.wheel += mouse1.getWheel();
+  t.wheelH += mouse1.getWheelH();
+  t.wheelHiRes += mouse1.getWheelHiRes();
+  t.wheelHHiRes += mouse1.getWheelHHiRes();
+}
+
+void print_totals(const char *name, const totals_t &t)
+{
+  Serial.printf("%s: X %d, Y %d, wheel %d (%d counts), wheelH %d (%d counts)\n",
+    name, t.x, t.y, t.wheel, t.wheelHiRes, t.wheelH, t.wheelHHiRes);
+}
+
+// Whole detents may differ by one, from the fraction carried between
+// the two runs.  Everything else must be exact.
+bool same_totals(const totals_t &a, const totals_t &b)
+{
+  return a.x == b.x && a.y == b.y && a.wheelHiRes == b.wheelHiRes
+    && a.wheelHHiRes == b.wheelHHiRes && abs(a.wheel - b.wheel) <= 1
+    && abs(a.wheelH - b.wheelH) <= 1;
+}
+
+void run_test()
+{
+  uint32_t count = report_count;
+  uint32_t start = report_micros[0];
+  uint32_t span = report_micros[count - 1] - start;
+  Serial.printf("%u reports captured over %u us", count, span);
+  if (span) Serial.printf(", %u per second", (uint32_t)((uint64_t)(count - 1) * 1000000 / span));
+  Serial.println();
+  Serial.printf("Wheel resolution %u counts per detent\n", mouse1.wheelResolution());
+
+  // Reference: read after every report
+  totals_t expected = {0, 0, 0, 0, 0, 0};
+  totals_t before = {0, 0, 0, 0, 0, 0};
+  read_mouse(before);
+  mouse1.mouseDataClear();
+  live_reports = 0;
+  for (uint32_t n = 0; n < PASSES; n++) {
+    for (uint32_t i = 0; i < count; i++) {
+      captured_parser->replayReport(reports[i], report_len[i]);
+      read_mouse(expected);
+      mouse1.mouseDataClear();
+    }
+  }
+
+  // Fast: read every 8 reports, and every third read gets one more
+  // report between reading and mouseDataClear()
+  totals_t actual = {0, 0, 0, 0, 0, 0};
+  uint32_t since_read = 0, reads = 0, total_cycles = 0, most = 0;
+  for (uint32_t n = 0; n < PASSES; n++) {
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t cycles = captured_parser->replayReport(reports[i], report_len[i]);
+      total_cycles += cycles;
+      if (cycles > most) most = cycles;
+      if (++since_read >= 8) {
+        read_mouse(actual);
+        if (++reads % 3 == 0 && ++i < count) {
+          cycles = captured_parser->replayReport(reports[i], report_len[i]);
+          total_cycles += cycles;
+          if (cycles > most) most = cycles;
+        }
+        mouse1.mouseDataClear();
+        since_read = 0;
+      }
+    }
+  }
+  read_mouse(actual);
+  mouse1.mouseDataClear();
+
+  print_totals("Read every report", expected);
+  print_totals("Read every 8     ", actual);
+  Serial.printf("%u reports parsed, average %u, max %u cycles\n",
+    PASSES * count, total_cycles / (PASSES * count), most);
+  if (live_reports) {
+    Serial.printf("The mouse sent %u reports meanwhile, keep it still and try again\n",
+      live_reports);
+  } else if (same_totals(expected, actual)) {
+    Serial.println("PASS");
+  } else {
+    Serial.println("FAIL");
+  }
+}
+
+void setup()
+{
+  while (!Serial) ; // wait for Arduino Serial Monitor
+  Serial.println("\n\nMouse High Rate Test");
+  hid1.attachCapture(capture);
+  hid2.attachCapture(capture);
+  myusb.begin();
+}
+
+void loop()
+{
+  static bool tested = false;
+  myusb.Task();
+  if (!*mouse_hid) {
+    if (tested || report_count) {
+      // start over with the next mouse
+      captured_parser = nullptr;
+      report_count = 0;
+      tested = false;
+    }
+    return;
+  }
+  if (mouse1.available()) mouse1.mouseDataClear();
+  if (report_count == MAX_REPORTS && !tested) {
+    delay(500); // time to let go of the mouse
+    run_test();
+    tested = true;
+    Serial.println("Send any character to test again");
+  }
+  if (Serial.available()) {
+    while (Serial.read() != -1) ;
+    tested = false;
+  }
+}
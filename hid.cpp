@@ -35,11 +35,149 @@
 #define print   USBHost::print_
 #define println USBHost::println_
 
+// Global item state saved by Push and restored by Pop
+#define HID_PUSH_DEPTH 4
+typedef struct {
+	int32_t  logical_min;
+	int32_t  logical_max;
+	uint16_t usage_page;
+	uint16_t report_size;
+	uint16_t report_count;
+	uint8_t  report_id;
+} hid_globals_t;
+
+// Shared memory for the report descriptor, field table and report buffers
+// of every USBHIDParser, in 32 byte blocks (cache line aligned, so report
+// buffers can be used for DMA), with one bit per block marking it in use.
+#ifndef USBHOST_HID_ARENA_SIZE
+#define USBHOST_HID_ARENA_SIZE 4096
+#endif
+#define HID_ARENA_BLOCK 32
+
+typedef struct hid_arena_struct {
+	struct hid_arena_struct *next;
+	uint8_t  *base;
+	uint32_t  blocks;
+	uint32_t *used;
+} hid_arena_t;
+
+static uint8_t hid_arena_memory[USBHOST_HID_ARENA_SIZE] __attribute__ ((aligned(32)));
+static uint32_t hid_arena_used[(USBHOST_HID_ARENA_SIZE / HID_ARENA_BLOCK + 31) / 32];
+static hid_arena_t hid_arena = {NULL, hid_arena_memory,
+	USBHOST_HID_ARENA_SIZE / HID_ARENA_BLOCK, hid_arena_used};
+
+hidfield_t USBHIDParser::scratch_fields[FIELD_LIST_LEN];
+hidfield_t USBHIDParser::scratch_report_fields[REPORT_FIELD_LIST_LEN];
+uint16_t USBHIDParser::scratch_field_usages[FIELD_USAGE_LEN];
+
+static inline bool arena_block_used(const hid_arena_t *a, uint32_t n)
+{
+	return a->used[n >> 5] & (1 << (n & 31));
+}
+
+static void arena_mark(hid_arena_t *a, uint32_t first, uint32_t count, bool used)
+{
+	for (uint32_t n = first; n < first + count; n++) {
+		if (used) a->used[n >> 5] |= (1 << (n & 31));
+		else a->used[n >> 5] &= ~(1 << (n & 31));
+	}
+}
+
+// First fit, within any one contributed region
+static void * arena_alloc(uint32_t size)
+{
+	if (size == 0) return NULL;
+	uint32_t count = (size + HID_ARENA_BLOCK - 1) / HID_ARENA_BLOCK;
+	__disable_irq();
+	for (hid_arena_t *a = &hid_arena; a; a = a->next) {
+		uint32_t run = 0;
+		for (uint32_t n=0; n < a->blocks; n++) {
+			if (arena_block_used(a, n)) {
+				run = 0;
+			} else if (++run == count) {
+				uint32_t first = n + 1 - count;
+				arena_mark(a, first, count, true);
+				__enable_irq();
+				return a->base + first * HID_ARENA_BLOCK;
+			}
+		}
+	}
+	__enable_irq();
+	return NULL;
+}
+
+static void arena_free(void *ptr, uint32_t size)
+{
+	if (!ptr || size == 0) return;
+	uint8_t *p = (uint8_t *)ptr;
+	uint32_t count = (size + HID_ARENA_BLOCK - 1) / HID_ARENA_BLOCK;
+	__disable_irq();
+	for (hid_arena_t *a = &hid_arena; a; a = a->next) {
+		if (p >= a->base && p < a->base + a->blocks * HID_ARENA_BLOCK) {
+			arena_mark(a, (p - a->base) / HID_ARENA_BLOCK, count, false);
+			break;
+		}
+	}
+	__enable_irq();
+}
+
+// Add more memory to the arena.  Its bookkeeping is kept at the start.
+void USBHIDParser::contribute_Memory(void *mem, uint32_t size)
+{
+	uintptr_t start = (uintptr_t)mem;
+	uintptr_t end = start + size;
+	hid_arena_t *a = (hid_arena_t *)((start + 3) & ~3);
+	uint32_t blocks = size / HID_ARENA_BLOCK;
+	uintptr_t base;
+	while (1) {
+		uint32_t *used = (uint32_t *)(a + 1);
+		base = ((uintptr_t)(used + (blocks + 31) / 32) + HID_ARENA_BLOCK - 1)
+			& ~(uintptr_t)(HID_ARENA_BLOCK - 1);
+		if (blocks == 0 || base + blocks * HID_ARENA_BLOCK <= end) break;
+		blocks--;
+	}
+	if (blocks == 0) return;
+	a->base = (uint8_t *)base;
+	a->blocks = blocks;
+	a->used = (uint32_t *)(a + 1);
+	memset(a->used, 0, (blocks + 31) / 32 * 4);
+	__disable_irq();
+	a->next = hid_arena.next;
+	hid_arena.next = a;
+	__enable_irq();
+}
+
+void USBHIDParser::memoryUsage(uint32_t &used, uint32_t &available, uint32_t &largest)
+{
+	used = available = largest = 0;
+	__disable_irq();
+	for (hid_arena_t *a = &hid_arena; a; a = a->next) {
+		uint32_t run = 0;
+		for (uint32_t n=0; n < a->blocks; n++) {
+			if (arena_block_used(a, n)) {
+				used += HID_ARENA_BLOCK;
+				run = 0;
+			} else {
+				available += HID_ARENA_BLOCK;
+				run += HID_ARENA_BLOCK;
+				if (run > largest) largest = run;
+			}
+		}
+	}
+	__enable_irq();
+}
+
+static const usb_match_t hid_match[] = {
+	{USB_MATCH_CLASS, 3, 0, 0, 0, 0}, // any HID interface
+	{0, 0, 0, 0, 0, 0}
+};
+
 void USBHIDParser::init()
 {
 	contribute_Pipes(mypipes, sizeof(mypipes)/sizeof(Pipe_t));
 	contribute_Transfers(mytransfers, sizeof(mytransfers)/sizeof(Transfer_t));
 	contribute_String_Buffers(mystring_bufs, sizeof(mystring_bufs)/sizeof(strbuf_t));
+	match_list = hid_match;
 	driver_ready_for_device(this);
 }
 
@@ -83,7 +221,6 @@ bool USBHIDParser::claim(Device_t *dev, int type, const uint8_t *descriptors, ui
 		i++;
 		if (i >= descriptors[14]) return false;
 	}
-	if (descsize > sizeof(descriptor)) return false; // can't fit the report descriptor
 
 	// endpoint descriptor(s)
 	uint32_t offset = 9 + hidlen;
@@ -101,6 +238,7 @@ bool USBHIDParser::claim(Device_t *dev, int type, const uint8_t *descriptors, ui
 		println("   interval = ", interval);
 		if ((endpoint & 0x0F) == 0) return false;
 		if ((endpoint & 0xF0) != 0x80) return false; // must be IN direction
+		if (!alloc_buffers(size)) return false;
 		in_pipe = new_Pipe(dev, 3, endpoint & 0x0F, 1, size, interval);
 		out_pipe = NULL;
 		in_size = size;
@@ -128,12 +266,14 @@ bool USBHIDParser::claim(Device_t *dev, int type, const uint8_t *descriptors, ui
 		if ((endpoint2 & 0x0F) == 0) return false;
 		if (((endpoint1 & 0xF0) == 0x80) && ((endpoint2 & 0xF0) == 0)) {
 			// first endpoint is IN, second endpoint is OUT
+			if (!alloc_buffers(size1)) return false;
 			in_pipe = new_Pipe(dev, 3, endpoint1 & 0x0F, 1, size1, interval1);
 			out_pipe = new_Pipe(dev, 3, endpoint2, 0, size2, interval2);
 			in_size = size1;
 			out_size = size2;
 		} else if (((endpoint1 & 0xF0) == 0) && ((endpoint2 & 0xF0) == 0x80)) {
 			// first endpoint is OUT, second endpoint is IN
+			if (!alloc_buffers(size2)) return false;
 			in_pipe = new_Pipe(dev, 3, endpoint2 & 0x0F, 1, size2, interval2);
 			out_pipe = new_Pipe(dev, 3, endpoint1, 0, size1, interval1);
 			in_size = size2;
@@ -148,6 +288,7 @@ bool USBHIDParser::claim(Device_t *dev, int type, const uint8_t *descriptors, ui
 		//topusage_list[i] = 0;
 		topusage_drivers[i] = NULL;
 	}
+	fields_compiled = false;
 	// request the HID report descriptor
 	bInterfaceNumber = descriptors[2];	// save away the interface number; 
 	mk_setup(setup, 0x81, 6, 0x2200, descriptors[2], descsize); // get report desc
@@ -159,6 +300,14 @@ void USBHIDParser::control(const Transfer_t *transfer)
 {
 	println("control callback (hid)");
 	print_hexbytes(transfer->buffer, transfer->length);
+	if (transfer->buffer == feature_report && transfer->setup.wRequestAndType == 0x01A1) {
+		// Feature report requested by requestFeature()
+		if (feature_driver) {
+			feature_driver->hid_feature_report(feature_report_id,
+				feature_report, transfer->length);
+		}
+		return;
+	}
 	if (topusage_drivers[0]) {
 		if (topusage_drivers[0]->hid_process_control(transfer)) {
 			return; // the called function can tell us they processed it.
@@ -171,11 +320,16 @@ void USBHIDParser::control(const Transfer_t *transfer)
 	println("  mesg = ", mesg, HEX);
 	if (mesg == 0x22000681 && transfer->length == descsize) { // HID report descriptor
 		println("  got report descriptor");
+		if (capture_) {
+			(*capture_)(this, CAPTURE_DESCRIPTOR, descriptor, descsize, micros(), 0);
+		}
 		parse();
-		queue_Data_Transfer(in_pipe, report, in_size, this);
-		queue_Data_Transfer(in_pipe, report2, in_size, this);
-		if (device->idVendor == 0x054C && 
-				((device->idProduct == 0x0268) || (device->idProduct == 0x042F)/* || (device->idProduct == 0x03D5)*/)) {
+		compile_fields();
+		for (uint32_t i=0; i < IN_REPORT_COUNT; i++) {
+			queue_Data_Transfer(in_pipe, reports[i], in_size, this);
+		}
+		const usb_quirk_t *q = find_quirk(device->idVendor, device->idProduct, QUIRK_DRIVER_HID);
+		if (q && (q->flags & QUIRK_PS3_FEATURE_F4)) {
 			println("send special PS3 feature command");
 			mk_setup(setup, 0x21, 9, 0x03F4, 0, 4); // ps3 tell to send report 1?
 			static uint8_t ps3_feature_F4_report[] = {0x42, 0x0c, 0x00, 0x00};
@@ -210,6 +364,49 @@ void USBHIDParser::disconnect()
 			topusage_drivers[i] = NULL;
 		}
 	}
+	free_buffers();
+}
+
+// The report descriptor and report buffers, sized for this device
+bool USBHIDParser::alloc_buffers(uint32_t insize)
+{
+	descriptor = (uint8_t *)arena_alloc(descsize);
+	in_size = insize;
+	bool ok = (descriptor != nullptr);
+	for (uint32_t i=0; i < IN_REPORT_COUNT; i++) {
+		reports[i] = (uint8_t *)arena_alloc(insize);
+		if (!reports[i]) ok = false;
+	}
+	if (ok) return true;
+	println("HID arena full, can't claim");
+	free_buffers();
+	return false;
+}
+
+// Return everything this device used to the arena
+void USBHIDParser::free_buffers()
+{
+	fields_compiled = false;
+	arena_free(descriptor, descsize);
+	for (uint32_t i=0; i < IN_REPORT_COUNT; i++) {
+		arena_free(reports[i], in_size);
+		reports[i] = nullptr;
+	}
+	arena_free(layout, layout_size);
+	arena_free(prior_report, PRIOR_REPORT_COUNT * in_size);
+	arena_free(output_report, output_report_size);
+	arena_free(feature_report, feature_report_size);
+	descriptor = layout = prior_report = nullptr;
+	output_report = feature_report = nullptr;
+	output_report_size = feature_report_size = 0;
+	fields = report_fields = nullptr;
+	field_usages = nullptr;
+	if (tx_from_arena) {
+		arena_free(tx1, out_size);
+		arena_free(tx2, out_size);
+		tx1 = tx2 = nullptr;
+		tx_from_arena = false;
+	}
 }
 
 // Called when the HID device sends a report
@@ -229,28 +426,77 @@ void USBHIDParser::in_data(const Transfer_t *transfer)
 	print_hexbytes(transfer->buffer, transfer->length);
 	*/
 	const uint8_t *buf = (const uint8_t *)transfer->buffer;
-	uint32_t len = transfer->length;
+	uint32_t us = micros();
+	uint32_t cycles = process_report(transfer);
+	if (capture_) {
+		(*capture_)(this, CAPTURE_REPORT, buf, transfer->length, us, cycles);
+	}
+	// the other buffers stayed queued while this one was processed
+	queue_Data_Transfer(in_pipe, (void *)buf, in_size, this);
+}
+
+static inline uint32_t report_clock()
+{
+#ifdef ARM_DWT_CYCCNT
+	return ARM_DWT_CYCCNT;
+#else
+	return micros();
+#endif
+}
 
+// Parse one input report, giving the cycles used by the parser and drivers
+uint32_t USBHIDParser::process_report(const Transfer_t *transfer)
+{
+	const uint8_t *buf = (const uint8_t *)transfer->buffer;
+	uint32_t len = transfer->length;
+	uint32_t start = report_clock();
 	// See if the first top report wishes to bypass the
 	// parse...
 	if (!(topusage_drivers[0] && topusage_drivers[0]->hid_process_in_data(transfer))) {
 
 		if (use_report_id == false) {
-			parse(0x0100, buf, len);
+			if (fields_compiled) parse_fields(0, buf, len);
+			else parse(0x0100, buf, len);
 		} else {
 			if (len > 1) {
-				parse(0x0100 | buf[0], buf + 1, len - 1);
+				if (fields_compiled) parse_fields(buf[0], buf + 1, len - 1);
+				else parse(0x0100 | buf[0], buf + 1, len - 1);
 			}
 		}
 	}
-	if (buf == report2) queue_Data_Transfer(in_pipe, report2, in_size, this);
-	else queue_Data_Transfer(in_pipe, report, in_size, this);
+	uint32_t cycles = report_clock() - start;
+	if (cycles > max_report_cycles) max_report_cycles = cycles;
+	return cycles;
 }
 
+void USBHIDParser::attachCapture(capture_function_t f)
+{
+#ifdef ARM_DWT_CYCCNT
+	ARM_DEMCR |= ARM_DEMCR_TRCENA;
+	ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+	capture_ = f;
+}
+
+uint32_t USBHIDParser::replayReport(const uint8_t *data, uint32_t len)
+{
+	if (!device || !data || len == 0) return 0;
+	if (len > in_size) len = in_size;
+	Transfer_t transfer __attribute__ ((aligned(32)));
+	memset(&transfer, 0, sizeof(transfer));
+	transfer.buffer = (void *)data;
+	transfer.length = len;
+	transfer.pipe = in_pipe;
+	transfer.driver = this;
+	// the drivers expect to run only from the USB interrupt
+	mask_interrupts(true);
+	uint32_t cycles = process_report(&transfer);
+	mask_interrupts(false);
+	return cycles;
+}
 
 void USBHIDParser::out_data(const Transfer_t *transfer)
 {
-	Serial.printf(">>>USBHIDParser::out_data\n");
 	println("USBHIDParser:out_data called (instance)");
 	// A packet completed. lets mark it as done and call back
 	// to top reports handler.  We unmark our checkmark to
@@ -273,11 +519,16 @@ void USBHIDParser::timer_event(USBDriverTimer *whichTimer)
 bool USBHIDParser::sendPacket(const uint8_t *buffer, int cb) {
 	if (!out_size || !out_pipe) return false;	
 	if (!tx1) {
-		// Was not init before, for now lets put it at end of descriptor
-		// TODO: should verify that either don't exceed overlap descsize
-		//       Or that we have taken over this device
-		tx1 = &descriptor[sizeof(descriptor) - out_size];
-		tx2 = tx1 - out_size;
+		// Was not init before, get two buffers from the arena.  One
+		// is enough if that's all there is room for.
+		tx1 = (uint8_t *)arena_alloc(out_size);
+		tx2 = (uint8_t *)arena_alloc(out_size);
+		if (!tx1) {
+			arena_free(tx2, out_size);
+			tx2 = nullptr;
+			return false;
+		}
+		tx_from_arena = true;
 	}
 	if ((txstate & 3) == 3) return false; 	// both transmit buffers are full
 	if (cb == -1)
@@ -300,8 +551,20 @@ bool USBHIDParser::sendPacket(const uint8_t *buffer, int cb) {
 	return true;
 }
 
+bool USBHIDParser::sendPacketInPlace(const uint8_t *buffer, int cb)
+{
+	if (!out_size || !out_pipe) return false;
+	if (cb == -1) cb = out_size;
+	return queue_Data_Transfer(out_pipe, (void *)buffer, cb, this);
+}
+
 void USBHIDParser::setTXBuffers(uint8_t *buffer1, uint8_t *buffer2, uint8_t cb)
 {
+	if (tx_from_arena) {
+		arena_free(tx1, out_size);
+		arena_free(tx2, out_size);
+		tx_from_arena = false;
+	}
 	tx1 = buffer1;
 	tx2 = buffer2;
 }
@@ -330,12 +593,14 @@ void USBHIDParser::parse()
 	uint16_t usage = 0;
 	uint8_t collection_level = 0;
 	uint8_t topusage_count = 0;
+	uint16_t usage_page_stack[HID_PUSH_DEPTH];
+	uint8_t stack_depth = 0;
 
 	use_report_id = false;
 	while (p < end) {
 		uint8_t tag = *p;
-		if (tag == 0xFE) { // Long Item
-			p += *p + 3;
+		if (tag == 0xFE) { // Long Item, no long item tags are defined
+			p += p[1] + 3;
 			continue;
 		}
 		uint32_t val;
@@ -362,16 +627,30 @@ void USBHIDParser::parse()
 		  case 0x04: // Usage Page (global)
 			usage_page = val;
 			break;
+		  case 0xA4: // Push (global)
+			if (stack_depth < HID_PUSH_DEPTH) {
+				usage_page_stack[stack_depth++] = usage_page;
+			}
+			break;
+		  case 0xB4: // Pop (global)
+			if (stack_depth > 0) {
+				usage_page = usage_page_stack[--stack_depth];
+			}
+			break;
 		  case 0x08: // Usage (local)
 			usage = val;
 			break;
 		  case 0xA0: // Collection
-			if (collection_level == 0 && topusage_count < TOPUSAGE_LIST_LEN) {
+			if (collection_level == 0) {
 				uint32_t topusage = ((uint32_t)usage_page << 16) | usage;
-				println("Found top level collection ", topusage, HEX);
-				//topusage_list[topusage_count] = topusage;
-				topusage_drivers[topusage_count] = find_driver(topusage);
-				topusage_count++;
+				if (topusage_count < TOPUSAGE_LIST_LEN) {
+					println("Found top level collection ", topusage, HEX);
+					//topusage_list[topusage_count] = topusage;
+					topusage_drivers[topusage_count] = find_driver(topusage);
+					topusage_count++;
+				} else {
+					println("Too many top level collections, ignoring ", topusage, HEX);
+				}
 			}
 			collection_level++;
 			usage = 0;
@@ -394,6 +673,54 @@ void USBHIDParser::parse()
 	}
 }
 
+// Give a driver a buffer to queue its input events
+void USBHIDInput::attachEventQueue(hidevent_t *buffer, uint16_t size)
+{
+	__disable_irq();
+	event_buffer = NULL;
+	event_head = 0;
+	event_tail = 0;
+	event_dropped = 0;
+	event_size = size;
+	if (buffer && size > 1) event_buffer = buffer;
+	__enable_irq();
+}
+
+// Called from the USB interrupt, the only writer of event_head
+void USBHIDInput::queue_event(uint32_t usage, int32_t value, uint32_t us)
+{
+	uint32_t head = event_head + 1;
+	if (head >= event_size) head = 0;
+	if (head == event_tail) {
+		event_dropped++; // full, keep the older events
+		return;
+	}
+	hidevent_t *e = event_buffer + head;
+	e->micros = us;
+	e->usage = usage;
+	e->value = value;
+	event_head = head;
+}
+
+uint16_t USBHIDInput::eventsAvailable()
+{
+	uint32_t head = event_head;
+	uint32_t tail = event_tail;
+	if (head >= tail) return head - tail;
+	return event_size + head - tail;
+}
+
+// Called by the sketch, the only writer of event_tail
+bool USBHIDInput::readEvent(hidevent_t &event)
+{
+	uint32_t tail = event_tail;
+	if (tail == event_head) return false;
+	if (++tail >= event_size) tail = 0;
+	event = event_buffer[tail];
+	event_tail = tail;
+	return true;
+}
+
 // This is a list of all the drivers inherited from the USBHIDInput class.
 // Unlike the list of USBDriver (managed in enumeration.cpp), drivers stay
 // on this list even when they have claimed a top level collection.
@@ -431,35 +758,54 @@ USBHIDInput * USBHIDParser::find_driver(uint32_t topusage)
 	return NULL;
 }
 
-// Extract 1 to 32 bits from the data array, starting at bitindex.
-static uint32_t bitfield(const uint8_t *data, uint32_t bitindex, uint32_t numbits)
+// Little endian 32 bit load, from any alignment.  Cortex-M4 & M7 do
+// unaligned LDR, so the compiler turns this into a single load.
+static inline uint32_t load32(const uint8_t *data)
 {
-	uint32_t output = 0;
-	uint32_t bitcount = 0;
-	data += (bitindex >> 3);
+	uint32_t n;
+	memcpy(&n, data, 4);
+	return n;
+}
+
+// Extract 1 to 32 bits from the data array of len bytes, starting at
+// bitindex.  With 8 bytes of data from the field's first byte, that is
+// one unaligned load, shift and mask.  Near the end of the data, only
+// the bytes which hold the field are read.
+static uint32_t bitfield(const uint8_t *data, uint32_t len, uint32_t bitindex, uint32_t numbits)
+{
+	uint32_t byte = bitindex >> 3;
 	uint32_t offset = bitindex & 7;
-	if (offset) {
-		output = (*data++) >> offset;
-		bitcount = 8 - offset;
+	if (numbits == 0) return 0;
+	if (numbits > 32) numbits = 32;
+	uint32_t mask = 0xFFFFFFFF >> (32 - numbits);
+	data += byte;
+	uint64_t n;
+	if (byte + 8 <= len) {
+		memcpy(&n, data, 8);
+		return (uint32_t)(n >> offset) & mask;
 	}
-	while (bitcount < numbits) {
-		output |= (uint32_t)(*data++) << bitcount;
-		bitcount += 8;
+	if (offset == 0) {
+		// byte aligned 8 and 16 bit fields are the most common
+		if (numbits == 8) return data[0];
+		if (numbits == 16) return data[0] | (data[1] << 8);
 	}
-	if (bitcount > numbits && numbits < 32) {
-		output &= ((1 << numbits) - 1);
+	switch ((offset + numbits + 7) >> 3) {
+	  case 5: n = load32(data) | ((uint64_t)data[4] << 32); break;
+	  case 4: n = load32(data); break;
+	  case 3: n = data[0] | (data[1] << 8) | (data[2] << 16); break;
+	  case 2: n = data[0] | (data[1] << 8); break;
+	  default: n = data[0];
 	}
-	return output;
+	return (uint32_t)(n >> offset) & mask;
 }
 
 // convert a number with the specified number of bits from unsigned to signed,
 // so the result is a proper 32 bit signed integer.
 static int32_t signext(uint32_t num, uint32_t bitcount)
 {
-	if (bitcount < 32 && bitcount > 0 && (num & (1 << (bitcount-1)))) {
-		num |= ~((1 << bitcount) - 1);
-	}
-	return (int32_t)num;
+	if (bitcount == 0 || bitcount >= 32) return (int32_t)num;
+	uint32_t shift = 32 - bitcount;
+	return (int32_t)(num << shift) >> shift;
 }
 
 // convert a tag's value to a signed integer.
@@ -471,6 +817,17 @@ static int32_t signedval(uint32_t num, uint8_t tag)
 	return (int32_t)num;
 }
 
+// Logical Maximum 0xFF or 0xFFFF written without a zero byte above it
+// reads back negative.  With a positive minimum it was meant unsigned,
+// so use the largest value the field can hold.
+static int32_t field_logical_max(int32_t logical_min, int32_t logical_max, uint32_t size)
+{
+	if (logical_max < logical_min && logical_min >= 0 && size > 0 && size < 32) {
+		return (1 << size) - 1;
+	}
+	return logical_max;
+}
+
 // parse the report descriptor and use it to feed the fields of the report
 // to the drivers which have claimed its top level collections
 void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint32_t len)
@@ -491,10 +848,13 @@ void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint3
 	int32_t logical_min = 0;
 	int32_t logical_max = 0;
 	uint32_t bitindex = 0;
+	hid_globals_t stack[HID_PUSH_DEPTH];
+	uint8_t stack_depth = 0;
+	uint32_t now = micros();
 
 	while (p < end) {
 		uint8_t tag = *p;
-		if (tag == 0xFE) { // Long Item (unsupported)
+		if (tag == 0xFE) { // Long Item, no long item tags are defined
 			p += p[1] + 3;
 			continue;
 		}
@@ -584,13 +944,14 @@ void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint3
 				// skip past constant fields or when no driver is listening
 				bitindex += report_count * report_size;
 			} else {
+				int32_t lgmax = field_logical_max(logical_min, logical_max, report_size);
 				println("begin, usage=", topusage, HEX);
 				println("       type= ", val, HEX);
 				println("       min=  ", logical_min);
-				println("       max=  ", logical_max);
+				println("       max=  ", lgmax);
 				println("       reportcount=", report_count);
 				println("       usage count=", usage_count);
-				driver->hid_input_begin(topusage, val, logical_min, logical_max);
+				driver->hid_input_begin(topusage, val, logical_min, lgmax);
 				println("Input, total bits=", report_count * report_size);
 				if ((val & 2)) {
 					// ordinary variable format
@@ -616,6 +977,7 @@ void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint3
 					//USBHDBGSerial.printf("TU:%x US:%x %x %d %d: C:%d, %d, MM:%d, %x %x\n", topusage, usage_page, val, logical_min, logical_max, 
 					//			report_count, usage_count, uminmax, usage[0], usage[1]);
 					for (uint32_t i=0; i < report_count; i++) {
+						if (bitindex + report_size > len * 8) break; // short report
 						uint32_t u;
 						if (uminmax) {
 							u = uindex;
@@ -630,31 +992,32 @@ void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint3
 						u |= (uint32_t)usage_page << 16;
 						print("  usage = ", u, HEX);
 
-						uint32_t n = bitfield(data, bitindex, report_size);
+						uint32_t n = bitfield(data, len, bitindex, report_size);
 						if (logical_min >= 0) {
 							println("  data = ", n);
-							driver->hid_input_data(u, n);
+							driver->input_data(u, n, now);
 						} else {
 							int32_t sn = signext(n, report_size);
 							println("  sdata = ", sn);
-							driver->hid_input_data(u, sn);
+							driver->input_data(u, sn, now);
 						}
 						bitindex += report_size;
 					}
 				} else {
 					// array format, each item is a usage number
 					for (uint32_t i=0; i < report_count; i++) {
-						uint32_t u = bitfield(data, bitindex, report_size);
+						if (bitindex + report_size > len * 8) break; // short report
+						uint32_t u = bitfield(data, len, bitindex, report_size);
 						int n = u;
-						if (n >= logical_min && n <= logical_max) {
+						if (n >= logical_min && n <= lgmax) {
 							u |= (uint32_t)usage_page << 16;
 							print("  usage = ", u, HEX);
 							println("  data = 1");
-							driver->hid_input_data(u, 1);
+							driver->input_data(u, 1, now);
 						} else {
 							print ("  usage =", u, HEX);
 							print(" out of range: ", logical_min, HEX);
-							println(" ", logical_max, HEX);
+							println(" ", lgmax, HEX);
 						}
 						bitindex += report_size;
 					}
@@ -677,8 +1040,28 @@ void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint3
 		  case 0x64: // Unit (global)
 			break; // Ignore these commonly used tags.  Hopefully not needed?
 
-		  case 0xA4: // Push (yikes! Hope nobody really uses this?!)
-		  case 0xB4: // Pop (yikes! Hope nobody really uses this?!)
+		  case 0xA4: // Push (global)
+			if (stack_depth < HID_PUSH_DEPTH) {
+				hid_globals_t *g = &stack[stack_depth++];
+				g->logical_min = logical_min;
+				g->logical_max = logical_max;
+				g->usage_page = usage_page;
+				g->report_size = report_size;
+				g->report_count = report_count;
+				g->report_id = report_id;
+			}
+			break;
+		  case 0xB4: // Pop (global)
+			if (stack_depth > 0) {
+				hid_globals_t *g = &stack[--stack_depth];
+				logical_min = g->logical_min;
+				logical_max = g->logical_max;
+				usage_page = g->usage_page;
+				report_size = g->report_size;
+				report_count = g->report_count;
+				report_id = g->report_id;
+			}
+			break;
 		  case 0x38: // Designator Index (local)
 		  case 0x48: // Designator Minimum (local)
 		  case 0x58: // Designator Maximum (local)
@@ -698,3 +1081,625 @@ void USBHIDParser::parse(uint16_t type_and_report_id, const uint8_t *data, uint3
 	}
 }
 
+// Compile the report descriptor into a list of the Input fields which
+// drivers have claimed, with each field's bit position already known.
+// The descriptor is walked exactly as parse() does, so parse_fields()
+// gives drivers the same callbacks.  If the list doesn't fit, reports
+// are decoded by parse() from the descriptor.
+void USBHIDParser::compile_fields()
+{
+	const uint8_t *p = descriptor;
+	const uint8_t *end = p + descsize;
+	USBHIDInput *driver = NULL;
+	uint8_t topusage_index = 0;
+	uint8_t collection_level = 0;
+	uint16_t usage[USAGE_LIST_LEN] = {0, 0};
+	uint8_t usage_count = 0;
+	uint8_t report_id = 0;
+	uint16_t report_size = 0;
+	uint16_t report_count = 0;
+	uint16_t usage_page = 0;
+	int32_t logical_min = 0;
+	int32_t logical_max = 0;
+	int32_t physical_max = 0;
+	uint32_t usages_used = 0;
+	hid_globals_t stack[HID_PUSH_DEPTH];
+	uint8_t stack_depth = 0;
+	// bit position and last usage within each Input, Output and
+	// Feature report, most descriptors use only a few report IDs
+	uint16_t bitindex_id[12];
+	uint16_t bitindex[12];
+	uint32_t last_usage[12];
+	uint8_t bitindex_count = 0;
+
+	fields_compiled = false;
+	field_count = 0;
+	report_field_count = 0;
+	resolution_multiplier = 0;
+	// only one compile runs at a time, from the USB interrupt
+	fields = scratch_fields;
+	report_fields = scratch_report_fields;
+	field_usages = scratch_field_usages;
+	output_report_id = 0xFF;
+	feature_report_id = 0xFF;
+	feature_driver = NULL;
+	while (p < end) {
+		uint8_t tag = *p;
+		if (tag == 0xFE) { // Long Item, no long item tags are defined
+			p += p[1] + 3;
+			continue;
+		}
+		uint32_t val;
+		switch (tag & 0x03) { // Short Item data
+		  case 0: val = 0;
+			p++;
+			break;
+		  case 1: val = p[1];
+			p += 2;
+			break;
+		  case 2: val = p[1] | (p[2] << 8);
+			p += 3;
+			break;
+		  case 3: val = p[1] | (p[2] << 8) | (p[3] << 16) | (p[4] << 24);
+			p += 5;
+			break;
+		}
+		if (p > end) break;
+		bool reset_local = false;
+		switch (tag & 0xFC) {
+		  case 0x04: // Usage Page (global)
+			usage_page = val;
+			break;
+		  case 0x14: // Logical Minimum (global)
+			logical_min = signedval(val, tag);
+			break;
+		  case 0x24: // Logical Maximum (global)
+			logical_max = signedval(val, tag);
+			break;
+		  case 0x44: // Physical Maximum (global)
+			physical_max = signedval(val, tag);
+			break;
+		  case 0x74: // Report Size (global)
+			report_size = val;
+			break;
+		  case 0x94: // Report Count (global)
+			report_count = val;
+			break;
+		  case 0x84: // Report ID (global)
+			report_id = val;
+			break;
+		  case 0xA4: // Push (global)
+			if (stack_depth < HID_PUSH_DEPTH) {
+				hid_globals_t *g = &stack[stack_depth++];
+				g->logical_min = logical_min;
+				g->logical_max = logical_max;
+				g->usage_page = usage_page;
+				g->report_size = report_size;
+				g->report_count = report_count;
+				g->report_id = report_id;
+			}
+			break;
+		  case 0xB4: // Pop (global)
+			if (stack_depth > 0) {
+				hid_globals_t *g = &stack[--stack_depth];
+				logical_min = g->logical_min;
+				logical_max = g->logical_max;
+				usage_page = g->usage_page;
+				report_size = g->report_size;
+				report_count = g->report_count;
+				report_id = g->report_id;
+			}
+			break;
+		  case 0x08: // Usage (local)
+			if (usage_count < USAGE_LIST_LEN) {
+				if (val > 0x1f) {
+					usage[usage_count++] = val;
+				}
+			}
+			break;
+		  case 0x18: // Usage Minimum (local)
+			usage[0] = val;
+			usage_count = 255;
+			break;
+		  case 0x28: // Usage Maximum (local)
+			usage[1] = val;
+			usage_count = 255;
+			break;
+		  case 0xA0: // Collection
+			if (collection_level == 0) {
+				driver = NULL;
+				if (topusage_index < TOPUSAGE_LIST_LEN) {
+					topusage_list[topusage_index] = ((uint32_t)usage_page << 16) | usage[0];
+					driver = topusage_drivers[topusage_index++];
+				}
+			}
+			collection_level++;
+			reset_local = true;
+			break;
+		  case 0xC0: // End Collection
+			if (collection_level > 0) {
+				collection_level--;
+				if (collection_level == 0 && driver != NULL) {
+					if (field_count >= FIELD_LIST_LEN) return;
+					hidfield_t *f = &fields[field_count++];
+					f->op = HIDFIELD_END_COLLECTION;
+					f->topusage_index = topusage_index - 1;
+					driver = NULL;
+				}
+			}
+			reset_local = true;
+			break;
+		  case 0x80: { // Input
+			uint8_t id = use_report_id ? report_id : 0;
+			uint32_t n;
+			for (n=0; n < bitindex_count; n++) {
+				if (bitindex_id[n] == id) break;
+			}
+			if (n >= bitindex_count) {
+				if (bitindex_count >= sizeof(bitindex_id)/sizeof(bitindex_id[0])) return;
+				bitindex_id[n] = id;
+				bitindex[n] = 0;
+				last_usage[n] = 0;
+				bitindex_count++;
+			}
+			if (!(val & 1) && driver != NULL) {
+				if (field_count >= FIELD_LIST_LEN || report_size > 32) return;
+				hidfield_t *f = &fields[field_count++];
+				f->bitindex = bitindex[n];
+				f->count = report_count;
+				f->type = val;
+				f->usage_page = usage_page;
+				f->logical_min = logical_min;
+				f->logical_max = field_logical_max(logical_min, logical_max, report_size);
+				f->size = report_size;
+				f->report_id = id;
+				f->topusage_index = topusage_index - 1;
+				if (!(val & 2)) {
+					f->op = HIDFIELD_ARRAY;
+				} else if (usage_count > USAGE_LIST_LEN) {
+					f->op = HIDFIELD_USAGE_RANGE;
+					f->usage_min = usage[0];
+					f->usage_max = usage[1];
+				} else if ((report_count > 1) && (usage_count <= 1)) {
+					f->op = HIDFIELD_USAGE_RANGE;
+					if (usage_count == 1) {
+						f->usage_min = usage[0];
+					} else {
+						// same guess as parse(), from the last usage
+						// of the prior field in this report
+						uint32_t u = (last_usage[n] & 0xff00) + 0x100;
+						if (u > 0xffff) return;
+						f->usage_min = u;
+					}
+					f->usage_max = 0xffff;
+				} else {
+					// parse() uses the list in order, repeating its
+					// last entry, so store only what it can reach
+					uint32_t num = (report_count < USAGE_LIST_LEN) ? report_count : USAGE_LIST_LEN;
+					if (usages_used + num > FIELD_USAGE_LEN) return;
+					f->op = HIDFIELD_USAGE_LIST;
+					f->usage_min = usages_used;
+					f->usage_max = num;
+					for (uint32_t i=0; i < num; i++) {
+						field_usages[usages_used++] = usage[i];
+					}
+				}
+				// remember the last usage this field gives
+				if (f->op == HIDFIELD_USAGE_LIST && report_count > 0) {
+					last_usage[n] = field_usages[usages_used - 1];
+				} else if (f->op == HIDFIELD_USAGE_RANGE && report_count > 0) {
+					uint32_t u = f->usage_min + report_count - 1;
+					if (f->usage_min >= f->usage_max) u = f->usage_min;
+					else if (u > f->usage_max) u = f->usage_max;
+					last_usage[n] = u;
+				}
+			}
+			bitindex[n] += report_count * report_size;
+			reset_local = true;
+			} break;
+		  case 0x90: // Output
+		  case 0xB0: { // Feature
+			// all items are kept, even constant, so report lengths are known
+			uint32_t kind = ((tag & 0xFC) == 0x90) ? HIDFIELD_OUTPUT : HIDFIELD_FEATURE;
+			uint16_t id = (use_report_id ? report_id : 0) | (kind << 4);
+			uint32_t n;
+			for (n=0; n < bitindex_count; n++) {
+				if (bitindex_id[n] == id) break;
+			}
+			if (n >= bitindex_count) {
+				if (bitindex_count >= sizeof(bitindex_id)/sizeof(bitindex_id[0])) return;
+				bitindex_id[n] = id;
+				bitindex[n] = 0;
+				last_usage[n] = 0;
+				bitindex_count++;
+			}
+			if (report_field_count < REPORT_FIELD_LIST_LEN && report_size <= 32) {
+				hidfield_t *f = &report_fields[report_field_count++];
+				f->bitindex = bitindex[n];
+				f->count = report_count;
+				f->type = val;
+				f->usage_page = usage_page;
+				f->logical_min = logical_min;
+				f->logical_max = logical_max;
+				f->size = report_size;
+				f->report_id = use_report_id ? report_id : 0;
+				f->topusage_index = topusage_index - 1;
+				f->op = kind | HIDFIELD_USAGE_RANGE;
+				f->usage_min = 0;
+				f->usage_max = 0;
+				if (usage_count > USAGE_LIST_LEN) {
+					f->usage_min = usage[0];
+					f->usage_max = usage[1];
+				} else if (usage_count == 1) {
+					f->usage_min = usage[0];
+					f->usage_max = (report_count > 1) ? 0xffff : usage[0];
+				} else if (usage_count > 1) {
+					uint32_t num = usage_count;
+					if (usages_used + num <= FIELD_USAGE_LEN) {
+						f->op = kind | HIDFIELD_USAGE_LIST;
+						f->usage_min = usages_used;
+						f->usage_max = num;
+						for (uint32_t i=0; i < num; i++) {
+							field_usages[usages_used++] = usage[i];
+						}
+					}
+				}
+				if (kind == HIDFIELD_FEATURE && usage_count == 1 && usage_page == 1
+				  && usage[0] == 0x48 && logical_max > logical_min) {
+					// Resolution Multiplier, at its maximum the wheel
+					// gives this many counts per detent
+					int32_t m = (physical_max > 0) ? physical_max : logical_max;
+					if (m > 255) m = 255;
+					if (m > resolution_multiplier) resolution_multiplier = m;
+				}
+			} else {
+				println("HID Output/Feature layout too large");
+				report_field_count = 0xFF;
+			}
+			bitindex[n] += report_count * report_size;
+			reset_local = true;
+			} break;
+		}
+		if (reset_local) {
+			usage_count = 0;
+			usage[0] = 0;
+			usage[1] = 0;
+		}
+	}
+	println("HID fields compiled: ", field_count);
+	// keep only what this descriptor needs, in the arena
+	uint32_t nreport = (report_field_count <= REPORT_FIELD_LIST_LEN) ? report_field_count : 0;
+	uint32_t size = (field_count + nreport) * sizeof(hidfield_t) + usages_used * sizeof(uint16_t);
+	layout = (uint8_t *)arena_alloc(size);
+	if (!layout) {
+		println("HID arena full, reports will be parsed from the descriptor");
+		fields = report_fields = nullptr;
+		field_usages = nullptr;
+		return;
+	}
+	layout_size = size;
+	hidfield_t *f = (hidfield_t *)layout;
+	memcpy(f, scratch_fields, field_count * sizeof(hidfield_t));
+	fields = f;
+	f += field_count;
+	memcpy(f, scratch_report_fields, nreport * sizeof(hidfield_t));
+	report_fields = f;
+	f += nreport;
+	memcpy(f, scratch_field_usages, usages_used * sizeof(uint16_t));
+	field_usages = (uint16_t *)f;
+	fields_compiled = true;
+	// the descriptor is only needed to parse reports without the fields
+	arena_free(descriptor, descsize);
+	descriptor = nullptr;
+	memset(prior_report_len, 0, sizeof(prior_report_len));
+	prior_report_next = 0;
+	for (uint32_t i=0; i < TOPUSAGE_LIST_LEN; i++) {
+		if (topusage_drivers[i] && topusage_drivers[i]->hid_changes_only) {
+			prior_report = (uint8_t *)arena_alloc(PRIOR_REPORT_COUNT * in_size);
+			break;
+		}
+	}
+	// Output and Feature reports, as long as this device's longest
+	output_report_size = max_report_length(HIDFIELD_OUTPUT);
+	feature_report_size = max_report_length(HIDFIELD_FEATURE);
+	output_report = (uint8_t *)arena_alloc(output_report_size);
+	feature_report = (uint8_t *)arena_alloc(feature_report_size);
+	if (!output_report) output_report_size = 0;
+	if (!feature_report) feature_report_size = 0;
+}
+
+// Find the prior report with this ID and length, or claim the
+// oldest slot for it.  Sets *found if the slot holds a prior report.
+static uint8_t * find_prior_report(uint8_t *reports, uint32_t size, uint8_t *ids,
+	uint16_t *lens, uint8_t &next, uint32_t count, uint8_t report_id,
+	uint32_t len, bool *found)
+{
+	for (uint32_t i=0; i < count; i++) {
+		if (lens[i] == len && ids[i] == report_id) {
+			*found = true;
+			return reports + i * size;
+		}
+	}
+	uint32_t i = next;
+	if (++next >= count) next = 0;
+	ids[i] = report_id;
+	lens[i] = len;
+	*found = false;
+	return reports + i * size;
+}
+
+// Feed a report to the drivers using the compiled field list.  Drivers
+// with hid_changes_only get only the fields which differ from the prior
+// report with the same ID.
+void USBHIDParser::parse_fields(uint8_t report_id, const uint8_t *data, uint32_t len)
+{
+	const hidfield_t *f = fields;
+	const hidfield_t *end = fields + field_count;
+	uint8_t *prior = NULL;
+	bool identical = false;
+	uint32_t begun = 0; // bitmask of topusage_index given hid_input_begin
+	uint32_t now = micros();
+
+	for (uint32_t i=0; i < TOPUSAGE_LIST_LEN; i++) {
+		if (topusage_drivers[i] && topusage_drivers[i]->hid_changes_only
+		  && prior_report && len <= in_size) {
+			bool found;
+			prior = find_prior_report(prior_report, in_size, prior_report_id,
+				prior_report_len, prior_report_next, PRIOR_REPORT_COUNT,
+				report_id, len, &found);
+			if (found) {
+				identical = (memcmp(prior, data, len) == 0);
+			} else {
+				memcpy(prior, data, len);
+				prior = NULL; // nothing to compare, give everything
+			}
+			break;
+		}
+	}
+
+	for (; f < end; f++) {
+		USBHIDInput *driver = topusage_drivers[f->topusage_index];
+		bool delta = (prior != NULL) && driver->hid_changes_only;
+		if (f->op == HIDFIELD_END_COLLECTION) {
+			if (!delta || (begun & (1 << f->topusage_index))) {
+				driver->hid_input_end();
+			}
+			continue;
+		}
+		if (f->report_id != report_id) continue;
+		if (delta && identical) continue;
+		uint32_t bitindex = f->bitindex;
+		uint32_t size = f->size;
+		uint32_t upage = (uint32_t)f->usage_page << 16;
+		// a report shorter than the descriptor says gives only the
+		// items which it actually holds
+		uint32_t count = f->count;
+		if (size == 0 || bitindex + size > len * 8) continue;
+		if (count > (len * 8 - bitindex) / size) count = (len * 8 - bitindex) / size;
+		if (f->op == HIDFIELD_ARRAY) {
+			if (delta) {
+				uint32_t i;
+				for (i=0; i < count; i++) {
+					if (bitfield(data, len, bitindex + i * size, size)
+					  != bitfield(prior, len, bitindex + i * size, size)) break;
+				}
+				if (i >= count) continue; // no change
+			}
+			driver->hid_input_begin(topusage_list[f->topusage_index], f->type,
+				f->logical_min, f->logical_max);
+			begun |= (1 << f->topusage_index);
+			// array format, each item is a usage number
+			for (uint32_t i=0; i < count; i++) {
+				uint32_t u = bitfield(data, len, bitindex, size);
+				int n = u;
+				if (n >= f->logical_min && n <= f->logical_max) {
+					driver->input_data(u | upage, 1, now);
+				}
+				bitindex += size;
+			}
+			continue;
+		}
+		// ordinary variable format
+		bool need_begin = true;
+		uint32_t uindex = f->usage_min;
+		uint32_t uindex_max = f->usage_max;
+		const uint16_t *ulist = field_usages + f->usage_min;
+		bool sign = (f->logical_min < 0);
+		for (uint32_t i=0; i < count; i++) {
+			uint32_t u;
+			if (f->op == HIDFIELD_USAGE_LIST) {
+				u = ulist[(i < uindex_max) ? i : uindex_max - 1];
+			} else {
+				u = uindex;
+				if (uindex < uindex_max) uindex++;
+			}
+			uint32_t n = bitfield(data, len, bitindex, size);
+			if (delta && n == bitfield(prior, len, bitindex, size)) {
+				bitindex += size;
+				continue;
+			}
+			if (need_begin) {
+				driver->hid_input_begin(topusage_list[f->topusage_index], f->type,
+					f->logical_min, f->logical_max);
+				begun |= (1 << f->topusage_index);
+				need_begin = false;
+			}
+			if (sign) {
+				driver->input_data(u | upage, signext(n, size), now);
+			} else {
+				driver->input_data(u | upage, n, now);
+			}
+			bitindex += size;
+		}
+	}
+	if (prior && !identical) memcpy(prior, data, len);
+}
+
+// Store a value into a report, at any bit position and size up to 32
+static void setbitfield(uint8_t *data, uint32_t bitindex, uint32_t numbits, uint32_t value)
+{
+	data += (bitindex >> 3);
+	uint32_t offset = bitindex & 7;
+	while (numbits > 0) {
+		uint32_t n = 8 - offset;
+		if (n > numbits) n = numbits;
+		uint32_t mask = ((1 << n) - 1) << offset;
+		*data = (*data & ~mask) | ((value << offset) & mask);
+		data++;
+		value >>= n;
+		numbits -= n;
+		offset = 0;
+	}
+}
+
+// Find the Output or Feature field for a usage, and which item within
+// the field.  kind is HIDFIELD_OUTPUT or HIDFIELD_FEATURE.
+const hidfield_t * USBHIDParser::find_report_field(uint32_t kind, uint32_t usage, uint32_t *item)
+{
+	if (!fields_compiled || report_field_count > REPORT_FIELD_LIST_LEN) return NULL;
+	uint32_t page = usage >> 16;
+	usage &= 0xFFFF;
+	for (uint32_t i=0; i < report_field_count; i++) {
+		const hidfield_t *f = &report_fields[i];
+		if ((f->op & 0xF0) != kind || (f->type & 1) || f->usage_page != page) continue;
+		if ((f->op & 0x0F) == HIDFIELD_USAGE_LIST) {
+			for (uint32_t n=0; n < f->usage_max && n < f->count; n++) {
+				if (field_usages[f->usage_min + n] == usage) {
+					*item = n;
+					return f;
+				}
+			}
+		} else if (usage >= f->usage_min && usage <= f->usage_max
+		  && usage - f->usage_min < f->count) {
+			*item = usage - f->usage_min;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+// Number of bytes in an Output or Feature report, including the ID byte
+uint32_t USBHIDParser::report_length(uint32_t kind, uint32_t report_id)
+{
+	if (report_field_count > REPORT_FIELD_LIST_LEN) return 0;
+	uint32_t bits = 0;
+	for (uint32_t i=0; i < report_field_count; i++) {
+		const hidfield_t *f = &report_fields[i];
+		if ((f->op & 0xF0) != kind || f->report_id != report_id) continue;
+		uint32_t n = f->bitindex + f->count * f->size;
+		if (n > bits) bits = n;
+	}
+	if (bits == 0) return 0;
+	return ((bits + 7) >> 3) + (use_report_id ? 1 : 0);
+}
+
+// Longest Output or Feature report of any ID, including the ID byte
+uint32_t USBHIDParser::max_report_length(uint32_t kind)
+{
+	if (report_field_count > REPORT_FIELD_LIST_LEN) return 0;
+	uint32_t bits = 0;
+	for (uint32_t i=0; i < report_field_count; i++) {
+		const hidfield_t *f = &report_fields[i];
+		if ((f->op & 0xF0) != kind) continue;
+		uint32_t n = f->bitindex + f->count * f->size;
+		if (n > bits) bits = n;
+	}
+	if (bits == 0) return 0;
+	return ((bits + 7) >> 3) + (use_report_id ? 1 : 0);
+}
+
+bool USBHIDParser::set_report_field(uint32_t kind, uint8_t *buf, uint32_t bufsize,
+	uint8_t &report_id, uint32_t usage, int32_t value)
+{
+	uint32_t item;
+	const hidfield_t *f = find_report_field(kind, usage, &item);
+	if (!f) return false;
+	if (f->report_id != report_id) {
+		// begin a new report
+		if (report_length(kind, f->report_id) > bufsize) return false;
+		memset(buf, 0, bufsize);
+		report_id = f->report_id;
+		if (use_report_id) buf[0] = report_id;
+	}
+	uint32_t bitindex = f->bitindex + item * f->size + (use_report_id ? 8 : 0);
+	setbitfield(buf, bitindex, f->size, value);
+	return true;
+}
+
+bool USBHIDParser::setOutput(uint32_t usage, int32_t value)
+{
+	return set_report_field(HIDFIELD_OUTPUT, output_report, output_report_size,
+		output_report_id, usage, value);
+}
+
+bool USBHIDParser::sendOutput()
+{
+	if (!device || !fields_compiled || output_report_id == 0xFF) return false;
+	uint32_t len = report_length(HIDFIELD_OUTPUT, output_report_id);
+	mk_setup(output_setup, 0x21, 9, 0x0200 | output_report_id, bInterfaceNumber, len);
+	return queue_Control_Transfer(device, &output_setup, output_report, this);
+}
+
+bool USBHIDParser::setFeature(uint32_t usage, int32_t value)
+{
+	return set_report_field(HIDFIELD_FEATURE, feature_report, feature_report_size,
+		feature_report_id, usage, value);
+}
+
+bool USBHIDParser::sendFeature()
+{
+	if (!device || !fields_compiled || feature_report_id == 0xFF) return false;
+	uint32_t len = report_length(HIDFIELD_FEATURE, feature_report_id);
+	mk_setup(feature_setup, 0x21, 9, 0x0300 | feature_report_id, bInterfaceNumber, len);
+	return queue_Control_Transfer(device, &feature_setup, feature_report, this);
+}
+
+// Set every Resolution Multiplier to its maximum, so wheels report
+// fractions of a detent.  Returns the counts per detent, 1 if the device
+// has no multiplier or it could not be set.
+uint32_t USBHIDParser::enableResolutionMultiplier()
+{
+	if (!device || !fields_compiled || resolution_multiplier <= 1) return 1;
+	bool found = false;
+	for (uint32_t i=0; i < report_field_count; i++) {
+		const hidfield_t *f = &report_fields[i];
+		if ((f->op & 0xF0) != HIDFIELD_FEATURE || (f->type & 1)) continue;
+		if ((f->op & 0x0F) != HIDFIELD_USAGE_RANGE) continue;
+		if (f->usage_page != 1 || f->usage_min != 0x48) continue;
+		if (found && f->report_id != feature_report_id) continue;
+		if (!found) {
+			if (report_length(HIDFIELD_FEATURE, f->report_id) > feature_report_size) continue;
+			memset(feature_report, 0, feature_report_size);
+			feature_report_id = f->report_id;
+			if (use_report_id) feature_report[0] = f->report_id;
+			found = true;
+		}
+		uint32_t bitindex = f->bitindex + (use_report_id ? 8 : 0);
+		setbitfield(feature_report, bitindex, f->size, f->logical_max);
+	}
+	if (!found || !sendFeature()) return 1;
+	return resolution_multiplier;
+}
+
+bool USBHIDParser::requestFeature(uint8_t report_id, USBHIDInput *driver)
+{
+	if (!device || !fields_compiled) return false;
+	uint32_t len = report_length(HIDFIELD_FEATURE, report_id);
+	if (len == 0 || len > feature_report_size) return false;
+	memset(feature_report, 0, feature_report_size);
+	feature_report_id = report_id;
+	feature_driver = driver;
+	mk_setup(feature_setup, 0xA1, 1, 0x0300 | report_id, bInterfaceNumber, len);
+	return queue_Control_Transfer(device, &feature_setup, feature_report, this);
+}
+
+int32_t USBHIDParser::getFeature(uint32_t usage)
+{
+	uint32_t item;
+	const hidfield_t *f = find_report_field(HIDFIELD_FEATURE, usage, &item);
+	if (!f || f->report_id != feature_report_id) return 0;
+	uint32_t bitindex = f->bitindex + item * f->size + (use_report_id ? 8 : 0);
+	uint32_t n = bitfield(feature_report, feature_report_size, bitindex, f->size);
+	if (f->logical_min < 0) return signext(n, f->size);
+	return n;
+}
@@ -32,12 +32,18 @@ volatile bool USBHub::reset_busy = false;
 #define print   USBHost::print_
 #define println USBHost::println_
 
+static const usb_match_t hub_match[] = {
+	{USB_MATCH_DEVICE | USB_MATCH_CLASS | USB_MATCH_SUBCLASS, 9, 0, 0, 0, 0},
+	{0, 0, 0, 0, 0, 0}
+};
+
 void USBHub::init()
 {
 	contribute_Devices(mydevices, sizeof(mydevices)/sizeof(Device_t));
 	contribute_Pipes(mypipes, sizeof(mypipes)/sizeof(Pipe_t));
 	contribute_Transfers(mytransfers, sizeof(mytransfers)/sizeof(Transfer_t));
 	contribute_String_Buffers(mystring_bufs, sizeof(mystring_bufs)/sizeof(strbuf_t));
+	match_list = hub_match;
 	driver_ready_for_device(this);
 }
 
@@ -66,7 +72,7 @@ bool USBHub::claim(Device_t *dev, int type, const uint8_t *d, uint32_t len)
 		  d[9] == 7 && d[10] == 5 &&		// valid endpoint descriptor
 		  (d[11] & 0xF0) == 0x80 &&		// endpoint direction is IN
 		  d[12] == 3 &&				// endpoint type is interrupt
-		  d[13] == 1 && d[14] == 0) {		// max packet size is 1 byte
+		  (d[13] == 1 || d[13] == 2) && d[14] == 0) { // max packet size 1 or 2 bytes
 			println("found possible interface, altsetting=", d[3]);
 			if (interface_count == 0) {
 				interface_number = d[2];
@@ -97,130 +103,174 @@ bool USBHub::claim(Device_t *dev, int type, const uint8_t *d, uint32_t len)
 	numports = 0; // unknown until hub descriptor is read
 	changepipe = NULL;
 	changebits = 0;
-	sending_control_transfer = 0;
+	control_busy = 0;
+	change_micros = 0;
 	port_doing_reset = 0;
+	debounce_in_use = 0;
+	debounce_checking = 0;
+	debounce_polling = debounce_polling_user;
+	debounce_misses = 0;
 	memset(portstate, 0, sizeof(portstate));
 	memset(devicelist, 0, sizeof(devicelist));
 
-	mk_setup(setup, 0xA0, 6, 0x2900, 0, sizeof(hub_desc));
-	queue_Control_Transfer(dev, &setup, hub_desc, this);
+	mk_setup(setup[0], 0xA0, 6, 0x2900, 0, sizeof(hub_desc));
+	queue_Control_Transfer(dev, &setup[0], hub_desc, this);
+	control_busy = 1;
+	control_order[0] = 0;
+	control_queued = 1;
 
 	return true;
 }
 
+// Hub requests are queued on the control pipe, up to CONTROL_SLOTS at
+// once.  Each in-flight request needs its own setup_t (and status word
+// for GET_STATUS), because the EHCI reads them when the qTD executes.
+// The EHCI completes them in order, so a burst of port changes costs
+// one round trip per slot group, rather than one per request.
+setup_t * USBHub::can_send_control_now()
+{
+	for (uint32_t i=0; i < CONTROL_SLOTS; i++) {
+		if (!(control_busy & (1 << i))) {
+			control_busy |= (1 << i);
+			return &setup[i];
+		}
+	}
+	return NULL;
+}
 
-bool USBHub::can_send_control_now()
+bool USBHub::queue_hub_control(setup_t *s, void *buf)
 {
-	if (sending_control_transfer) return false;
-	sending_control_transfer = 1;
-	return true;
+	if (queue_Control_Transfer(device, s, buf, this)) {
+		control_order[control_queued++] = s - setup;
+		return true;
+	}
+	// out of Transfer_t, free this slot and try again later
+	control_busy &= ~(1 << (s - setup));
+	return false;
 }
 
 void USBHub::send_poweron(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 3, 8, port, 0);
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_poweron &= ~(1 << port);
-	} else {
-		send_pending_poweron |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 3, 8, port, 0);
+		if (queue_hub_control(s, NULL)) {
+			send_pending_poweron &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_poweron |= (1 << port);
 }
 
 void USBHub::send_getstatus(uint32_t port)
 {
 	if (port > numports) return;
-	if (can_send_control_now()) {
+	setup_t *s = can_send_control_now();
+	if (s) {
 		println("getstatus, port = ", port);
-		mk_setup(setup, ((port > 0) ? 0xA3 : 0xA0), 0, 0, port, 4);
-		queue_Control_Transfer(device, &setup, &statusbits, this);
-		send_pending_getstatus &= ~(1 << port);
-	} else {
-		println("deferred getstatus, port = ", port);
-		send_pending_getstatus |= (1 << port);
+		mk_setup(*s, ((port > 0) ? 0xA3 : 0xA0), 0, 0, port, 4);
+		if (queue_hub_control(s, &statusbits[s - setup])) {
+			send_pending_getstatus &= ~(1 << port);
+			return;
+		}
 	}
+	println("deferred getstatus, port = ", port);
+	send_pending_getstatus |= (1 << port);
 }
 
 void USBHub::send_clearstatus_connect(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 1, 16, port, 0); // 16=C_PORT_CONNECTION
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_clearstatus_connect &= ~(1 << port);
-	} else {
-		send_pending_clearstatus_connect |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 1, 16, port, 0); // 16=C_PORT_CONNECTION
+		if (queue_hub_control(s, NULL)) {
+			send_pending_clearstatus_connect &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_clearstatus_connect |= (1 << port);
 }
 
 void USBHub::send_clearstatus_enable(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 1, 17, port, 0); // 17=C_PORT_ENABLE
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_clearstatus_enable &= ~(1 << port);
-	} else {
-		send_pending_clearstatus_enable |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 1, 17, port, 0); // 17=C_PORT_ENABLE
+		if (queue_hub_control(s, NULL)) {
+			send_pending_clearstatus_enable &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_clearstatus_enable |= (1 << port);
 }
 
 void USBHub::send_clearstatus_suspend(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 1, 18, port, 0); // 18=C_PORT_SUSPEND
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_clearstatus_suspend &= ~(1 << port);
-	} else {
-		send_pending_clearstatus_suspend |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 1, 18, port, 0); // 18=C_PORT_SUSPEND
+		if (queue_hub_control(s, NULL)) {
+			send_pending_clearstatus_suspend &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_clearstatus_suspend |= (1 << port);
 }
 
 void USBHub::send_clearstatus_overcurrent(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 1, 19, port, 0); // 19=C_PORT_OVER_CURRENT
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_clearstatus_overcurrent &= ~(1 << port);
-	} else {
-		send_pending_clearstatus_overcurrent |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 1, 19, port, 0); // 19=C_PORT_OVER_CURRENT
+		if (queue_hub_control(s, NULL)) {
+			send_pending_clearstatus_overcurrent &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_clearstatus_overcurrent |= (1 << port);
 }
 
 void USBHub::send_clearstatus_reset(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 1, 20, port, 0); // 20=C_PORT_RESET
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_clearstatus_reset &= ~(1 << port);
-	} else {
-		send_pending_clearstatus_reset |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 1, 20, port, 0); // 20=C_PORT_RESET
+		if (queue_hub_control(s, NULL)) {
+			send_pending_clearstatus_reset &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_clearstatus_reset |= (1 << port);
 }
 
 void USBHub::send_setreset(uint32_t port)
 {
 	if (port == 0 || port > numports) return;
 	println("send_setreset");
-	if (can_send_control_now()) {
-		mk_setup(setup, 0x23, 3, 4, port, 0); // set feature PORT_RESET
-		queue_Control_Transfer(device, &setup, NULL, this);
-		send_pending_setreset &= ~(1 << port);
-	} else {
-		send_pending_setreset |= (1 << port);
+	setup_t *s = can_send_control_now();
+	if (s) {
+		mk_setup(*s, 0x23, 3, 4, port, 0); // set feature PORT_RESET
+		if (queue_hub_control(s, NULL)) {
+			send_pending_setreset &= ~(1 << port);
+			return;
+		}
 	}
+	send_pending_setreset |= (1 << port);
 }
 
 void USBHub::send_setinterface()
 {
-	// assumes not already sending another control transfer
-	mk_setup(setup, 1, 11, altsetting, interface_number, 0);
-	queue_Control_Transfer(device, &setup, NULL, this);
-	sending_control_transfer = 1;
+	// only called while reading the hub descriptor, so a slot is free
+	setup_t *s = can_send_control_now();
+	if (!s) return;
+	mk_setup(*s, 1, 11, altsetting, interface_number, 0);
+	queue_hub_control(s, NULL);
 }
 
 static uint32_t lowestbit(uint32_t bitmask)
@@ -228,18 +278,64 @@ static uint32_t lowestbit(uint32_t bitmask)
 	return __builtin_ctz(bitmask);
 }
 
+// Send as many deferred requests as free slots allow.  Stop early if
+// a request could not be queued (no Transfer_t available), since it
+// will remain pending and be retried after the next completion.
+void USBHub::send_pending()
+{
+	while (control_busy != (1 << CONTROL_SLOTS) - 1) {
+		uint32_t busy = control_busy;
+		if (send_pending_poweron) {
+			send_poweron(lowestbit(send_pending_poweron));
+		} else if (send_pending_clearstatus_connect) {
+			send_clearstatus_connect(lowestbit(send_pending_clearstatus_connect));
+		} else if (send_pending_clearstatus_enable) {
+			send_clearstatus_enable(lowestbit(send_pending_clearstatus_enable));
+		} else if (send_pending_clearstatus_suspend) {
+			send_clearstatus_suspend(lowestbit(send_pending_clearstatus_suspend));
+		} else if (send_pending_clearstatus_overcurrent) {
+			send_clearstatus_overcurrent(lowestbit(send_pending_clearstatus_overcurrent));
+		} else if (send_pending_clearstatus_reset) {
+			send_clearstatus_reset(lowestbit(send_pending_clearstatus_reset));
+		} else if (send_pending_getstatus) {
+			send_getstatus(lowestbit(send_pending_getstatus));
+		} else if (send_pending_setreset) {
+			send_setreset(lowestbit(send_pending_setreset));
+		} else {
+			break;
+		}
+		if (control_busy == busy) break;
+	}
+}
+
 void USBHub::control(const Transfer_t *transfer)
 {
 	println("USBHub control callback");
 	print_hexbytes(transfer->buffer, transfer->length);
 
-	sending_control_transfer = 0;
+	// Free the slot used by this request.  The control pipe completes
+	// requests in the order they were queued, so it is the oldest one.
+	// Matching by setup contents would free the wrong slot when two
+	// identical requests are queued, while it is still in use.
+	if (control_queued > 0) {
+		control_busy &= ~(1 << control_order[0]);
+		control_queued--;
+		for (uint32_t i=0; i < control_queued; i++) {
+			control_order[i] = control_order[i+1];
+		}
+	}
 	uint32_t port = transfer->setup.wIndex;
 	uint32_t mesg = transfer->setup.word1;
 
 	switch (mesg) {
 	  case 0x290006A0: // read hub descriptor
 		numports = hub_desc[2];
+		if (numports > MAXPORTS) {
+			println("Hub has too many ports, only using ", MAXPORTS);
+			numports = MAXPORTS;
+		}
+		// status change bitmap: bit 0 for the hub, 1 bit per port
+		changesize = (numports >> 3) + 1;
 		characteristics = hub_desc[3];
 		powertime = hub_desc[5];
 		if (interface_count > 1) {
@@ -256,10 +352,10 @@ void USBHub::control(const Transfer_t *transfer)
 		if (port == numports && changepipe == NULL) {
 			println("power turned on to all ports");
 			println("device addr = ", device->address);
-			changepipe = new_Pipe(device, 3, endpoint, 1, 1, interval);
+			changepipe = new_Pipe(device, 3, endpoint, 1, changesize, interval);
 			println("pipe cap1 = ", changepipe->qh.capabilities[0], HEX);
 			changepipe->callback_function = callback;
-			queue_Data_Transfer(changepipe, &changebits, 1, this);
+			queue_Data_Transfer(changepipe, &changebits, changesize, this);
 		}
 		break;
 
@@ -270,13 +366,8 @@ void USBHub::control(const Transfer_t *transfer)
 		println("New Port Status");
 		if (transfer->length == 4) {
 			uint32_t status = *(uint32_t *)(transfer->buffer);
-			if (status != statusbits) println("ERROR: status not same");
 			new_port_status(port, status);
 		}
-		//if (changebits & (1 << port)) {
-			//changebits &= ~(1 << port);
-			//send_clearstatus(port);
-		//}
 		break;
 	  case 0x00100120: // clear hub status
 		println("Hub Status Cleared");
@@ -288,27 +379,13 @@ void USBHub::control(const Transfer_t *transfer)
 		println("unhandled setup, message = ", mesg, HEX);
 	}
 	// After we've completed processing for this control
-	// transfer, check if any more need to be sent.  These
-	// allow only a single control transfer to occur at once
-	// which isn't fast, but requires only 3 Transfer_t and
-	// allows reusing the setup and other buffers
-	if (sending_control_transfer) return;
-	if (send_pending_poweron) {
-		send_poweron(lowestbit(send_pending_poweron));
-	} else if (send_pending_clearstatus_connect) {
-		send_clearstatus_connect(lowestbit(send_pending_clearstatus_connect));
-	} else if (send_pending_clearstatus_enable) {
-		send_clearstatus_enable(lowestbit(send_pending_clearstatus_enable));
-	} else if (send_pending_clearstatus_suspend) {
-		send_clearstatus_suspend(lowestbit(send_pending_clearstatus_suspend));
-	} else if (send_pending_clearstatus_overcurrent) {
-		send_clearstatus_overcurrent(lowestbit(send_pending_clearstatus_overcurrent));
-	} else if (send_pending_clearstatus_reset) {
-		send_clearstatus_reset(lowestbit(send_pending_clearstatus_reset));
-	} else if (send_pending_getstatus) {
-		send_getstatus(lowestbit(send_pending_getstatus));
-	} else if (send_pending_setreset) {
-		send_setreset(lowestbit(send_pending_setreset));
+	// transfer, check if any more need to be sent.  Up to
+	// CONTROL_SLOTS may be queued at once, any more remain
+	// pending in the send_pending_* bitmasks.
+	send_pending();
+	if (control_busy == 0 && change_micros) {
+		println("hub requests settled, us = ", micros() - change_micros);
+		change_micros = 0;
 	}
 }
 
@@ -322,12 +399,13 @@ void USBHub::status_change(const Transfer_t *transfer)
 {
 	println("HUB Callback (member)");
 	println("status = ", changebits, HEX);
+	if (changebits && change_micros == 0) change_micros = micros();
 	for (uint32_t i=0; i <= numports; i++) {
 		if (changebits & (1 << i)) {
 			send_getstatus(i);
 		}
 	}
-	queue_Data_Transfer(changepipe, &changebits, 1, this);
+	queue_Data_Transfer(changepipe, &changebits, changesize, this);
 }
 
 void USBHub::new_port_status(uint32_t port, uint32_t status)
@@ -366,6 +444,7 @@ void USBHub::new_port_status(uint32_t port, uint32_t status)
 	  case PORT_DISCONNECT:
 		if (status & 0x0001) { // connected
 			state = PORT_DEBOUNCE1;
+			debounce_micros[port-1] = micros();
 			start_debounce_timer(port);
 			send_clearstatus_connect(port);
 		}
@@ -375,24 +454,50 @@ void USBHub::new_port_status(uint32_t port, uint32_t status)
 	  case PORT_DEBOUNCE3:
 	  case PORT_DEBOUNCE4:
 	  case PORT_DEBOUNCE5:
-		if (status & 0x0001) {
-			if (++state > PORT_DEBOUNCE5) {
-				if (USBHub::reset_busy || USBHost::enumeration_busy) {
-					// wait in debounce state if another port is
-					// resetting or a device is busy enumerating
-					state = PORT_DEBOUNCE5;
-					break;
-				}
-				USBHub::reset_busy = true;
-				stop_debounce_timer(port);
-				state = PORT_RESET;
-				println("sending reset");
-				send_setreset(port);
-				port_doing_reset = port;
-			}
-		} else {
+		if (!(status & 0x0001)) {
 			stop_debounce_timer(port);
 			state = PORT_DISCONNECT;
+			if (status & 0x10000) send_clearstatus_connect(port);
+			break;
+		}
+		if (debounce_polling) {
+			// polling: must see 5 connected status reads, 20 ms apart
+			if (++state > PORT_DEBOUNCE5) {
+				if (!begin_port_reset(port)) state = PORT_DEBOUNCE5;
+			}
+			break;
+		}
+		if (status & 0x10000) {
+			// connection changed again, restart the debounce period
+			println("  debounce restart");
+			if ((debounce_checking & (1 << port))
+			  && ++debounce_misses >= DEBOUNCE_MISS_LIMIT) {
+				// the status change pipe did not tell us about these
+				// bounces, so this hub needs to be polled instead.  Once
+				// could be a race with a status read from the pipe.
+				println("  hub did not report bounce, using polling");
+				debounce_polling = true;
+				debounce_checking = 0;
+				state = PORT_DEBOUNCE1;
+				send_clearstatus_connect(port);
+				debouncetimer.stop();
+				debouncetimer.start(20000);
+				break;
+			}
+			debounce_checking &= ~(1 << port);
+			debounce_micros[port-1] = micros();
+			send_clearstatus_connect(port);
+			schedule_debounce_timer();
+			break;
+		}
+		if (debounce_checking & (1 << port)) {
+			// deadline status read, no change for the whole period
+			debounce_checking &= ~(1 << port);
+			if (!begin_port_reset(port)) {
+				// another device is using address zero, look again later
+				debounce_micros[port-1] = micros() - (DEBOUNCE_MICROS - 20000);
+			}
+			schedule_debounce_timer();
 		}
 		break;
 	  case PORT_RESET:
@@ -443,11 +548,24 @@ void USBHub::timer_event(USBDriverTimer *timer)
 	if (timer == &debouncetimer) {
 		uint32_t in_use = debounce_in_use;
 		println("ports in use bitmask = ", in_use, HEX);
-		if (in_use) {
+		if (in_use && debounce_polling) {
 			for (uint32_t i=1; i <= numports; i++) {
 				if (in_use & (1 << i)) send_getstatus(i);
 			}
 			debouncetimer.start(20000);
+		} else if (in_use) {
+			// read status once for each port whose debounce period
+			// has ended, the result decides if it's stable
+			uint32_t now = micros();
+			for (uint32_t i=1; i <= numports; i++) {
+				if ((in_use & ~debounce_checking) & (1 << i)) {
+					if (now - debounce_micros[i-1] >= DEBOUNCE_MICROS - 100) {
+						debounce_checking |= (1 << i);
+						send_getstatus(i);
+					}
+				}
+			}
+			schedule_debounce_timer();
 		}
 	} else if (timer == &resettimer) {
 		uint8_t port = port_doing_reset;
@@ -459,7 +577,8 @@ void USBHub::timer_event(USBDriverTimer *timer)
 				println("PORT_RECOVERY");
 				// begin enumeration process
 				uint8_t speed = port_doing_reset_speed;
-				devicelist[port-1] = new_Device(speed, device->address, port);
+				devicelist[port-1] = new_Device(device->controller, speed,
+					device->address, port);
 				// TODO: if return is NULL, what to do?  Panic?
 				// Can we disable the port?  Will this device
 				// play havoc if it sits unconfigured responding
@@ -477,15 +596,66 @@ void USBHub::timer_event(USBDriverTimer *timer)
 	//if (++count > 36) while (1) ; // stop here
 }
 
+// Hub port debounce (USB 2.0: TATTDB, page 150 & 188).  A port must
+// show a stable connection for 100 ms before it may be reset.  By
+// default, each port's last connection change time is recorded when
+// its change is reported by the status change pipe, and the port is
+// read only once at the end of the 100 ms.  Hubs which fail to report
+// bounces on the status change pipe fall back to reading every
+// debouncing port's status every 20 ms.
 void USBHub::start_debounce_timer(uint32_t port)
 {
-	if (debounce_in_use == 0) debouncetimer.start(20000);
-	debounce_in_use |= (1 << port);
+	if (debounce_polling) {
+		if (debounce_in_use == 0) debouncetimer.start(20000);
+		debounce_in_use |= (1 << port);
+	} else {
+		debounce_in_use |= (1 << port);
+		debounce_checking &= ~(1 << port);
+		schedule_debounce_timer();
+	}
 }
 
 void USBHub::stop_debounce_timer(uint32_t port)
 {
 	debounce_in_use &= ~(1 << port);
+	debounce_checking &= ~(1 << port);
+	if (debounce_in_use == 0) debouncetimer.stop();
+}
+
+// Set the debounce timer for the earliest port deadline
+void USBHub::schedule_debounce_timer()
+{
+	if (debounce_polling) return;
+	uint32_t waiting = debounce_in_use & ~debounce_checking;
+	debouncetimer.stop();
+	if (!waiting) return;
+	uint32_t now = micros();
+	uint32_t soonest = DEBOUNCE_MICROS;
+	for (uint32_t i=1; i <= numports; i++) {
+		if (waiting & (1 << i)) {
+			uint32_t elapsed = now - debounce_micros[i-1];
+			uint32_t remain = (elapsed < DEBOUNCE_MICROS) ? DEBOUNCE_MICROS - elapsed : 0;
+			if (remain < soonest) soonest = remain;
+		}
+	}
+	if (soonest < 100) soonest = 100; // minimum timer duration
+	debouncetimer.start(soonest);
+}
+
+// Begin resetting a port after it has completed debounce.  Returns
+// false if another port is resetting or a device is using address
+// zero, in which case the port must remain in debounce and try again.
+bool USBHub::begin_port_reset(uint32_t port)
+{
+	if (USBHub::reset_busy || USBHost::enumeration_busy(device->controller)) return false;
+	USBHub::reset_busy = true;
+	println("debounce done, us = ", micros() - debounce_micros[port-1]);
+	stop_debounce_timer(port);
+	portstate[port-1] = PORT_RESET;
+	println("sending reset");
+	send_setreset(port);
+	port_doing_reset = port;
+	return true;
 }
 
 
@@ -498,7 +668,9 @@ void USBHub::disconnect()
 	numports = 0;
 	changepipe = NULL;
 	changebits = 0;
-	sending_control_transfer = 0;
+	control_busy = 0;
+	control_queued = 0;
+	change_micros = 0;
 	port_doing_reset = 0;
 	memset(portstate, 0, sizeof(portstate));
 	memset(devicelist, 0, sizeof(devicelist));
@@ -511,6 +683,10 @@ void USBHub::disconnect()
 	send_pending_clearstatus_reset = 0;
 	send_pending_setreset = 0;
 	debounce_in_use = 0;
+	debounce_checking = 0;
+	debounce_polling = debounce_polling_user;
+	debounce_misses = 0;
+	debouncetimer.stop();
 }
 
 
@@ -34,23 +34,6 @@
 #define DBGPrintf(...) 
 #endif
 
-// PID/VID to joystick mapping - Only the XBOXOne is used to claim the USB interface directly, 
-// The others are used after claim-hid code to know which one we have and to use it for 
-// doing other features.  
-JoystickController::product_vendor_mapping_t JoystickController::pid_vid_mapping[] = {
-	{ 0x045e, 0x02ea, XBOXONE, false },{ 0x045e, 0x02dd, XBOXONE, false },
-	{ 0x045e, 0x0719, XBOX360, false},
-	{ 0x045e, 0x028E, SWITCH, false},  // Switch? 
-	{ 0x054C, 0x0268, PS3, true}, 
-	{ 0x054C, 0x042F, PS3, true},	// PS3 Navigation controller
-	{ 0x054C, 0x03D5, PS3_MOTION, true},	// PS3 Motion controller
-	{ 0x054C, 0x05C4, PS4, true}, 	{0x054C, 0x09CC, PS4, true },
-	{ 0x046D, 0xC626, SpaceNav, true},  // 3d Connextion Space Navigator, 0x10008
-	{ 0x046D, 0xC628, SpaceNav, true}  // 3d Connextion Space Navigator, 0x10008
-};
-
-
-
 //-----------------------------------------------------------------------------
 void JoystickController::init()
 {
@@ -65,14 +48,13 @@ void JoystickController::init()
 //-----------------------------------------------------------------------------
 JoystickController::joytype_t JoystickController::mapVIDPIDtoJoystickType(uint16_t idVendor, uint16_t idProduct, bool exclude_hid_devices)
 {
-	for (uint8_t i = 0; i < (sizeof(pid_vid_mapping)/sizeof(pid_vid_mapping[0])); i++) {
-		if ((idVendor == pid_vid_mapping[i].idVendor) && (idProduct == pid_vid_mapping[i].idProduct)) {
-			println("Match PID/VID: ", i, DEC);
-			if (exclude_hid_devices && pid_vid_mapping[i].hidDevice) return UNKNOWN;
-			return pid_vid_mapping[i].joyType;
-		}
-	}  
-	return UNKNOWN; 	// Not in our list
+	// Only the XBOXONE is claimed by VID/PID directly, the others are used
+	// after claim_collection to know which one we have for other features.
+	const usb_quirk_t *q = find_quirk(idVendor, idProduct, QUIRK_DRIVER_JOYSTICK);
+	if (!q) return UNKNOWN; 	// Not in our list
+	println("Match PID/VID: ", q->type, DEC);
+	if (exclude_hid_devices && (q->flags & QUIRK_HID_DEVICE)) return UNKNOWN;
+	return (joytype_t)q->type;
 }
 
 //*****************************************************************************
@@ -196,6 +178,8 @@ bool JoystickController::setRumble(uint8_t lValue, uint8_t rValue, uint8_t timeo
 
 			if (!queue_Data_Transfer(txpipe_, txbuf_, 6, this)) {
 				println("XBox duke rumble transfer fail");
+			}
+			return true;
 		case SWITCH:
 			memset(txbuf_, 0, 10);	// make sure it is cleared out
 			txbuf_[0] = 0x80;
@@ -438,6 +422,7 @@ hidclaim_t JoystickController::claim_collection(USBHIDParser *driver, Device_t *
 	mydevice = dev;
 	collections_claimed++;
 	anychange = true; // always report values on first read
+	hid_changes_only = true; // axes & buttons are state, skip repeated values
 	driver_ = driver;	// remember the driver. 
 	driver_->setTXBuffers(txbuf_, nullptr, sizeof(txbuf_));
 	connected_ = true;		// remember that hardware is actually connected...
@@ -475,15 +460,77 @@ void JoystickController::disconnect_collection(Device_t *dev)
 		mydevice = NULL;
 		driver_ = nullptr;
 		axis_mask_ = 0;	
+		axis_present_ = 0;
 		axis_changed_mask_ = 0;
+		memset(axis_scale_, 0, sizeof(axis_scale_));
+		memset(axis_norm_, 0, sizeof(axis_norm_));
+		hat_ = 0;
 	}
 }
 
 void JoystickController::hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax)
 {
-	// TODO: set up translation from logical min/max to consistent 16 bit scale
+	// With the compiled field table, begin is called before each field,
+	// so this is the logical range of the values which follow
+	field_lgmin_ = lgmin;
+	field_lgmax_ = lgmax;
+}
+
+void JoystickController::setDeadzone(uint16_t deadzone)
+{
+	if (deadzone > 32000) deadzone = 32000;
+	deadzone_ = deadzone;
+	deadzone_scale_ = (32767 << 16) / (32767 - deadzone);
+}
+
+// Scale an axis to -32768 to 32767.  The multiplier is computed once per
+// axis from the logical range, so each report costs one multiply.
+// Without a usable range the raw value is given, as before scaling.
+int16_t JoystickController::normalize_axis(uint32_t index, int32_t value)
+{
+	if (axis_scale_[index] == 0 || axis_lgmin_[index] != field_lgmin_
+	  || axis_lgmax_[index] != field_lgmax_) {
+		uint32_t range = field_lgmax_ - field_lgmin_;
+		if (field_lgmax_ <= field_lgmin_) {
+			axis_scale_[index] = 0;
+			if (value > 32767) return 32767;
+			if (value < -32768) return -32768;
+			return value;
+		}
+		axis_lgmin_[index] = field_lgmin_;
+		axis_lgmax_[index] = field_lgmax_;
+		axis_scale_[index] = (uint32_t)(((uint64_t)65535 << 16) / range);
+	}
+	if (value < axis_lgmin_[index]) value = axis_lgmin_[index];
+	if (value > axis_lgmax_[index]) value = axis_lgmax_[index];
+	uint32_t offset = value - axis_lgmin_[index];
+	int32_t n = (int32_t)(((uint64_t)offset * axis_scale_[index]) >> 16) - 32768;
+	if (deadzone_) {
+		if (n > deadzone_) {
+			n = ((n - deadzone_) * deadzone_scale_) >> 16;
+		} else if (n < -deadzone_) {
+			n = -(int32_t)(((-n - deadzone_) * deadzone_scale_) >> 16);
+		} else {
+			n = 0;
+		}
+		if (n > 32767) n = 32767;
+		if (n < -32768) n = -32768;
+	}
+	return n;
 }
 
+// Hat switch positions, clockwise from up
+static const uint8_t hat_directions[8] = {
+	JoystickController::HAT_UP,
+	JoystickController::HAT_UP | JoystickController::HAT_RIGHT,
+	JoystickController::HAT_RIGHT,
+	JoystickController::HAT_DOWN | JoystickController::HAT_RIGHT,
+	JoystickController::HAT_DOWN,
+	JoystickController::HAT_DOWN | JoystickController::HAT_LEFT,
+	JoystickController::HAT_LEFT,
+	JoystickController::HAT_UP | JoystickController::HAT_LEFT
+};
+
 void JoystickController::hid_input_data(uint32_t usage, int32_t value)
 {
 	DBGPrintf("joystickType_=%d\n", joystickType_);
@@ -504,12 +551,23 @@ void JoystickController::hid_input_data(uint32_t usage, int32_t value)
 			}
 		}
 	} else if (usage_page == 1 && usage >= 0x30 && usage <= 0x39) {
-		// TODO: need scaling of value to consistent API, 16 bit signed?
 		// TODO: many joysticks repeat slider usage.  Detect & map to axis?
 		uint32_t i = usage - 0x30;
-		axis_mask_ |= (1 << i);		// Keep record of which axis we have data on.
-		if (axis[i] != value) {
-			axis[i] = value;
+		axis_present_ |= (1 << i);	// Keep record of which axis we have data on.
+		bool changed = (axis[i] != value);
+		axis[i] = value;
+		if (usage == 0x39) {
+			// hat switch, 4 or 8 positions, anything else is centered
+			uint32_t pos = value - field_lgmin_;
+			uint32_t range = field_lgmax_ - field_lgmin_;
+			uint8_t hat = 0;
+			if (range == 3 && pos <= 3) hat = hat_directions[pos * 2];
+			else if (range == 7 && pos <= 7) hat = hat_directions[pos];
+			hat_ = hat;
+		} else {
+			axis_norm_[i] = normalize_axis(i, value);
+		}
+		if (changed) {
 			axis_changed_mask_ |= (1 << i);
 			if (axis_changed_mask_ & axis_change_notify_mask_)
 				anychange = true;
@@ -528,7 +586,7 @@ void JoystickController::hid_input_data(uint32_t usage, int32_t value)
 					if (axis_changed_mask_ & axis_change_notify_mask_)
 						anychange = true;	// We have changes... 
 				}
-				axis_mask_ |= ((uint64_t)1 << usage_index);		// Keep record of which axis we have data on.
+				axis_present_ |= ((uint64_t)1 << usage_index);	// Keep record of which axis we have data on.
 			}
 			//DBGPrintf("UB: index=%x value=%x\n", usage_index, value);
 		}
@@ -537,7 +595,6 @@ void JoystickController::hid_input_data(uint32_t usage, int32_t value)
 		DBGPrintf("UP: usage_page=%x usage=%x add: %x %x %d\n", usage_page, usage, additional_axis_usage_page_, additional_axis_usage_start_, additional_axis_usage_count_);
 
 	}
-	// TODO: hat switch?
 }
 
 void JoystickController::hid_input_end()
@@ -718,13 +775,15 @@ bool JoystickController::claim(Device_t *dev, int type, const uint8_t *descripto
 	joystickType_ = jtype;
 	if (jtype == XBOXONE) {
 		queue_Data_Transfer(txpipe_, xboxone_start_input, sizeof(xboxone_start_input), this);
+		const usb_quirk_t *q = find_quirk(dev->idVendor, dev->idProduct, QUIRK_DRIVER_JOYSTICK);
+		uint16_t quirks = q ? q->flags : 0;
 
 		//Init packet for XBONE S/Elite controllers (return from bluetooth mode)
-		if (dev->idVendor == 0x045e && (dev->idProduct == 0x02ea || dev->idProduct == 0x0b00))
+		if (quirks & QUIRK_XBOXONE_S_INIT)
 			queue_Data_Transfer(txpipe_, xboxone_s_init, sizeof(xboxone_s_init), this);
 
 		//Required for PDP aftermarket controllers
-		if (dev->idVendor == 0x0e6f)
+		if (quirks & QUIRK_XBOXONE_PDP_INIT)
 		{
 			queue_Data_Transfer(txpipe_, xboxone_pdp_init1, sizeof(xboxone_pdp_init1), this);
 			queue_Data_Transfer(txpipe_, xboxone_pdp_init2, sizeof(xboxone_pdp_init2), this);
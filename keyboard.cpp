@@ -36,11 +36,6 @@ typedef struct {
 	uint8_t charNumlockOn;		// We will assume when num lock is on we have all characters...
 } keycode_numlock_t;
 
-typedef struct {
-	uint16_t	idVendor;		// vendor id of keyboard
-	uint16_t	idProduct;		// product id - 0 implies all of the ones from vendor; 
-} keyboard_force_boot_protocol_t;	// list of products to force into boot protocol
-
 #ifdef M
 #undef M
 #endif
@@ -94,10 +89,6 @@ static const keycode_numlock_t keycode_numlock[] = {
 	{M(KEYPAD_PERIOD), 	0x80 | M(KEY_DELETE), '.'}
 };
 
-static const keyboard_force_boot_protocol_t keyboard_forceBootMode[] = {
-	{0x04D9, 0}
-};
-
 
 #define print   USBHost::print_
 #define println USBHost::println_
@@ -105,15 +96,24 @@ static const keyboard_force_boot_protocol_t keyboard_forceBootMode[] = {
 
 
 
+static const usb_match_t keyboard_match[] = {
+	{USB_MATCH_CLASS | USB_MATCH_SUBCLASS | USB_MATCH_PROTOCOL, 3, 1, 1, 0, 0}, // boot keyboard
+	{0, 0, 0, 0, 0, 0}
+};
+
 void KeyboardController::init()
 {
 	contribute_Pipes(mypipes, sizeof(mypipes)/sizeof(Pipe_t));
 	contribute_Transfers(mytransfers, sizeof(mytransfers)/sizeof(Transfer_t));
 	contribute_String_Buffers(mystring_bufs, sizeof(mystring_bufs)/sizeof(strbuf_t));
+	match_list = keyboard_match;
 	driver_ready_for_device(this);
 	USBHIDParser::driver_ready_for_hid_collection(this);
 	BluetoothController::driver_ready_for_bluetooth(this);
 	force_boot_protocol = false;	// start off assuming not
+	memset(boot_keys, 0, sizeof(boot_keys));
+	memset(hid_keys, 0, sizeof(hid_keys));
+	memset(keys_reported, 0, sizeof(keys_reported));
 }
 
 bool KeyboardController::claim(Device_t *dev, int type, const uint8_t *descriptors, uint32_t len)
@@ -157,17 +157,8 @@ bool KeyboardController::claim(Device_t *dev, int type, const uint8_t *descripto
 
 	// see if this device in list of devices that need to be set in
 	// boot protocol mode
-	bool in_forceBoot_mode_list = false;
-	for (uint8_t i = 0; i < sizeof(keyboard_forceBootMode)/sizeof(keyboard_forceBootMode[0]); i++) {
-		if (dev->idVendor == keyboard_forceBootMode[i].idVendor) {
-			if ((dev->idProduct == keyboard_forceBootMode[i].idProduct) ||
-					(keyboard_forceBootMode[i].idProduct == 0)) {
-				in_forceBoot_mode_list = true;
-				break;
-			}
-		}
-	}
-	if (in_forceBoot_mode_list) {
+	const usb_quirk_t *q = find_quirk(dev->idVendor, dev->idProduct, QUIRK_DRIVER_KEYBOARD);
+	if (q && (q->flags & QUIRK_FORCE_BOOT_PROTOCOL)) {
 		println("SET_PROTOCOL Boot");
 		mk_setup(setup, 0x21, 11, 0, 0, 0); // 11=SET_PROTOCOL  BOOT
 	} else {
@@ -219,6 +210,10 @@ void KeyboardController::forceBootProtocol()
 void KeyboardController::disconnect()
 {
 	// TODO: free resources
+	keyRepeatTimer.stop();
+	repeat_key_ = 0;
+	memset(boot_keys, 0, sizeof(boot_keys));
+	memset(keys_reported, 0, sizeof(keys_reported));
 }
 
 
@@ -232,59 +227,140 @@ void __keyboardControllerEmptyCallback() { }
 void keyPressed()  __attribute__ ((weak, alias("__keyboardControllerEmptyCallback")));
 void keyReleased() __attribute__ ((weak, alias("__keyboardControllerEmptyCallback")));
 
-static bool contains(uint8_t b, const uint8_t *data)
+// Convert a boot protocol report to key state bits.  ErrorRollOver
+// means too many keys are down to list, so keep the prior state.
+bool KeyboardController::boot_report_to_keys(const uint8_t *data, uint32_t len)
 {
-	if (data[2] == b || data[3] == b || data[4] == b) return true;
-	if (data[5] == b || data[6] == b || data[7] == b) return true;
-	return false;
+	uint32_t keys[8];
+	memset(keys, 0, sizeof(keys));
+	keys[7] = data[0];	// modifier bits are usages 0xE0 to 0xE7
+	if (len > 8) len = 8;
+	for (uint32_t i=2; i < len; i++) {
+		uint32_t key = data[i];
+		if (key == 1) return false;
+		if (key >= 4) keys[key >> 5] |= (1 << (key & 31));
+	}
+	memcpy(boot_keys, keys, sizeof(keys));
+	return true;
 }
 
-void KeyboardController::new_data(const Transfer_t *transfer)
+// Compare the key state a word at a time and report what changed,
+// releases first as the boot protocol diff always did
+void KeyboardController::update_keys()
 {
-	println("KeyboardController Callback (member)");
-	print("  KB Data: ");
-	print_hexbytes(transfer->buffer, 8);
-	for (int i=2; i < 8; i++) {
-		uint32_t key = prev_report[i];
-		if (key >= 4 && !contains(key, report)) {
-			key_release(prev_report[0], key);
-			if (rawKeyReleasedFunction) {
-				rawKeyReleasedFunction(key);
-			}
+	uint32_t keys[8];
+	for (uint32_t w=0; w < 8; w++) {
+		keys[w] = boot_keys[w] | hid_keys[w];
+	}
+	uint32_t oldmod = keys_reported[7] & 0xFF;
+	uint32_t newmod = keys[7] & 0xFF;
+	for (uint32_t w=0; w < 8; w++) {
+		uint32_t up = keys_reported[w] & ~keys[w];
+		while (up) {
+			uint32_t bit = __builtin_ctz(up);
+			up &= up - 1;
+			keys_reported[w] &= ~(1 << bit);
+			key_event((w << 5) | bit, oldmod, false);
 		}
 	}
-	if (rawKeyReleasedFunction) {
-		// each modifier key is represented by a bit in the first byte
-		for (int i = 0; i < 8; ++i)
-		{
-			uint8_t keybit = 1 << i;
-			if ((prev_report[0] & keybit) && !(report[0] & keybit)) {
-				rawKeyReleasedFunction(103 + i);
-			}
+	for (uint32_t w=0; w < 8; w++) {
+		uint32_t down = keys[w] & ~keys_reported[w];
+		while (down) {
+			uint32_t bit = __builtin_ctz(down);
+			down &= down - 1;
+			keys_reported[w] |= (1 << bit);
+			key_event((w << 5) | bit, newmod, true);
 		}
 	}
-	for (int i=2; i < 8; i++) {
-		uint32_t key = report[i];
-		if (key >= 4 && !contains(key, prev_report)) {
-			key_press(report[0], key);
-			if (rawKeyPressedFunction) {
-				rawKeyPressedFunction(key);
-			}
+}
+
+void KeyboardController::queue_key_event(uint32_t key, uint32_t mod, bool pressed, bool repeat)
+{
+	uint32_t head = key_event_head + 1;
+	if (head >= KEY_EVENT_LEN) head = 0;
+	if (head == key_event_tail) return; // full
+	key_events[head].keycode = key;
+	key_events[head].modifiers = mod;
+	key_events[head].pressed = pressed;
+	key_events[head].repeat = repeat;
+	key_event_head = head;
+}
+
+void KeyboardController::key_event(uint32_t key, uint32_t mod, bool pressed)
+{
+	queue_key_event(key, mod, pressed, false);
+	if (key >= 0xE0 && key <= 0xE7) {
+		// each modifier key is represented by a bit in the first byte
+		if (pressed) {
+			if (rawKeyPressedFunction) rawKeyPressedFunction(103 + key - 0xE0);
+		} else {
+			if (rawKeyReleasedFunction) rawKeyReleasedFunction(103 + key - 0xE0);
 		}
+		return;
 	}
-	if (rawKeyPressedFunction) {
-		for (int i = 0; i < 8; ++i)
-		{
-			uint8_t keybit = 1 << i;
-			if (!(prev_report[0] & keybit) && (report[0] & keybit)) {
-				rawKeyPressedFunction(103 + i);
-			}
+	if (pressed) {
+		key_press(mod, key);
+		if (rawKeyPressedFunction) rawKeyPressedFunction(key);
+		if (repeat_delay_ && key != M(KEY_CAPS_LOCK) && key != M(KEY_NUM_LOCK)
+		  && key != M(KEY_SCROLL_LOCK)) {
+			repeat_key_ = key;
+			keyRepeatTimer.stop();
+			keyRepeatTimer.start(repeat_delay_ * 1000);
+		}
+	} else {
+		key_release(mod, key);
+		if (rawKeyReleasedFunction) rawKeyReleasedFunction(key);
+		if (key == repeat_key_) {
+			keyRepeatTimer.stop();
+			repeat_key_ = 0;
 		}
 	}
-	memcpy(prev_report, report, 8);
+}
+
+void KeyboardController::new_data(const Transfer_t *transfer)
+{
+	println("KeyboardController Callback (member)");
+	print("  KB Data: ");
+	print_hexbytes(transfer->buffer, 8);
+	if (boot_report_to_keys(report, 8)) update_keys();
 	queue_Data_Transfer(datapipe, report, 8, this);
 }
 
+bool KeyboardController::readKeyEvent(keyevent_t &event)
+{
+	uint32_t tail = key_event_tail;
+	if (tail == key_event_head) return false;
+	if (++tail >= KEY_EVENT_LEN) tail = 0;
+	event = key_events[tail];
+	key_event_tail = tail;
+	return true;
+}
+
+void KeyboardController::setKeyRepeat(uint16_t delay_ms, uint16_t rate_ms)
+{
+	__disable_irq();
+	if (rate_ms == 0) delay_ms = 0;
+	repeat_delay_ = delay_ms;
+	repeat_rate_ = rate_ms;
+	if (delay_ms == 0) {
+		keyRepeatTimer.stop();
+		repeat_key_ = 0;
+	}
+	__enable_irq();
+}
+
+// Key repeat, the most recently pressed key while it stays down
+void KeyboardController::timer_event(USBDriverTimer *whichTimer)
+{
+	uint32_t key = repeat_key_;
+	if (!key || !repeat_rate_) return;
+	if (!(keys_reported[key >> 5] & (1 << (key & 31)))) return;
+	uint32_t mod = keys_reported[7] & 0xFF;
+	queue_key_event(key, mod, true, true);
+	key_press(mod, key);
+	keyRepeatTimer.start(repeat_rate_ * 1000);
+}
+
 
 void KeyboardController::numLock(bool f) {
 	if (leds_.numLock != f) {
@@ -348,11 +424,85 @@ void KeyboardController::key_release(uint32_t mod, uint32_t key)
 	}
 }
 
+// The layout Teensyduino was built with, turned into a table the first
+// time it is needed, instead of searching keycodes_ascii on every key
+static keyboard_layout_t default_layout;
+static keyboard_deadkey_t default_deadkeys[64];
+static bool default_layout_built = false;
+
+#ifndef ALTGR_MASK
+#define ALTGR_MASK 0
+#endif
+#ifndef DEADKEYS_MASK
+#define DEADKEYS_MASK 0
+#endif
+
+static void add_layout_key(KEYCODE_TYPE code, uint8_t ch)
+{
+	if (code == 0) return;
+	uint32_t key = code & (SHIFT_MASK - 1);
+	uint32_t mclass = ((code & SHIFT_MASK) ? 1 : 0) | ((code & ALTGR_MASK) ? 2 : 0);
+	uint32_t dead = (code & DEADKEYS_MASK) >> 8;
+	if (code & ~(SHIFT_MASK | ALTGR_MASK | DEADKEYS_MASK | (SHIFT_MASK - 1))) return;
+	if (dead) {
+		if (default_layout.deadkey_count < sizeof(default_deadkeys)/sizeof(default_deadkeys[0])) {
+			keyboard_deadkey_t *d = &default_deadkeys[default_layout.deadkey_count++];
+			d->code = (dead << 8) | (mclass << 6) | key;
+			d->ch = ch;
+		}
+	} else if (default_layout.keys[mclass][key] == 0) {
+		default_layout.keys[mclass][key] = ch; // first match, as the search was
+	}
+}
+
+static void add_layout_deadkey(KEYCODE_TYPE code, uint32_t bits)
+{
+	uint32_t key = code & (SHIFT_MASK - 1);
+	uint32_t mclass = ((code & SHIFT_MASK) ? 1 : 0) | ((code & ALTGR_MASK) ? 2 : 0);
+	default_layout.keys[mclass][key] = bits >> 8;
+}
+
+const keyboard_layout_t * KeyboardController::defaultLayout()
+{
+	if (default_layout_built) return &default_layout;
+	memset(&default_layout, 0, sizeof(default_layout));
+	default_layout.deadkeys = default_deadkeys;
+	for (int i=0; i < 96; i++) {
+		add_layout_key(keycodes_ascii[i], i + 32);
+	}
+#ifdef ISO_8859_1_A0
+	for (int i=0; i < 96; i++) {
+		add_layout_key(keycodes_iso_8859_1[i], i + 160);
+	}
+#endif
+#ifdef DEADKEY_CIRCUMFLEX
+	add_layout_deadkey(DEADKEY_CIRCUMFLEX, CIRCUMFLEX_BITS);
+#endif
+#ifdef DEADKEY_ACUTE_ACCENT
+	add_layout_deadkey(DEADKEY_ACUTE_ACCENT, ACUTE_ACCENT_BITS);
+#endif
+#ifdef DEADKEY_GRAVE_ACCENT
+	add_layout_deadkey(DEADKEY_GRAVE_ACCENT, GRAVE_ACCENT_BITS);
+#endif
+#ifdef DEADKEY_TILDE
+	add_layout_deadkey(DEADKEY_TILDE, TILDE_BITS);
+#endif
+#ifdef DEADKEY_DIAERESIS
+	add_layout_deadkey(DEADKEY_DIAERESIS, DIAERESIS_BITS);
+#endif
+#ifdef DEADKEY_CEDILLA
+	add_layout_deadkey(DEADKEY_CEDILLA, CEDILLA_BITS);
+#endif
+#ifdef DEADKEY_RING_ABOVE
+	add_layout_deadkey(DEADKEY_RING_ABOVE, RING_ABOVE_BITS);
+#endif
+	default_layout_built = true;
+	return &default_layout;
+}
+
 uint16_t KeyboardController::convert_to_unicode(uint32_t mod, uint32_t key)
 {
 	// WIP: special keys
-	// TODO: dead key sequences
-
 
 	if (key & SHIFT_MASK) {
 		// Many of these keys will look like they are other keys with shift mask...
@@ -382,23 +532,29 @@ uint16_t KeyboardController::convert_to_unicode(uint32_t mod, uint32_t key)
 
 	// If we made it here without doing something then return 0;
 	if (key & SHIFT_MASK) return 0;
-
-	if ((mod & 0x02) || (mod & 0x20)) key |= SHIFT_MASK;
-	if (leds_.capsLock) key ^= SHIFT_MASK;		// Caps lock will switch the Shift;
-	for (int i=0; i < 96; i++) {
-		if (keycodes_ascii[i] == key) {
-			if ((mod & 1) || (mod & 0x10)) return (i+32) & 0x1f;	// Control key is down
-			return i + 32;
+	if (key >= 64) return 0;
+
+	if (!layout_) layout_ = defaultLayout();
+	uint32_t mclass = ((mod & 0x02) || (mod & 0x20)) ? 1 : 0;
+	if (leds_.capsLock) mclass ^= 1;		// Caps lock will switch the Shift;
+	if (mod & 0x40) mclass |= 2;		// Right Alt is AltGr
+	uint32_t ch = layout_->keys[mclass][key];
+	if (ch == 0 && mclass >= 2) ch = layout_->keys[mclass & 1][key]; // no AltGr meaning
+	if (ch > 0 && ch < 8) {
+		dead_key_ = ch;		// dead key, wait for the next key
+		return 0;
+	}
+	if (dead_key_) {
+		uint32_t code = (dead_key_ << 8) | (mclass << 6) | key;
+		dead_key_ = 0;
+		for (uint32_t i=0; i < layout_->deadkey_count; i++) {
+			if (layout_->deadkeys[i].code == code) return layout_->deadkeys[i].ch;
 		}
 	}
-
-
-#ifdef ISO_8859_1_A0
-	for (int i=0; i < 96; i++) {
-		if (keycodes_iso_8859_1[i] == key) return i + 160;
+	if (ch >= 32 && ch < 128 && ((mod & 1) || (mod & 0x10))) {
+		return ch & 0x1f;	// Control key is down
 	}
-#endif
-	return 0;
+	return ch;
 }
 
 void KeyboardController::LEDS(uint8_t leds) {
@@ -413,6 +569,12 @@ void KeyboardController::updateLEDS() {
 		// Only do it this way if we are a standard USB device
 		mk_setup(setup, 0x21, 9, 0x200, 0, sizeof(leds_.byte)); // hopefully this sets leds
 		queue_Control_Transfer(device, &setup, &leds_.byte, this);
+	} else if (hiddriver_ != nullptr) {
+		// N-key rollover keyboard, LED page Output report
+		for (uint32_t i=0; i < 5; i++) {
+			hiddriver_->setOutput(0x80001 + i, (leds_.byte >> i) & 1);
+		}
+		hiddriver_->sendOutput();
 	} else {
 		// Bluetooth, need to setup back channel to Bluetooth controller. 
 	}
@@ -424,6 +586,7 @@ void KeyboardController::updateLEDS() {
 
 #define TOPUSAGE_SYS_CONTROL 	0x10080
 #define TOPUSAGE_CONSUMER_CONTROL	0x0c0001
+#define TOPUSAGE_KEYBOARD	0x10006
 
 hidclaim_t KeyboardController::claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage)
 {
@@ -431,13 +594,17 @@ hidclaim_t KeyboardController::claim_collection(USBHIDParser *driver, Device_t *
 	//USBHDBGSerial.printf("KBH Claim %x\n", topusage);
 	if ((topusage != TOPUSAGE_SYS_CONTROL) 
 		&& (topusage != TOPUSAGE_CONSUMER_CONTROL)
+		&& (topusage != TOPUSAGE_KEYBOARD)
 		) return CLAIM_NO;
 	// only claim from one physical device
 	//USBHDBGSerial.println("KeyboardController claim collection");
 	// Lets only claim if this is the same device as claimed Keyboard... 
-	if (dev != device) return CLAIM_NO;
+	// except N-key rollover keyboards without a boot interface
+	if (dev != device && !(topusage == TOPUSAGE_KEYBOARD && device == nullptr
+	  && btdevice == nullptr)) return CLAIM_NO;
 	if (mydevice != NULL && dev != mydevice) return CLAIM_NO;
 	mydevice = dev;
+	if (topusage == TOPUSAGE_KEYBOARD) hiddriver_ = driver;
 	collections_claimed_++;
 	return CLAIM_REPORT;
 }
@@ -446,12 +613,19 @@ void KeyboardController::disconnect_collection(Device_t *dev)
 {
 	if (--collections_claimed_ == 0) {
 		mydevice = NULL;
+		hiddriver_ = nullptr;
+		memset(hid_keys, 0, sizeof(hid_keys));
+		if (device == nullptr) memset(keys_reported, 0, sizeof(keys_reported));
 	}
 }
 
 void KeyboardController::hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax)
 {
 	//USBHDBGSerial.printf("KPC:hid_input_begin TUSE: %x TYPE: %x Range:%x %x\n", topusage, type, lgmin, lgmax);
+	// begin may come before each field, but end only once per report
+	if (!hid_input_begin_ && topusage == TOPUSAGE_KEYBOARD) {
+		memset(hid_keys_new, 0, sizeof(hid_keys_new));
+	}
 	topusage_ = topusage;	// remember which report we are processing. 
 	hid_input_begin_ = true;
 	hid_input_data_ = false;
@@ -459,6 +633,16 @@ void KeyboardController::hid_input_begin(uint32_t topusage, uint32_t type, int l
 
 void KeyboardController::hid_input_data(uint32_t usage, int32_t value)
 {
+	if (topusage_ == TOPUSAGE_KEYBOARD) {
+		// bitmap or array, either way gather the keys which are down.
+		// Empty array slots are key 0, and 2 and 3 are error codes.
+		// Only ErrorRollOver (1) is kept, for hid_input_end().
+		uint32_t key = usage & 0xffff;
+		if ((usage >> 16) == 7 && (key == 1 || (key >= 4 && key < 256)) && value) {
+			hid_keys_new[key >> 5] |= (1 << (key & 31));
+		}
+		return;
+	}
 	// Hack ignore 0xff00 high words as these are user values... 
 	if ((usage & 0xffff0000) == 0xff000000) return; 
 	//USBHDBGSerial.printf("KeyboardController: topusage= %x usage=%X, value=%d\n", topusage_, usage, value);
@@ -501,6 +685,13 @@ void KeyboardController::hid_input_data(uint32_t usage, int32_t value)
 void KeyboardController::hid_input_end()
 {
 	//USBHDBGSerial.println("KPC:hid_input_end");
+	if (hid_input_begin_ && topusage_ == TOPUSAGE_KEYBOARD) {
+		hid_input_begin_ = false;
+		if (hid_keys_new[0] & 2) return; // ErrorRollOver, keep prior state
+		memcpy(hid_keys, hid_keys_new, sizeof(hid_keys));
+		update_keys();
+		return;
+	}
 	if (hid_input_begin_) {
 
 		// See if we received any data from parser if not, assume all keys released... 
@@ -566,20 +757,8 @@ bool KeyboardController::process_bluetooth_HID_data(const uint8_t *data, uint16_
 	if (data[0] != 1) return false;
 	print("  KB Data: ");
 	print_hexbytes(data, length);
-	for (int i=2; i < length; i++) {
-		uint32_t key = prev_report[i];
-		if (key >= 4 && !contains(key, report)) {
-			key_release(prev_report[0], key);
-		}
-	}
-	for (int i=2; i < 8; i++) {
-		uint32_t key = data[i];
-		if (key >= 4 && !contains(key, prev_report)) {
-			key_press(data[1], key);
-		}
-	}
-	// Save away the data.. But shift down one byte... Don't need the report number
-	memcpy(prev_report, &data[1], 8);
+	// Same as the boot report, after the report number
+	if (length > 1 && boot_report_to_keys(&data[1], length - 1)) update_keys();
 	return true;
 }
 
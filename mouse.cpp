@@ -40,6 +40,8 @@ hidclaim_t MouseController::claim_collection(USBHIDParser *driver, Device_t *dev
 	if (mydevice != NULL && dev != mydevice) return CLAIM_NO;
 	mydevice = dev;
 	collections_claimed++;
+	driver_ = driver;
+	resolution_pending_ = true;
 	return CLAIM_REPORT;
 }
 
@@ -47,12 +49,17 @@ void MouseController::disconnect_collection(Device_t *dev)
 {
 	if (--collections_claimed == 0) {
 		mydevice = NULL;
+		driver_ = nullptr;
+		wheel_multiplier = 1;
+		wheel_remainder[0] = 0;
+		wheel_remainder[1] = 0;
 	}
 }
 
 void MouseController::hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax)
 {
-	// TODO: check if absolute coordinates
+	// Relative (bit 2) motion is summed, absolute positions are stored
+	relative_ = (type & 0x04) != 0;
 	hid_input_begin_ = true;
 }
 
@@ -70,27 +77,36 @@ void MouseController::hid_input_data(uint32_t usage, int32_t value)
 	} else if (usage_page == 1) {
 		switch (usage) {
 		  case 0x30:
-			mouseX = value;
+			set_motion(MOTION_X, value);
 			break;
 		  case 0x31:
-			mouseY = value;
+			set_motion(MOTION_Y, value);
 			break;
 		  case 0x32: // Apple uses this for horizontal scroll
-			wheelH = value;
+			if (relative_) add_wheel(1, value);
+			else set_motion(MOTION_WHEELH, value);
 			break;
 		  case 0x38:
-			wheel = value;
+			if (relative_) add_wheel(0, value);
+			else set_motion(MOTION_WHEEL, value);
 			break;
 		}
 	} else if (usage_page == 12) {
 		if (usage == 0x238) { // Microsoft uses this for horizontal scroll
-			wheelH = value;
+			if (relative_) add_wheel(1, value);
+			else set_motion(MOTION_WHEELH, value);
 		}
 	}
 }
 
 void MouseController::hid_input_end()
 {
+	if (resolution_pending_ && driver_) {
+		// Once the fields are known, ask for the high resolution wheel.
+		// A report or two may still arrive at the old resolution.
+		resolution_pending_ = false;
+		wheel_multiplier = driver_->enableResolutionMultiplier();
+	}
 	if (hid_input_begin_) {
 		mouseEvent = true;
 		hid_input_begin_ = false;
@@ -98,7 +114,63 @@ void MouseController::hid_input_end()
 }
 
 void MouseController::mouseDataClear() {
-	mouseEvent = false;
+	__disable_irq();
+	// keep any motion which arrived after it was read
+	bool more = false;
+	for (uint32_t i=0; i < MOTION_COUNT; i++) {
+		if (motion_absolute & (1 << i)) {
+			// a position, which stays until the next one arrives
+		} else if (motion_read & (1 << i)) {
+			motion[i] -= motion_seen[i];
+			if (motion[i]) more = true;
+		} else {
+			motion[i] = 0;
+		}
+	}
+	motion_read = 0;
+	mouseEvent = more;
+	__enable_irq();
+}
+
+int MouseController::read_motion(uint32_t axis)
+{
+	int32_t n = motion[axis];
+	motion_seen[axis] = n;
+	motion_read |= (1 << axis);
+	return n;
+}
+
+// Called from the USB interrupt.  Saturate rather than wrap, so a sketch
+// which reads rarely sees a large motion in the right direction.
+void MouseController::add_motion(uint32_t axis, int32_t value)
+{
+	int64_t n = value;
+	if (!(motion_absolute & (1 << axis))) n += motion[axis];
+	if (n > INT32_MAX) n = INT32_MAX;
+	else if (n < INT32_MIN) n = INT32_MIN;
+	motion[axis] = n;
+	motion_absolute &= ~(1 << axis);
+}
+
+// Wheel counts are kept as given, and also as whole detents, carrying
+// the fraction to the next report.
+void MouseController::add_wheel(uint32_t which, int32_t value)
+{
+	add_motion(MOTION_WHEEL_HIRES + which, value);
+	int32_t n = wheel_remainder[which] + value;
+	int32_t detents = n / (int32_t)wheel_multiplier;
+	wheel_remainder[which] = n - detents * (int32_t)wheel_multiplier;
+	if (detents) add_motion(MOTION_WHEEL + which, detents);
+}
+
+void MouseController::set_motion(uint32_t axis, int32_t value)
+{
+	if (relative_) {
+		add_motion(axis, value);
+	} else {
+		motion[axis] = value;
+		motion_absolute |= (1 << axis);
+	}
 }
 
 
@@ -142,12 +214,12 @@ bool MouseController::process_bluetooth_HID_data(const uint8_t *data, uint16_t l
 	// Looks like report 2 is for the mouse info.
 	if (data[0] != 2) return false;
 	buttons = data[1];
-	mouseX  = (int8_t)data[2];
-	mouseY  = (int8_t)data[3];
+	add_motion(MOTION_X, (int8_t)data[2]);
+	add_motion(MOTION_Y, (int8_t)data[3]);
 	if (length >= 5) {
-		wheel   = (int8_t)data[4];
+		add_wheel(0, (int8_t)data[4]);
 		if (length >= 6) {
-			wheelH = (int8_t)data[5];
+			add_wheel(1, (int8_t)data[5]);
 		}
 	}
 	mouseEvent = true;
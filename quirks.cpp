@@ -0,0 +1,114 @@
+/* USB EHCI Host for Teensy 3.6
+ * Copyright 2017 Paul Stoffregen (paul@pjrc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <Arduino.h>
+#include "USBHost_t36.h"  // Read this header first for key info
+
+
+// Devices which need a specific driver or special handling, found by
+// VID/PID.  Keep this list sorted by vidpid, then driver: find_quirk()
+// hashes the vendor to its first entry, so claiming a device costs a
+// few compares rather than a scan of every driver's own list.
+static constexpr usb_quirk_t quirk_list[] = {
+	{0x04036001, QUIRK_DRIVER_SERIAL, USBSerialBase::FTDI, 0},
+	{0x04038088, QUIRK_DRIVER_SERIAL, USBSerialBase::FTDI, QUIRK_CLAIM_INTERFACE},
+	{0x045E028E, QUIRK_DRIVER_JOYSTICK, JoystickController::SWITCH, 0},
+	{0x045E02DD, QUIRK_DRIVER_JOYSTICK, JoystickController::XBOXONE, 0},
+	{0x045E02EA, QUIRK_DRIVER_JOYSTICK, JoystickController::XBOXONE, QUIRK_XBOXONE_S_INIT},
+	{0x045E0719, QUIRK_DRIVER_JOYSTICK, JoystickController::XBOX360, 0},
+	{0x045E0B00, QUIRK_DRIVER_JOYSTICK, JoystickController::UNKNOWN, QUIRK_XBOXONE_S_INIT},
+	{0x046DC626, QUIRK_DRIVER_JOYSTICK, JoystickController::SpaceNav, QUIRK_HID_DEVICE},
+	{0x046DC628, QUIRK_DRIVER_JOYSTICK, JoystickController::SpaceNav, QUIRK_HID_DEVICE},
+	{0x04D90000, QUIRK_DRIVER_KEYBOARD, 0, QUIRK_FORCE_BOOT_PROTOCOL},
+	{0x054C0268, QUIRK_DRIVER_HID, 0, QUIRK_PS3_FEATURE_F4},
+	{0x054C0268, QUIRK_DRIVER_JOYSTICK, JoystickController::PS3, QUIRK_HID_DEVICE},
+	{0x054C03D5, QUIRK_DRIVER_JOYSTICK, JoystickController::PS3_MOTION, QUIRK_HID_DEVICE},
+	{0x054C042F, QUIRK_DRIVER_HID, 0, QUIRK_PS3_FEATURE_F4},
+	{0x054C042F, QUIRK_DRIVER_JOYSTICK, JoystickController::PS3, QUIRK_HID_DEVICE}, // Navigation
+	{0x054C05C4, QUIRK_DRIVER_JOYSTICK, JoystickController::PS4, QUIRK_HID_DEVICE},
+	{0x054C09CC, QUIRK_DRIVER_JOYSTICK, JoystickController::PS4, QUIRK_HID_DEVICE},
+	{0x067B2303, QUIRK_DRIVER_SERIAL, USBSerialBase::PL2303, 0},
+	{0x0A5C21E8, QUIRK_DRIVER_BLUETOOTH, 0, 0}, // class 255/1/1, not 0xE0
+	{0x0E6F0000, QUIRK_DRIVER_JOYSTICK, JoystickController::UNKNOWN, QUIRK_XBOXONE_PDP_INIT},
+	{0x10C4EA60, QUIRK_DRIVER_SERIAL, USBSerialBase::CP210X, 0},
+	{0x1A865523, QUIRK_DRIVER_SERIAL, USBSerialBase::CH341, 0},
+	{0x1A867523, QUIRK_DRIVER_SERIAL, USBSerialBase::CH341, 0},
+	{0x43485523, QUIRK_DRIVER_SERIAL, USBSerialBase::CH341, 0}
+};
+
+#define QUIRK_COUNT (sizeof(quirk_list) / sizeof(quirk_list[0]))
+
+// A perfect hash of the vendors in quirk_list, made by the compiler.
+// slot[QUIRK_HASH(idVendor)] is 1 + the index of the vendor's first
+// entry, 0 when no vendor in the list has that hash, or QUIRK_SHARED
+// when two do.  Change the multiplier if a new vendor shares a slot.
+#define QUIRK_HASH(vid) ((uint16_t)((vid) * 0x9E37) >> 11)
+#define QUIRK_SHARED 0xFF
+typedef struct {
+	uint8_t slot[32];
+} quirk_hash_t;
+
+static constexpr quirk_hash_t make_quirk_hash()
+{
+	quirk_hash_t h = {};
+	for (uint32_t i=0; i < QUIRK_COUNT; i++) {
+		uint16_t vid = quirk_list[i].vidpid >> 16;
+		if (i > 0 && (quirk_list[i - 1].vidpid >> 16) == vid) continue;
+		uint8_t &slot = h.slot[QUIRK_HASH(vid)];
+		slot = (slot == 0) ? i + 1 : QUIRK_SHARED;
+	}
+	return h;
+}
+static constexpr quirk_hash_t quirk_hash = make_quirk_hash();
+
+// Returns the quirk entry for this device and driver, or NULL
+const usb_quirk_t * USBHost::find_quirk(uint16_t idVendor, uint16_t idProduct, uint8_t driver)
+{
+	uint32_t lo = quirk_hash.slot[QUIRK_HASH(idVendor)];
+	if (lo == 0) return NULL;
+	if (lo == QUIRK_SHARED) {
+		// binary search for the vendor's first entry
+		uint32_t vendor = (uint32_t)idVendor << 16;
+		uint32_t hi = QUIRK_COUNT;
+		lo = 0;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			if (quirk_list[mid].vidpid < vendor) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+	} else {
+		lo--;
+	}
+	// then its few products, with idProduct 0 for all the others
+	const usb_quirk_t *all = NULL;
+	for (const usb_quirk_t *q = &quirk_list[lo]; q < &quirk_list[QUIRK_COUNT]; q++) {
+		if ((q->vidpid >> 16) != idVendor) break;
+		if (q->driver != driver) continue;
+		if ((uint16_t)q->vidpid == idProduct) return q;
+		if ((uint16_t)q->vidpid == 0) all = q;
+	}
+	return all;
+}
@@ -57,6 +57,11 @@ void RawHIDController::disconnect_collection(Device_t *dev)
 	if (--collections_claimed == 0) {
 		mydevice = NULL;
 		usage_ = 0;
+		// transfers in flight are gone with the device
+		__disable_irq();
+		tx_tail_ = tx_next_ = tx_head_;
+		tx_active_ = 0;
+		__enable_irq();
 	}
 }
 
@@ -66,6 +71,23 @@ bool RawHIDController::hid_process_in_data(const Transfer_t *transfer)
 	USBHDBGSerial.printf("RawHIDController::hid_process_in_data: %x\n", usage_);
 #endif
 
+	if (rx_queue_) {
+		uint32_t head = rx_head_ + 1;
+		if (head >= rx_count_) head = 0;
+		if (head == rx_tail_) {
+			rx_overruns_++; // full, drop the newest packet
+			return true;
+		}
+		uint32_t len = transfer->length;
+		if (len > MAX_PACKET_SIZE) {
+			len = MAX_PACKET_SIZE;
+			rx_truncated_++;
+		}
+		memcpy(rx_queue_[head].data, transfer->buffer, len);
+		rx_queue_[head].len = len;
+		rx_head_ = head;
+		return true;
+	}
 	if (receiveCB) {
 		return (*receiveCB)(usage_, (const uint8_t *)transfer->buffer, transfer->length);
 	}
@@ -77,13 +99,95 @@ bool RawHIDController::hid_process_out_data(const Transfer_t *transfer)
 #ifdef USBHOST_PRINT_DEBUG
 	USBHDBGSerial.printf("RawHIDController::hid_process_out_data: %x\n", usage_);
 #endif
+	if (tx_queue_ && tx_active_ && (const uint8_t *)transfer->buffer
+	  == tx_queue_[tx_tail_ + 1 < tx_count_ ? tx_tail_ + 1 : 0].data) {
+		// OUT transfers complete in order, so this is the oldest
+		uint32_t tail = tx_tail_ + 1;
+		if (tail >= tx_count_) tail = 0;
+		tx_tail_ = tail;
+		tx_active_--;
+		tx_submit();
+	}
 	return true;
 }
 
 bool RawHIDController::sendPacket(const uint8_t *buffer) 
 {
 	if (!driver_) return false;
-	return driver_->sendPacket(buffer);
+	if (!tx_queue_) return driver_->sendPacket(buffer);
+	uint32_t head = tx_head_ + 1;
+	if (head >= tx_count_) head = 0;
+	if (head == tx_tail_) {
+		tx_overruns_++;
+		return false;
+	}
+	uint32_t len = driver_->outSize();
+	if (len > MAX_PACKET_SIZE) {
+		len = MAX_PACKET_SIZE;
+		tx_truncated_++;
+	}
+	memcpy(tx_queue_[head].data, buffer, len);
+	tx_queue_[head].len = len;
+	__disable_irq();
+	tx_head_ = head;
+	tx_submit();
+	__enable_irq();
+	return true;
+}
+
+// Keep up to TX_IN_FLIGHT packets queued on the OUT pipe.  Called with
+// interrupts disabled, or from the USB interrupt.
+void RawHIDController::tx_submit()
+{
+	while (tx_active_ < TX_IN_FLIGHT && tx_next_ != tx_head_ && driver_) {
+		uint32_t next = tx_next_ + 1;
+		if (next >= tx_count_) next = 0;
+		if (!driver_->sendPacketInPlace(tx_queue_[next].data, tx_queue_[next].len)) break;
+		tx_next_ = next;
+		tx_active_++;
+	}
+}
+
+void RawHIDController::attachRxQueue(packet_t *buffer, uint16_t count)
+{
+	__disable_irq();
+	rx_queue_ = (buffer && count > 1) ? buffer : nullptr;
+	rx_count_ = count;
+	rx_head_ = 0;
+	rx_tail_ = 0;
+	__enable_irq();
+}
+
+void RawHIDController::attachTxQueue(packet_t *buffer, uint16_t count)
+{
+	__disable_irq();
+	if (tx_active_ == 0) {
+		tx_queue_ = (buffer && count > 1) ? buffer : nullptr;
+		tx_count_ = count;
+		tx_head_ = tx_next_ = tx_tail_ = 0;
+	}
+	__enable_irq();
+}
+
+uint32_t RawHIDController::packetsAvailable()
+{
+	uint32_t head = rx_head_;
+	uint32_t tail = rx_tail_;
+	if (head >= tail) return head - tail;
+	return rx_count_ + head - tail;
+}
+
+// Copy the oldest received packet, returns its length or 0 if none
+uint32_t RawHIDController::readPacket(uint8_t *buffer, uint32_t size)
+{
+	uint32_t tail = rx_tail_;
+	if (!rx_queue_ || tail == rx_head_) return 0;
+	if (++tail >= rx_count_) tail = 0;
+	uint32_t len = rx_queue_[tail].len;
+	if (len > size) len = size;
+	memcpy(buffer, rx_queue_[tail].data, len);
+	rx_tail_ = tail;
+	return len;
 }
 
 
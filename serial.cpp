@@ -39,27 +39,6 @@
 #define debugDigitalWrite(pin, state) {;}
 #endif
 
-/************************************************************/
-//  Define mapping VID/PID - to Serial Device type.
-/************************************************************/
-USBSerialBase::product_vendor_mapping_t USBSerialBase::pid_vid_mapping[] = {
-	// FTDI mappings. 
-	{0x0403, 0x6001, USBSerialBase::FTDI, 0},
-	{0x0403, 0x8088, USBSerialBase::FTDI, 1},  // 2 devices try to claim at interface level
-
-	// PL2303
-	{0x67B,0x2303, USBSerialBase::PL2303, 0}, 
-
-	// CH341
-	{0x4348, 0x5523, USBSerialBase::CH341, 0},
-	{0x1a86, 0x7523, USBSerialBase::CH341, 0 },
-	{0x1a86, 0x5523, USBSerialBase::CH341, 0 },
-
-	// Silex CP210...
-	{0x10c4, 0xea60, USBSerialBase::CP210X, 0 }
-};
-
-
 /************************************************************/
 //  Initialization and claiming of devices & interfaces
 /************************************************************/
@@ -223,16 +202,14 @@ bool USBSerialBase::claim(Device_t *dev, int type, const uint8_t *descriptors, u
 	// Else lets see if this is a PID/VID we know something about.
 	// See if the vendor_id:product_id is in our list of products.
 	sertype = UNKNOWN;
-	for (uint8_t i = 0; i < (sizeof(pid_vid_mapping)/sizeof(pid_vid_mapping[0])); i++) {
-		if ((dev->idVendor == pid_vid_mapping[i].idVendor) && (dev->idProduct == pid_vid_mapping[i].idProduct)) {
-			sertype = pid_vid_mapping[i].sertype;
-			if (pid_vid_mapping[i].claim_at_type != type) {
-				println("Serial device wants to map at interface level");
-				return false;
-			}
-			break;
+	const usb_quirk_t *q = find_quirk(dev->idVendor, dev->idProduct, QUIRK_DRIVER_SERIAL);
+	if (q) {
+		sertype = (sertype_t)q->type;
+		if (((q->flags & QUIRK_CLAIM_INTERFACE) ? 1 : 0) != type) {
+			println("Serial device wants to map at interface level");
+			return false;
 		}
-	}  
+	}
 	if (sertype == UNKNOWN) {
 		// Not in our list see if CDCACM type...
 		// only at the Interface level
@@ -0,0 +1,167 @@
+// A high speed HID device sending a report every 125 us microframe, with
+// the USB interrupt sometimes slower than that.  The EHCI controller only
+// takes a report into a transfer which is queued.  While the interrupt is
+// busy with one report, its buffer isn't queued, so the parser keeps
+// IN_REPORT_COUNT transfers queued for the reports meanwhile.
+//
+// Each report holds a 16 bit count.  The device keeps one report; when
+// a microframe passes with no transfer queued to take it, the next one
+// replaces it and a report is lost.  The driver must receive every other
+// report once, in order.  Loss is printed for 1 and 2 queued transfers
+// too, for comparison; the parser had 2 before.
+
+#include "host.h"
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+
+// Vendor defined, one 16 bit count in an 8 byte report
+static const uint8_t counter_desc[] = {
+	0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x09, 0x20, 0x15, 0x00,
+	0x27, 0xFF, 0xFF, 0x00, 0x00, 0x75, 0x10, 0x95, 0x01, 0x81, 0x02,
+	0x75, 0x08, 0x95, 0x06, 0x81, 0x01, 0xC0
+};
+
+// Records the counts it receives
+class Counter : public USBHIDInput {
+public:
+	Counter() { USBHIDParser::driver_ready_for_hid_collection(this); }
+	uint32_t received = 0;
+	uint32_t last = 0;
+	uint32_t out_of_order = 0;
+protected:
+	hidclaim_t claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage) {
+		if (topusage != 0xFF000001) return CLAIM_NO;
+		mydevice = dev;
+		return CLAIM_REPORT;
+	}
+	void hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax) { }
+	void hid_input_data(uint32_t usage, int32_t value) {
+		if (usage != 0xFF000020) return;
+		if (received && (uint32_t)value <= last) out_of_order++;
+		last = value;
+		received++;
+	}
+	void hid_input_end() { }
+	void disconnect_collection(Device_t *dev) { mydevice = nullptr; }
+};
+Counter counter;
+
+static int errors = 0;
+#define CHECK(cond) do { if (!(cond)) { \
+	printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); errors++; } } while (0)
+
+// The same for each report however many transfers are queued, so the
+// runs differ only by the reports lost
+static uint32_t rnd(uint32_t n, uint32_t lo, uint32_t hi)
+{
+	uint32_t h = n * 2654435761u;
+	h ^= h >> 15;
+	return lo + h % (hi - lo + 1);
+}
+
+// Time the USB interrupt takes for report n, in us
+typedef uint32_t (*isr_time_t)(uint32_t n);
+static uint32_t isr_fast(uint32_t n) { return 10; }
+static uint32_t isr_jitter(uint32_t n) { return rnd(n, 40, 200); }	// 120 average
+static uint32_t isr_stall300(uint32_t n) { return (n % 100 == 99) ? 300 : 15; }
+static uint32_t isr_stall400(uint32_t n) { return (n % 100 == 99) ? 400 : 15; }
+static uint32_t isr_slow(uint32_t n) { return rnd(n, 100, 145); }	// 122.5 average
+
+static uint32_t count(const uint8_t *report)
+{
+	return report[0] | (report[1] << 8);
+}
+
+typedef struct {
+	uint32_t sent;		// reports the device made
+	uint32_t lost;		// replaced before a transfer took them
+	uint32_t received;
+} result_t;
+
+// One second at 8000 reports per second.  buffers is how many transfers
+// the parser keeps, at most IN_REPORT_COUNT.
+static result_t run(uint32_t buffers, isr_time_t isr_time)
+{
+	result_t r = {0, 0, 0};
+	CHECK(host_hid_attach(&hid1, 0x16C0, 0x0480, counter_desc, sizeof(counter_desc), 8) != NULL);
+	CHECK(host_queued(hid1.in_pipe) == USBHIDParser::IN_REPORT_COUNT);
+	counter.received = counter.out_of_order = 0;
+
+	// reports the controller has taken, which the interrupt hasn't finished
+	static uint8_t taken[8][8];
+	uint32_t taken_head = 0, taken_count = 0;
+	uint32_t isr_end = 0;		// when the interrupt finishes the oldest taken
+	bool held = false;		// the device has a report
+	uint8_t report[8];
+	uint32_t n = 0;
+
+	const uint32_t frames = 8000;
+	for (uint32_t frame=0; frame <= frames + 8; frame++) {
+		uint32_t t = frame * 125;
+		// the interrupt finishes each report in turn, queuing its buffer again
+		while (taken_count && (int32_t)(isr_end - t) <= 0) {
+			CHECK(host_complete_data(hid1.in_pipe, taken[taken_head], 8));
+			taken_head = (taken_head + 1) % 8;
+			if (--taken_count) isr_end += isr_time(count(taken[taken_head]));
+			r.received++;
+		}
+		// the harness still counts the taken ones, which the interrupt
+		// completes, and each is queued again when it's done
+		CHECK(host_queued(hid1.in_pipe) == USBHIDParser::IN_REPORT_COUNT);
+		// the controller polls the device, if a transfer is queued
+		if (held && taken_count < buffers) {
+			memcpy(taken[(taken_head + taken_count) % 8], report, 8);
+			if (taken_count++ == 0) isr_end = t + isr_time(count(report));
+			held = false;
+		}
+		// the device makes its next report
+		if (frame < frames) {
+			if (held) r.lost++;
+			memset(report, 0, sizeof(report));
+			report[0] = n;
+			report[1] = n >> 8;
+			n++;
+			held = true;
+			r.sent++;
+		}
+		host_advance(125);
+	}
+	CHECK(!held && taken_count == 0);
+	CHECK(r.sent == r.received + r.lost);
+	CHECK(counter.received == r.received);
+	CHECK(counter.out_of_order == 0);
+	host_hid_detach(&hid1);
+	return r;
+}
+
+int main()
+{
+	if (getenv("HOST_DEBUG")) Serial.echo = true;
+	static const struct {
+		const char *name;
+		isr_time_t isr_time;
+		bool behind_2;		// never more than 2 reports behind
+	} loads[] = {
+		{"10 us", isr_fast, true},
+		{"15 us, 300 us every 100", isr_stall300, true},
+		{"15 us, 400 us every 100", isr_stall400, false},
+		{"100 to 145 us", isr_slow, false},
+		{"40 to 200 us", isr_jitter, false},
+	};
+	for (const auto &load : loads) {
+		result_t r[4];
+		for (uint32_t buffers=1; buffers <= USBHIDParser::IN_REPORT_COUNT; buffers++) {
+			r[buffers] = run(buffers, load.isr_time);
+		}
+		printf("interrupt %s: %u reports, lost %u with 1 transfer, %u with 2, %u with %u\n",
+			load.name, r[1].sent, r[1].lost, r[2].lost, r[3].lost,
+			USBHIDParser::IN_REPORT_COUNT);
+		// more queued transfers never lose more
+		CHECK(r[3].lost <= r[2].lost && r[2].lost <= r[1].lost);
+		// and none are lost unless the interrupt is more than 2 reports behind
+		if (load.behind_2) CHECK(r[3].lost == 0);
+	}
+	if (errors) printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+// The static bit field helpers in hid.cpp, checked against one bit at a
+// time for every bit position 0 to 63 and every size 1 to 32, both with
+// the field at the end of the data and with 8 bytes or more left.  The
+// data ends at a page the process can't read, so reading past its end
+// crashes the test.  Also times bitfield() against the byte loop it
+// replaced, on a 30 field joystick report.
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include "host.h"
+#include "../hid.cpp"
+
+static int errors = 0;
+
+static uint32_t bitfield_reference(const uint8_t *data, uint32_t bitindex, uint32_t numbits)
+{
+	uint32_t n = 0;
+	for (uint32_t i=0; i < numbits; i++) {
+		uint32_t b = bitindex + i;
+		if (data[b >> 3] & (1 << (b & 7))) n |= (uint32_t)1 << i;
+	}
+	return n;
+}
+
+// bitfield() before it loaded whole words
+static uint32_t bitfield_byteloop(const uint8_t *data, uint32_t len, uint32_t bitindex, uint32_t numbits)
+{
+	uint32_t output = 0;
+	uint32_t bitcount = 0;
+	data += (bitindex >> 3);
+	uint32_t offset = bitindex & 7;
+	if (offset) {
+		output = (*data++) >> offset;
+		bitcount = 8 - offset;
+	}
+	while (bitcount < numbits) {
+		output |= (uint32_t)(*data++) << bitcount;
+		bitcount += 8;
+	}
+	if (bitcount > numbits && numbits < 32) {
+		output &= ((1 << numbits) - 1);
+	}
+	return output;
+}
+
+static uint32_t seed = 32;
+static uint8_t rnd8()
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+static void fill(uint8_t *buf, uint32_t len, uint32_t pattern)
+{
+	for (uint32_t i=0; i < len; i++) {
+		switch (pattern) {
+		  case 0: buf[i] = 0x00; break;
+		  case 1: buf[i] = 0xFF; break;
+		  case 2: buf[i] = 0x55; break;
+		  case 3: buf[i] = 0xAA; break;
+		  case 4: buf[i] = i * 0x11 + 1; break;
+		  default: buf[i] = rnd8();
+		}
+	}
+}
+
+static void test_bitfield(uint8_t *page_end)
+{
+	uint8_t data[16];
+	uint32_t count = 0;
+	for (uint32_t pattern=0; pattern < 40; pattern++) {
+		for (uint32_t bitindex=0; bitindex < 64; bitindex++) {
+			for (uint32_t numbits=1; numbits <= 32; numbits++) {
+			  for (uint32_t end=0; end < 2; end++) {
+				// the data's last byte is the last readable byte, either
+				// the field's last byte or 8 from the field's first
+				uint32_t len = (bitindex + numbits + 7) >> 3;
+				if (end) len = (bitindex >> 3) + 8;
+				uint8_t *p = page_end - len;
+				fill(data, len, pattern);
+				memcpy(p, data, len);
+				uint32_t expect = bitfield_reference(p, bitindex, numbits);
+				uint32_t n = bitfield(p, len, bitindex, numbits);
+				if (n != expect) {
+					if (errors++ < 10) printf("bitfield(%u, %u, %u) = %08X, expected %08X\n",
+						len, bitindex, numbits, n, expect);
+				}
+				int32_t s = signext(n, numbits);
+				int64_t sexpect = (expect & ((uint64_t)1 << (numbits - 1)))
+					? (int64_t)expect - ((int64_t)1 << numbits) : expect;
+				if (s != sexpect) {
+					if (errors++ < 10) printf("signext(%08X, %u) = %d, expected %lld\n",
+						n, numbits, s, (long long)sexpect);
+				}
+				count++;
+			  }
+			}
+		}
+	}
+	printf("bitfield: %u fields checked\n", count);
+}
+
+static void test_setbitfield()
+{
+	uint32_t count = 0;
+	for (uint32_t pattern=0; pattern < 10; pattern++) {
+		for (uint32_t bitindex=0; bitindex < 64; bitindex++) {
+			for (uint32_t numbits=1; numbits <= 32; numbits++) {
+				uint8_t before[12], after[12];
+				fill(before, sizeof(before), pattern);
+				memcpy(after, before, sizeof(after));
+				uint32_t value = ((uint32_t)rnd8() << 24) | (rnd8() << 16) | (rnd8() << 8) | rnd8();
+				setbitfield(after, bitindex, numbits, value);
+				uint32_t mask = (numbits < 32) ? ((uint32_t)1 << numbits) - 1 : 0xFFFFFFFF;
+				bool ok = bitfield_reference(after, bitindex, numbits) == (value & mask);
+				// and nothing else changed
+				for (uint32_t b=0; b < sizeof(before) * 8; b++) {
+					if (b >= bitindex && b < bitindex + numbits) continue;
+					if (bitfield_reference(before, b, 1) != bitfield_reference(after, b, 1)) ok = false;
+				}
+				if (!ok && errors++ < 10) {
+					printf("setbitfield(%u, %u, %08X) wrong\n", bitindex, numbits, value);
+				}
+				count++;
+			}
+		}
+	}
+	printf("setbitfield: %u fields checked\n", count);
+}
+
+static void test_logical_max()
+{
+	static const struct { int32_t min, max; uint32_t size; int32_t expect; } t[] = {
+		{0, -1, 8, 255},		// 0x25 0xFF, meant 255
+		{0, -1, 16, 65535},		// 0x26 0xFF 0xFF
+		{0, -1, 32, -1},		// can't hold more, left as given
+		{-127, 127, 8, 127},
+		{-1, -2, 8, -2},		// negative minimum, left as given
+		{1, 0, 4, 15},
+		{0, 1023, 10, 1023},
+	};
+	for (const auto &c : t) {
+		int32_t n = field_logical_max(c.min, c.max, c.size);
+		if (n != c.expect) {
+			printf("field_logical_max(%d, %d, %u) = %d, expected %d\n",
+				c.min, c.max, c.size, n, c.expect);
+			errors++;
+		}
+	}
+}
+
+// A joystick report: 16 bit axes, 10 bit axes, hats, and 1 bit buttons
+typedef struct { uint16_t bitindex; uint8_t size; } field_t;
+static field_t joystick_fields[30] = {
+	{0, 16}, {16, 16}, {32, 16}, {48, 16}, {64, 10}, {74, 10}, {84, 4}, {88, 4},
+	{92, 1}, {93, 1}, {94, 1}, {95, 1}, {96, 1}, {97, 1}, {98, 1}, {99, 1},
+	{100, 1}, {101, 1}, {102, 1}, {103, 1}, {104, 8}, {112, 8}, {120, 12},
+	{132, 12}, {144, 3}, {147, 5}, {152, 24}, {176, 32}, {208, 7}, {215, 9},
+};
+
+typedef uint32_t (*extract_t)(const uint8_t *data, uint32_t len, uint32_t bitindex, uint32_t numbits);
+
+// 16 packed 12 bit axes, as in digitizers and some game controllers
+static field_t packed_fields[30];
+
+// Reports arrive by DMA, so use several prepared reports rather than
+// changing one, which would stall the loads on the stores.
+static uint8_t reports[16][32];
+
+// a template, so the extractor is inlined as in parse_fields()
+template <extract_t extract>
+static double time_extract(const field_t *fields)
+{
+	const uint32_t loops = 20000;
+	volatile uint32_t sink = 0;
+	// as in parse_fields(), the layout is only known at run time
+	asm volatile("" : "+r" (fields));
+	uint64_t t0 = host_nanos();
+	for (uint32_t n=0; n < loops; n++) {
+		const uint8_t *report = reports[n & 15];
+		uint32_t sum = 0;
+		for (uint32_t i=0; i < 30; i++) sum += extract(report, 32, fields[i].bitindex, fields[i].size);
+		sink = sink + sum;
+	}
+	return (double)(host_nanos() - t0) / loops;
+}
+
+static void bench(const char *name, const field_t *fields)
+{
+	double fast = 1e9, slow = 1e9;
+	for (uint32_t round=0; round < 25; round++) {
+		double t = time_extract<bitfield>(fields);
+		if (t < fast) fast = t;
+		t = time_extract<bitfield_byteloop>(fields);
+		if (t < slow) slow = t;
+	}
+	fprintf(stderr, "hid_bitfield: %s, 30 fields in %.1f ns, %.1f ns with the byte loop\n",
+		name, fast, slow);
+}
+
+int main()
+{
+	// two pages, the second not readable
+	long pagesize = sysconf(_SC_PAGESIZE);
+	uint8_t *pages = (uint8_t *)mmap(NULL, pagesize * 2, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pages == MAP_FAILED || mprotect(pages + pagesize, pagesize, PROT_NONE) != 0) {
+		perror("mmap");
+		return 2;
+	}
+	test_bitfield(pages + pagesize);
+	test_setbitfield();
+	test_logical_max();
+	for (uint32_t i=0; i < 16; i++) fill(reports[i], 32, 99);
+	for (uint32_t i=0; i < 30; i++) {
+		packed_fields[i].bitindex = i * 12 % 240;
+		packed_fields[i].size = 12;
+	}
+	bench("joystick", joystick_fields);
+	bench("12 bit axes", packed_fields);
+	if (errors) printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
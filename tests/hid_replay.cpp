@@ -0,0 +1,149 @@
+// Replay a capture through the HID parser, printing every field the
+// drivers receive.  make check compares the output to <capture>.golden.
+//
+// Each report is also given to a second parser which uses the original
+// parse() of the report descriptor instead of the compiled fields, and
+// the two must give the same fields.  The time per report of both is
+// printed to stderr.
+
+#include <string>
+#include "host.h"
+
+// Claims every top level collection, and records what it is given
+class Recorder : public USBHIDInput {
+public:
+	Recorder() { USBHIDParser::driver_ready_for_hid_collection(this); }
+	std::string out;
+	Device_t *claimed = nullptr;
+	// while timing, only a checksum is kept
+	bool timing = false;
+	uint32_t sum = 0;
+protected:
+	hidclaim_t claim_collection(USBHIDParser *driver, Device_t *dev, uint32_t topusage) {
+		if (claimed && claimed != dev) return CLAIM_NO;
+		claimed = dev;
+		mydevice = dev;
+		return CLAIM_REPORT;
+	}
+	void hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax) {
+		if (timing) return;
+		add(" begin %08X type=%X %d..%d\n", topusage, type, lgmin, lgmax);
+	}
+	void hid_input_data(uint32_t usage, int32_t value) {
+		if (timing) {
+			sum = sum * 31 + (usage ^ value);
+			return;
+		}
+		add("  %08X = %d\n", usage, value);
+	}
+	void hid_input_end() {
+		if (timing) return;
+		add(" end\n");
+	}
+	void disconnect_collection(Device_t *dev) {
+		claimed = nullptr;
+		mydevice = nullptr;
+	}
+	void add(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+		char buf[128];
+		va_list ap;
+		va_start(ap, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		out += buf;
+	}
+};
+
+USBHost myusb;
+USBHIDParser fast(myusb);
+USBHIDParser slow(myusb);
+Recorder fast_recorder;
+Recorder slow_recorder;
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s capture.txt\n", argv[0]);
+		return 2;
+	}
+	if (getenv("HOST_DEBUG")) Serial.echo = true;
+	static host_capture_t cap;
+	if (!host_read_capture(argv[1], &cap)) {
+		fprintf(stderr, "%s: no descriptor\n", argv[1]);
+		return 2;
+	}
+	// each recorder claims the collections of one device
+	if (!host_hid_attach(&fast, cap.vid, cap.pid, cap.desc, cap.desclen, cap.in_size)) {
+		fprintf(stderr, "claim failed\n");
+		return 1;
+	}
+	if (!host_hid_attach(&slow, cap.vid, cap.pid, cap.desc, cap.desclen, cap.in_size)) {
+		fprintf(stderr, "claim failed\n");
+		return 1;
+	}
+	// The compiled fields replaced the descriptor.  Give it back to the
+	// second parser, so its reports use parse().
+	slow.descriptor = cap.desc;
+	slow.fields_compiled = false;
+
+	int errors = 0;
+	printf("%s %04X:%04X, %u byte descriptor, %u reports\n",
+		argv[1], cap.vid, cap.pid, cap.desclen, cap.count);
+	uint32_t start = micros();
+	for (uint32_t i=0; i < cap.count; i++) {
+		const host_report_t *r = &cap.reports[i];
+		int32_t wait = start + r->micros - micros();
+		if (wait > 0) host_advance(wait);
+		fast_recorder.out.clear();
+		slow_recorder.out.clear();
+		host_complete_data(fast.in_pipe, r->data, r->len);
+		host_complete_data(slow.in_pipe, r->data, r->len);
+		printf("report %u:", i);
+		for (uint32_t j=0; j < r->len; j++) printf(" %02X", r->data[j]);
+		printf("\n%s", fast_recorder.out.c_str());
+		if (fast_recorder.out != slow_recorder.out) {
+			printf("parse() gave different fields:\n%s", slow_recorder.out.c_str());
+			errors++;
+		}
+	}
+	// Time both, over enough passes for the caches to be warm
+	uint64_t fast_ns = 0, slow_ns = 0;
+	const uint32_t passes = 1000;
+	fast_recorder.timing = slow_recorder.timing = true;
+	for (uint32_t n=0; n < passes; n++) {
+		for (uint32_t i=0; i < cap.count; i++) {
+			const host_report_t *r = &cap.reports[i];
+			uint64_t t0 = host_nanos();
+			host_complete_data(fast.in_pipe, r->data, r->len);
+			uint64_t t1 = host_nanos();
+			host_complete_data(slow.in_pipe, r->data, r->len);
+			uint64_t t2 = host_nanos();
+			fast_ns += t1 - t0;
+			slow_ns += t2 - t1;
+		}
+	}
+	if (fast_recorder.sum != slow_recorder.sum) {
+		printf("parse() gave different fields while timing\n");
+		errors++;
+	}
+	if (cap.count) {
+		fprintf(stderr, "%s: compiled %.0f ns, parse() %.0f ns per report\n",
+			argv[1], (double)fast_ns / (passes * cap.count),
+			(double)slow_ns / (passes * cap.count));
+	}
+	// the buffers were all given back, and disconnect reached the drivers
+	slow.descriptor = nullptr;
+	host_hid_detach(&fast);
+	host_hid_detach(&slow);
+	if (fast_recorder.claimed || slow_recorder.claimed) {
+		printf("disconnect_collection not called\n");
+		errors++;
+	}
+	uint32_t used, available, largest;
+	USBHIDParser::memoryUsage(used, available, largest);
+	if (used != 0) {
+		printf("%u bytes of the arena not freed\n", used);
+		errors++;
+	}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,375 @@
+// Host side stand-in for the EHCI controller, see host.h
+
+#include "host.h"
+#include <time.h>
+#include <ctype.h>
+
+HostSerial Serial, Serial1;
+
+static uint32_t now_micros = 1000;
+
+uint32_t micros() { return now_micros; }
+uint32_t millis() { return now_micros / 1000; }
+void delay(uint32_t ms) { host_advance(ms * 1000); }
+void (*host_yield)() = nullptr;
+void yield() { if (host_yield) (*host_yield)(); }
+
+uint64_t host_nanos()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//--------------------------------------------------------------------------
+// Timers, usec holds the deadline
+
+#define MAX_TIMERS 16
+static USBDriverTimer *timers[MAX_TIMERS];
+static uint32_t timer_count = 0;
+
+void USBDriverTimer::start(uint32_t microseconds)
+{
+	if (!driver) return;
+	if (microseconds < 100) return; // minimum timer duration
+	stop();
+	if (timer_count >= MAX_TIMERS) return;
+	started_micros = now_micros;
+	usec = now_micros + microseconds;
+	timers[timer_count++] = this;
+}
+
+bool host_timer_running(const USBDriverTimer *timer)
+{
+	for (uint32_t i=0; i < timer_count; i++) {
+		if (timers[i] == timer) return true;
+	}
+	return false;
+}
+
+void USBDriverTimer::stop()
+{
+	for (uint32_t i=0; i < timer_count; i++) {
+		if (timers[i] == this) {
+			timers[i] = timers[--timer_count];
+			return;
+		}
+	}
+}
+
+void host_advance(uint32_t us)
+{
+	uint32_t end = now_micros + us;
+	while (1) {
+		USBDriverTimer *due = nullptr;
+		for (uint32_t i=0; i < timer_count; i++) {
+			int32_t left = timers[i]->usec - end;
+			if (left > 0) continue;
+			if (!due || (int32_t)(timers[i]->usec - due->usec) < 0) due = timers[i];
+		}
+		if (!due) break;
+		if ((int32_t)(due->usec - now_micros) > 0) now_micros = due->usec;
+		due->stop();
+		due->driver->timer_event(due);
+	}
+	now_micros = end;
+}
+
+//--------------------------------------------------------------------------
+// Transfers
+
+#define MAX_QUEUED 64
+static host_transfer_t controls[MAX_QUEUED];
+static uint32_t control_count = 0;
+static host_transfer_t data[MAX_QUEUED];
+static uint32_t data_count = 0;
+
+void USBHost::mask_interrupts(bool mask) { }
+
+Pipe_t * USBHost::new_Pipe(Device_t *dev, uint32_t type, uint32_t endpoint,
+	uint32_t direction, uint32_t maxlen, uint32_t interval)
+{
+	Pipe_t *pipe = allocate_Pipe();
+	if (!pipe) return NULL;
+	memset(pipe, 0, sizeof(Pipe_t));
+	pipe->device = dev;
+	pipe->type = type;
+	pipe->direction = direction;
+	pipe->qh.capabilities[0] = (maxlen << 16) | (endpoint << 8);
+	pipe->next = dev->data_pipes;
+	dev->data_pipes = pipe;
+	return pipe;
+}
+
+bool USBHost::queue_Control_Transfer(Device_t *dev, setup_t *setup, void *buf, USBDriver *driver)
+{
+	if (control_count >= MAX_QUEUED) return false;
+	host_transfer_t *t = &controls[control_count++];
+	t->dev = dev;
+	t->pipe = dev->control_pipe;
+	t->setup = *setup;
+	t->buffer = buf;
+	t->length = setup->wLength;
+	t->driver = driver;
+	return true;
+}
+
+bool USBHost::queue_Data_Transfer(Pipe_t *pipe, void *buffer, uint32_t len, USBDriver *driver)
+{
+	if (!pipe || data_count >= MAX_QUEUED) return false;
+	host_transfer_t *t = &data[data_count++];
+	t->dev = pipe->device;
+	t->pipe = pipe;
+	t->buffer = buffer;
+	t->length = len;
+	t->driver = driver;
+	return true;
+}
+
+void USBHost::driver_ready_for_device(USBDriver *driver)
+{
+	driver->device = NULL;
+	driver->next = NULL;
+}
+
+bool host_control_pending(host_transfer_t *t)
+{
+	if (control_count == 0) return false;
+	if (t) *t = controls[0];
+	return true;
+}
+
+void host_complete_control(const void *buf, uint32_t len)
+{
+	if (control_count == 0) return;
+	host_transfer_t c = controls[0];
+	control_count--;
+	memmove(controls, controls + 1, control_count * sizeof(host_transfer_t));
+	Transfer_t t;
+	memset(&t, 0, sizeof(t));
+	t.pipe = c.pipe;
+	t.setup = c.setup;
+	t.buffer = c.buffer;
+	t.length = c.length;
+	t.driver = c.driver;
+	if (buf && c.buffer && (c.setup.bmRequestType & 0x80)) {
+		if (len > c.length) len = c.length;
+		memcpy(c.buffer, buf, len);
+		t.length = len;
+	}
+	if (c.driver) c.driver->control(&t);
+}
+
+void host_complete_all_controls()
+{
+	// completing one may queue another, but never forever
+	for (uint32_t n=0; n < 100 && control_count > 0; n++) {
+		host_complete_control();
+	}
+}
+
+uint32_t host_queued(const Pipe_t *pipe)
+{
+	uint32_t n = 0;
+	for (uint32_t i=0; i < data_count; i++) {
+		if (data[i].pipe == pipe) n++;
+	}
+	return n;
+}
+
+bool host_data_pending(const Pipe_t *pipe, host_transfer_t *t)
+{
+	for (uint32_t i=0; i < data_count; i++) {
+		if (data[i].pipe == pipe) {
+			if (t) *t = data[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+bool host_complete_data(Pipe_t *pipe, const void *buf, uint32_t len)
+{
+	uint32_t i;
+	for (i=0; i < data_count; i++) {
+		if (data[i].pipe == pipe) break;
+	}
+	if (i >= data_count) return false;
+	host_transfer_t d = data[i];
+	data_count--;
+	memmove(data + i, data + i + 1, (data_count - i) * sizeof(host_transfer_t));
+	Transfer_t t;
+	memset(&t, 0, sizeof(t));
+	t.pipe = pipe;
+	t.buffer = d.buffer;
+	t.length = d.length;
+	t.driver = d.driver;
+	if (pipe->direction == 1 && buf) {
+		if (len > d.length) len = d.length;
+		memcpy(d.buffer, buf, len);
+		t.length = len;
+	}
+	if (pipe->callback_function) (*pipe->callback_function)(&t);
+	return true;
+}
+
+static void forget_transfers(Device_t *dev)
+{
+	uint32_t n = 0;
+	for (uint32_t i=0; i < control_count; i++) {
+		if (controls[i].dev != dev) controls[n++] = controls[i];
+	}
+	control_count = n;
+	n = 0;
+	for (uint32_t i=0; i < data_count; i++) {
+		if (data[i].dev != dev) data[n++] = data[i];
+	}
+	data_count = n;
+}
+
+//--------------------------------------------------------------------------
+// HID devices
+
+static Device_t devices[4];
+static Pipe_t control_pipes[4];
+
+Device_t * host_hid_attach(USBHIDParser *hid, uint16_t vid, uint16_t pid,
+	const uint8_t *desc, uint32_t desclen, uint32_t in_size, uint32_t out_size,
+	uint8_t subclass, uint8_t protocol)
+{
+	uint32_t i;
+	for (i=0; i < 4; i++) {
+		if (devices[i].drivers == NULL) break;
+	}
+	if (i >= 4) return NULL;
+	Device_t *dev = &devices[i];
+	memset(dev, 0, sizeof(Device_t));
+	memset(&control_pipes[i], 0, sizeof(Pipe_t));
+	control_pipes[i].device = dev;
+	dev->control_pipe = &control_pipes[i];
+	dev->idVendor = vid;
+	dev->idProduct = pid;
+	dev->speed = 0;
+
+	uint8_t d[9+9+7+7];
+	uint32_t n = 0;
+	const uint8_t intf[9] = {9, 4, 0, 0, (uint8_t)(out_size ? 2 : 1), 3, subclass, protocol, 0};
+	memcpy(d + n, intf, 9);
+	n += 9;
+	const uint8_t hiddesc[9] = {9, 33, 0x11, 0x01, 0, 1, 34,
+		(uint8_t)desclen, (uint8_t)(desclen >> 8)};
+	memcpy(d + n, hiddesc, 9);
+	n += 9;
+	const uint8_t ep_in[7] = {7, 5, 0x81, 3, (uint8_t)in_size, (uint8_t)(in_size >> 8), 1};
+	memcpy(d + n, ep_in, 7);
+	n += 7;
+	if (out_size) {
+		const uint8_t ep_out[7] = {7, 5, 0x02, 3, (uint8_t)out_size, (uint8_t)(out_size >> 8), 1};
+		memcpy(d + n, ep_out, 7);
+		n += 7;
+	}
+	if (!hid->claim(dev, 1, d, n)) return NULL;
+	hid->device = dev;
+	hid->next = NULL;
+	dev->drivers = hid;
+	// the report descriptor is the first control transfer
+	host_complete_control(desc, desclen);
+	return dev;
+}
+
+void host_hid_detach(USBHIDParser *hid)
+{
+	Device_t *dev = hid->device;
+	if (!dev) return;
+	hid->disconnect();
+	hid->device = NULL;
+	forget_transfers(dev);
+	for (Pipe_t *p = dev->data_pipes; p; ) {
+		Pipe_t *next = p->next;
+		USBHost::free_Pipe(p);
+		p = next;
+	}
+	dev->data_pipes = NULL;
+	dev->drivers = NULL;
+}
+
+//--------------------------------------------------------------------------
+// Capture files
+
+static uint32_t read_hex_bytes(const char *p, uint8_t *buf, uint32_t max)
+{
+	uint32_t n = 0;
+	while (*p) {
+		while (*p && !isxdigit((unsigned char)*p)) p++;
+		if (!*p) break;
+		char *end;
+		unsigned long b = strtoul(p, &end, 16);
+		if (end == p) break;
+		if (n < max) buf[n++] = b;
+		p = end;
+	}
+	return n;
+}
+
+bool host_read_capture(const char *filename, host_capture_t *cap)
+{
+	FILE *f = fopen(filename, "r");
+	if (!f) return false;
+	memset(cap, 0, sizeof(*cap));
+	uint32_t alloc = 0;
+	bool in_desc = false;
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n') {
+			in_desc = false;
+			continue;
+		}
+		if (strncmp(line, "device ", 7) == 0) {
+			unsigned vid, pid;
+			if (sscanf(line + 7, "%x:%x", &vid, &pid) == 2) {
+				cap->vid = vid;
+				cap->pid = pid;
+			}
+			in_desc = false;
+		} else if (strncmp(line, "insize ", 7) == 0) {
+			cap->in_size = atoi(line + 7);
+			in_desc = false;
+		} else if (strncmp(line, "descriptor", 10) == 0) {
+			// "descriptor 67:" gives the length, then the bytes
+			const char *p = strchr(line, ':');
+			p = p ? p + 1 : line + 10;
+			cap->desclen += read_hex_bytes(p, cap->desc + cap->desclen,
+				sizeof(cap->desc) - cap->desclen);
+			in_desc = true;
+		} else if (in_desc && isspace((unsigned char)line[0])) {
+			cap->desclen += read_hex_bytes(line, cap->desc + cap->desclen,
+				sizeof(cap->desc) - cap->desclen);
+		} else if (isdigit((unsigned char)line[0])) {
+			in_desc = false;
+			const char *p = strchr(line, ':');
+			if (!p) continue;
+			if (cap->count >= alloc) {
+				alloc = alloc ? alloc * 2 : 256;
+				cap->reports = (host_report_t *)realloc(cap->reports,
+					alloc * sizeof(host_report_t));
+			}
+			host_report_t *r = &cap->reports[cap->count++];
+			r->micros = strtoul(line, NULL, 10);
+			r->len = read_hex_bytes(p + 1, r->data, sizeof(r->data));
+		}
+	}
+	fclose(f);
+	if (cap->in_size == 0) {
+		for (uint32_t i=0; i < cap->count; i++) {
+			if (cap->reports[i].len > cap->in_size) cap->in_size = cap->reports[i].len;
+		}
+		if (cap->in_size == 0) cap->in_size = 64;
+	}
+	return cap->desclen > 0;
+}
+
+//--------------------------------------------------------------------------
+// Bluetooth is not simulated
+
+void BluetoothController::driver_ready_for_bluetooth(BTHIDInput *driver) { }
+void BluetoothController::sendL2CapCommand(uint8_t *data, uint8_t nbytes, int channel) { }
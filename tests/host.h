@@ -0,0 +1,70 @@
+// Host side stand-in for the EHCI controller, so the HID parser and the
+// drivers can be run on a PC from recorded descriptors and reports.
+//
+// Transfers queued by the library are kept in a list instead of being
+// given to hardware.  Tests complete them, which calls the same pipe
+// callbacks the USB interrupt would.  Time is simulated: micros() only
+// moves when a test calls host_advance(), which also runs due timers.
+#pragma once
+
+#include <Arduino.h>
+// The tests look at private state of the parser and drivers.  Access
+// specifiers don't change the layout, so this sees the same objects.
+#define private public
+#define protected public
+#include "USBHost_t36.h"
+#undef private
+#undef protected
+
+typedef struct {
+	Device_t   *dev;		// control transfers
+	Pipe_t     *pipe;		// data transfers
+	setup_t    setup;
+	void       *buffer;
+	uint32_t   length;
+	USBDriver  *driver;
+} host_transfer_t;
+
+void host_advance(uint32_t us);
+
+bool host_timer_running(const USBDriverTimer *timer);
+
+// Called by yield(), when a driver waits for the USB to finish something
+extern void (*host_yield)();
+
+// Control transfers, oldest first.  host_complete_control() gives the
+// data (for IN requests) and calls the driver's control().
+bool host_control_pending(host_transfer_t *t);
+void host_complete_control(const void *data=nullptr, uint32_t len=0);
+void host_complete_all_controls();
+
+// Data transfers queued on a pipe, and their completion, oldest first
+uint32_t host_queued(const Pipe_t *pipe);
+bool host_data_pending(const Pipe_t *pipe, host_transfer_t *t);
+bool host_complete_data(Pipe_t *pipe, const void *data, uint32_t len);
+
+// Attach a HID interface with this report descriptor, as enumeration
+// would: claim(), then GET_DESCRIPTOR of the report descriptor
+Device_t * host_hid_attach(USBHIDParser *hid, uint16_t vid, uint16_t pid,
+	const uint8_t *desc, uint32_t desclen, uint32_t in_size=64,
+	uint32_t out_size=0, uint8_t subclass=0, uint8_t protocol=0);
+void host_hid_detach(USBHIDParser *hid);
+
+// Read a capture in the format printed by the HIDCaptureReplay example
+typedef struct {
+	uint32_t micros;
+	uint16_t len;
+	uint8_t  data[64];
+} host_report_t;
+typedef struct {
+	uint16_t vid, pid;
+	uint16_t in_size;
+	uint16_t desclen;
+	uint8_t  desc[1024];
+	uint32_t count;
+	host_report_t *reports;
+} host_capture_t;
+bool host_read_capture(const char *filename, host_capture_t *cap);
+
+// Monotonic host clock for benchmarks, nanoseconds
+uint64_t host_nanos();
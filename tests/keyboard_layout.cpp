@@ -0,0 +1,203 @@
+// KeyboardController's layout table against the linear search of
+// keycodes_ascii and keycodes_iso_8859_1 it replaced, for every key,
+// modifier, Caps Lock and Num Lock combination.  Built once for each
+// layout in stub/keylayouts.h.
+//
+// The search knew nothing of AltGr or dead keys.  With AltGr it is
+// given the AltGr code first, then the code without it, which is what
+// the table must do.  Dead keys are checked separately: each character
+// made with one must come from pressing the dead key, then the key.
+
+#include "host.h"
+#include "../keyboard.cpp"
+
+USBHost myusb;
+KeyboardController keyboard1(myusb);
+
+static int errors = 0;
+
+static int search_table(const KEYCODE_TYPE *table, uint32_t code)
+{
+	// unused entries are 0, which the search matched for usage 0, no key
+	if (code == 0) return -1;
+	for (int i=0; i < 96; i++) {
+		if (table[i] == code) return i;
+	}
+	return -1;
+}
+
+// convert_to_unicode() as it was, taking AltGr (right Alt) into account
+static uint16_t search_convert(uint32_t mod, uint32_t key, bool numlock, bool capslock)
+{
+	if (key & SHIFT_MASK) {
+		for (uint8_t i = 0; i < (sizeof(keycode_numlock)/sizeof(keycode_numlock[0])); i++) {
+			if (keycode_numlock[i].code == key) {
+				if (numlock) {
+					return keycode_numlock[i].charNumlockOn;
+				} else {
+					key = keycode_numlock[i].codeNumlockOff;
+					if (!(key & 0x80)) return key;
+					key &= 0x7f;
+					break;
+				}
+			}
+		}
+	}
+	for (uint8_t i = 0; i < (sizeof(keycode_extras)/sizeof(keycode_extras[0])); i++) {
+		if (keycode_extras[i].code == key) {
+			return keycode_extras[i].ascii;
+		}
+	}
+	if (key & SHIFT_MASK) return 0;
+	if (key >= 64) return 0;	// the search took bit 7 as AltGr
+
+	if ((mod & 0x02) || (mod & 0x20)) key |= SHIFT_MASK;
+	if (capslock) key ^= SHIFT_MASK;
+	uint32_t codes[2] = {key, key};
+	if (mod & 0x40) codes[0] |= ALTGR_MASK;
+	for (uint32_t c=0; c < 2; c++) {
+		int i = search_table(keycodes_ascii, codes[c]);
+		if (i >= 0) {
+			if ((mod & 1) || (mod & 0x10)) return (i+32) & 0x1f;	// Control key is down
+			return i + 32;
+		}
+#ifdef ISO_8859_1_A0
+		i = search_table(keycodes_iso_8859_1, codes[c]);
+		if (i >= 0) return i + 160;
+#endif
+	}
+	return 0;
+}
+
+static void test_every_key()
+{
+	uint32_t count = 0;
+	for (uint32_t locks=0; locks < 4; locks++) {
+		keyboard1.leds_.numLock = locks & 1;
+		keyboard1.leds_.capsLock = (locks >> 1) & 1;
+		for (uint32_t mod=0; mod < 256; mod++) {
+			for (uint32_t key=0; key < 256; key++) {
+				keyboard1.dead_key_ = 0;
+				uint16_t expect = search_convert(mod, key, locks & 1, locks & 2);
+				uint16_t ch = keyboard1.convert_to_unicode(mod, key);
+				if (keyboard1.dead_key_) {
+					// a dead key gives nothing until the next key
+					if (ch != 0 && errors++ < 10) printf("dead key %02X gave %u\n", key, ch);
+				} else if (ch != expect) {
+					if (errors++ < 10) printf("mod %02X key %02X locks %u: %u, expected %u\n",
+						mod, key, locks, ch, expect);
+				}
+				count++;
+			}
+		}
+	}
+	keyboard1.leds_.byte = 0;
+	printf("%u keys checked\n", count);
+}
+
+// the key and modifiers which type a table entry
+static uint32_t code_mod(uint32_t code)
+{
+	uint32_t mod = 0;
+	if (code & SHIFT_MASK) mod |= 0x02;
+	if (ALTGR_MASK && (code & ALTGR_MASK)) mod |= 0x40;
+	return mod;
+}
+
+static void check_deadkey(const KEYCODE_TYPE *table, uint32_t first, uint32_t &count)
+{
+	for (int i=0; i < 96; i++) {
+		uint32_t code = table[i];
+		uint32_t dead = (code & DEADKEYS_MASK) >> 8;
+		if (!dead) continue;
+		uint32_t deadcode = 0;
+		for (uint32_t m=0; m < 4; m++) {
+			for (uint32_t k=0; k < 64; k++) {
+				if (keyboard1.layout_->keys[m][k] == dead) deadcode = k | (m & 1 ? SHIFT_MASK : 0)
+					| (m & 2 ? ALTGR_MASK : 0);
+			}
+		}
+		keyboard1.dead_key_ = 0;
+		uint32_t c1 = keyboard1.convert_to_unicode(code_mod(deadcode), deadcode & (SHIFT_MASK - 1));
+		uint32_t c2 = keyboard1.convert_to_unicode(code_mod(code), code & (SHIFT_MASK - 1));
+		if (c1 != 0 || c2 != first + i) {
+			printf("dead key %u then %03X gave %u %u, expected 0 %u\n",
+				dead, code & 0xFF, c1, c2, first + i);
+			errors++;
+		}
+		count++;
+	}
+}
+
+static void test_deadkeys()
+{
+#if DEADKEYS_MASK
+	uint32_t count = 0;
+	check_deadkey(keycodes_ascii, 32, count);
+#ifdef ISO_8859_1_A0
+	check_deadkey(keycodes_iso_8859_1, 160, count);
+#endif
+	printf("%u dead key characters checked\n", count);
+#endif
+}
+
+// A layout given at run time, which can be const
+static const keyboard_deadkey_t test_deadkeys_list[] = {
+	{(1 << 8) | (0 << 6) | 4, 0xE0},	// dead key 1, then a: à
+};
+static const keyboard_layout_t test_layout = {
+	{{0, 0, 0, 0, 'q', 'w', 'e', 'r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, // 20 is dead key 1
+	 {0, 0, 0, 0, 'Q', 'W', 'E', 'R'},
+	 {0, 0, 0, 0, '@'},
+	 {0}},
+	1, test_deadkeys_list
+};
+
+static void test_set_layout()
+{
+	keyboard1.setLayout(&test_layout);
+	bool ok = keyboard1.convert_to_unicode(0, 4) == 'q'
+		&& keyboard1.convert_to_unicode(0x02, 5) == 'W'
+		&& keyboard1.convert_to_unicode(0x40, 4) == '@'
+		&& keyboard1.convert_to_unicode(0x40, 5) == 'w'	// no AltGr meaning
+		&& keyboard1.convert_to_unicode(0x01, 7) == ('r' & 0x1f)
+		&& keyboard1.convert_to_unicode(0, 20) == 0
+		&& keyboard1.convert_to_unicode(0, 4) == 0xE0
+		&& keyboard1.convert_to_unicode(0, 20) == 0
+		&& keyboard1.convert_to_unicode(0, 5) == 'w';	// no combination
+	if (!ok) {
+		printf("setLayout() not used\n");
+		errors++;
+	}
+	keyboard1.setLayout(KeyboardController::defaultLayout());
+}
+
+// Time per key press, of the table and of the search
+static void bench()
+{
+	static const uint8_t text[] = {4, 5, 6, 7, 8, 44, 30, 31, 51, 52, 54, 55, 56, 45, 46, 47};
+	const uint32_t loops = 200000;
+	volatile uint32_t sink = 0;
+	uint64_t t0 = host_nanos();
+	for (uint32_t n=0; n < loops; n++) {
+		sink = sink + keyboard1.convert_to_unicode((n & 16) ? 2 : 0, text[n & 15]);
+	}
+	uint64_t t1 = host_nanos();
+	for (uint32_t n=0; n < loops; n++) {
+		sink = sink + search_convert((n & 16) ? 2 : 0, text[n & 15], false, false);
+	}
+	uint64_t t2 = host_nanos();
+	fprintf(stderr, "keyboard_layout: %.1f ns per key, %.1f ns with the search\n",
+		(double)(t1 - t0) / loops, (double)(t2 - t1) / loops);
+}
+
+int main()
+{
+	if (getenv("HOST_DEBUG")) Serial.echo = true;
+	test_every_key();
+	test_deadkeys();
+	test_set_layout();
+	bench();
+	if (errors) printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+// MouseController at 8000 reports per second, read by a sketch about
+// once per millisecond.  Every count of motion and wheel must be read
+// exactly once, including reports which arrive between the reads and
+// mouseDataClear().  The wheel has a Resolution Multiplier, which the
+// driver must turn on.  Absolute positions must stay after a clear.
+
+#include "host.h"
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+MouseController mouse1(myusb);
+
+// Report 1: 5 buttons, 16 bit X & Y, wheel and AC Pan.  Report 2 is a
+// Feature with a 2 bit Resolution Multiplier for each wheel, 1 to 8.
+static const uint8_t hires_mouse[] = {
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x01, 0x09, 0x01, 0xA1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01,
+	0x95, 0x05, 0x81, 0x02, 0x75, 0x03, 0x95, 0x01, 0x81, 0x01,
+	0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x16, 0x01, 0x80, 0x26, 0xFF, 0x7F,
+	0x75, 0x10, 0x95, 0x02, 0x81, 0x06,
+	0xA1, 0x02,
+	0x85, 0x02, 0x09, 0x48, 0x15, 0x00, 0x25, 0x01, 0x35, 0x01, 0x45, 0x08,
+	0x75, 0x02, 0x95, 0x01, 0xB1, 0x02,
+	0x85, 0x01, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x35, 0x00, 0x45, 0x00,
+	0x75, 0x08, 0x95, 0x01, 0x81, 0x06,
+	0xC0,
+	0xA1, 0x02,
+	0x85, 0x02, 0x09, 0x48, 0x15, 0x00, 0x25, 0x01, 0x35, 0x01, 0x45, 0x08,
+	0x75, 0x02, 0x95, 0x01, 0xB1, 0x02,
+	0x35, 0x00, 0x45, 0x00, 0x75, 0x04, 0xB1, 0x01,
+	0x85, 0x01, 0x05, 0x0C, 0x0A, 0x38, 0x02, 0x15, 0x81, 0x25, 0x7F,
+	0x75, 0x08, 0x95, 0x01, 0x81, 0x06,
+	0xC0,
+	0xC0, 0xC0
+};
+
+// Absolute 0-32767 tablet with 3 buttons, no report ID
+static const uint8_t tablet[] = {
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01,
+	0x95, 0x03, 0x81, 0x02, 0x75, 0x05, 0x95, 0x01, 0x81, 0x01,
+	0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00, 0x26, 0xFF, 0x7F,
+	0x75, 0x10, 0x95, 0x02, 0x81, 0x02,
+	0xC0, 0xC0
+};
+
+static uint32_t seed = 12345;
+static int32_t rnd(int32_t lo, int32_t hi)
+{
+	seed = seed * 1103515245 + 12345;
+	return lo + (int32_t)((seed >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+static int errors = 0;
+#define CHECK(cond) do { if (!(cond)) { \
+	printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); errors++; } } while (0)
+
+static int64_t sent[4], got[4], got_detents[2];
+
+static void send_report(int32_t x, int32_t y, int32_t wheel, int32_t pan)
+{
+	uint8_t r[8] = {1, 0, (uint8_t)x, (uint8_t)(x >> 8), (uint8_t)y,
+		(uint8_t)(y >> 8), (uint8_t)wheel, (uint8_t)pan};
+	sent[0] += x;
+	sent[1] += y;
+	sent[2] += wheel;
+	sent[3] += pan;
+	CHECK(host_complete_data(hid1.in_pipe, r, sizeof(r)));
+}
+
+static void read_mouse()
+{
+	got[0] += mouse1.getMouseX();
+	got[1] += mouse1.getMouseY();
+	got[2] += mouse1.getWheelHiRes();
+	got[3] += mouse1.getWheelHHiRes();
+	got_detents[0] += mouse1.getWheel();
+	got_detents[1] += mouse1.getWheelH();
+}
+
+static void test_high_rate()
+{
+	CHECK(host_hid_attach(&hid1, 0x045E, 0x0823, hires_mouse, sizeof(hires_mouse), 8) != NULL);
+	CHECK(mouse1.wheelResolution() == 1);
+
+	// the first report lets the driver ask for the high resolution wheel
+	send_report(0, 0, 0, 0);
+	host_transfer_t t;
+	CHECK(host_control_pending(&t));
+	CHECK(t.setup.bmRequestType == 0x21 && t.setup.bRequest == 9);
+	CHECK(t.setup.wValue == 0x0302 && t.length == 2);
+	const uint8_t *feature = (const uint8_t *)t.buffer;
+	CHECK(feature[0] == 2 && feature[1] == 0x05);
+	host_complete_control();
+	CHECK(mouse1.wheelResolution() == 8);
+
+	// 2 seconds at 8 kHz, with the sketch's loop() every 0.7 to 1.3 ms
+	const uint32_t count = 16000;
+	uint32_t next_read = micros() + 1000;
+	uint32_t reads = 0, late = 0;
+	uint64_t ns = 0;
+	for (uint32_t i=0; i < count; i++) {
+		uint64_t t0 = host_nanos();
+		send_report(rnd(-300, 300), rnd(-300, 300), rnd(-4, 4), rnd(-2, 2));
+		ns += host_nanos() - t0;
+		host_advance(125);
+		if ((int32_t)(micros() - next_read) >= 0) {
+			read_mouse();
+			if (rnd(0, 3) == 0) {
+				// the USB interrupt between reading and clearing
+				send_report(rnd(-300, 300), rnd(-300, 300), rnd(-4, 4), rnd(-2, 2));
+				late++;
+			}
+			mouse1.mouseDataClear();
+			next_read += rnd(700, 1300);
+			reads++;
+		}
+	}
+	read_mouse();
+	mouse1.mouseDataClear();
+	CHECK(!mouse1.available());
+
+	for (uint32_t i=0; i < 4; i++) {
+		if (got[i] != sent[i]) {
+			printf("axis %u: sent %lld, read %lld\n", i, (long long)sent[i], (long long)got[i]);
+			errors++;
+		}
+	}
+	// whole detents, with the fraction carried to the next report
+	for (uint32_t i=0; i < 2; i++) {
+		int64_t counts = got_detents[i] * 8 + mouse1.wheel_remainder[i];
+		if (counts != sent[2 + i]) {
+			printf("wheel %u: %lld detents + %d counts, sent %lld counts\n", i,
+				(long long)got_detents[i], mouse1.wheel_remainder[i],
+				(long long)sent[2 + i]);
+			errors++;
+		}
+	}
+	printf("%u reports, %u reads, %u during a read: %s\n", count + late, reads, late,
+		errors ? "lost counts" : "none lost");
+	fprintf(stderr, "mouse_highrate: %.0f ns per report\n", (double)ns / count);
+	host_hid_detach(&hid1);
+	CHECK(mouse1.wheelResolution() == 1);
+}
+
+static void test_absolute()
+{
+	CHECK(host_hid_attach(&hid1, 0x056A, 0x0001, tablet, sizeof(tablet), 5) != NULL);
+	const uint8_t r1[5] = {1, 0x10, 0x27, 0x20, 0x4E};	// 10000, 20000
+	CHECK(host_complete_data(hid1.in_pipe, r1, sizeof(r1)));
+	CHECK(mouse1.available());
+	CHECK(mouse1.getButtons() == 1);
+	CHECK(mouse1.getMouseX() == 10000 && mouse1.getMouseY() == 20000);
+	mouse1.mouseDataClear();
+	// a position is not used up by reading it
+	CHECK(mouse1.getMouseX() == 10000 && mouse1.getMouseY() == 20000);
+	const uint8_t r2[5] = {0, 0x11, 0x27, 0x20, 0x4E};
+	CHECK(host_complete_data(hid1.in_pipe, r2, sizeof(r2)));
+	CHECK(host_complete_data(hid1.in_pipe, r2, sizeof(r2)));
+	// nor summed
+	CHECK(mouse1.getMouseX() == 10001 && mouse1.getMouseY() == 20000);
+	mouse1.mouseDataClear();
+	printf("tablet %d, %d\n", mouse1.getMouseX(), mouse1.getMouseY());
+	host_hid_detach(&hid1);
+}
+
+int main()
+{
+	if (getenv("HOST_DEBUG")) Serial.echo = true;
+	test_high_rate();
+	test_absolute();
+	if (errors) printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+// The quirk list in quirks.cpp against the tables and if-chains it
+// replaced, copied from joystick.cpp, serial.cpp, bluetooth.cpp,
+// keyboard.cpp and hid.cpp as they were.  Every product of each vendor
+// in them, the products in them with every vendor, and random devices
+// must give the same driver type and special handling both ways.  Also
+// checks the vendor hash is perfect, and times a lookup against the
+// linear searches.
+
+#include "host.h"
+#include "../quirks.cpp"
+
+USBHost myusb;
+JoystickController joystick1(myusb);
+
+static int errors = 0;
+
+//--------------------------------------------------------------------------
+// The original tables
+
+static const struct {
+	uint16_t idVendor;
+	uint16_t idProduct;
+	JoystickController::joytype_t joyType;
+	bool hidDevice;
+} joystick_pid_vid_mapping[] = {
+	{ 0x045e, 0x02ea, JoystickController::XBOXONE, false },{ 0x045e, 0x02dd, JoystickController::XBOXONE, false },
+	{ 0x045e, 0x0719, JoystickController::XBOX360, false},
+	{ 0x045e, 0x028E, JoystickController::SWITCH, false},  // Switch?
+	{ 0x054C, 0x0268, JoystickController::PS3, true},
+	{ 0x054C, 0x042F, JoystickController::PS3, true},	// PS3 Navigation controller
+	{ 0x054C, 0x03D5, JoystickController::PS3_MOTION, true},	// PS3 Motion controller
+	{ 0x054C, 0x05C4, JoystickController::PS4, true}, 	{0x054C, 0x09CC, JoystickController::PS4, true },
+	{ 0x046D, 0xC626, JoystickController::SpaceNav, true},  // 3d Connextion Space Navigator, 0x10008
+	{ 0x046D, 0xC628, JoystickController::SpaceNav, true}  // 3d Connextion Space Navigator, 0x10008
+};
+
+static const struct {
+	uint16_t idVendor;
+	uint16_t idProduct;
+	USBSerialBase::sertype_t sertype;
+	int claim_at_type;
+} serial_pid_vid_mapping[] = {
+	// FTDI mappings.
+	{0x0403, 0x6001, USBSerialBase::FTDI, 0},
+	{0x0403, 0x8088, USBSerialBase::FTDI, 1},  // 2 devices try to claim at interface level
+
+	// PL2303
+	{0x67B,0x2303, USBSerialBase::PL2303, 0},
+
+	// CH341
+	{0x4348, 0x5523, USBSerialBase::CH341, 0},
+	{0x1a86, 0x7523, USBSerialBase::CH341, 0 },
+	{0x1a86, 0x5523, USBSerialBase::CH341, 0 },
+
+	// Silex CP210...
+	{0x10c4, 0xea60, USBSerialBase::CP210X, 0 }
+};
+
+static const struct {
+	uint16_t idVendor;
+	uint16_t idProduct;
+} bluetooth_pid_vid_mapping[] = {
+	{ 0xA5C, 0x21E8 }};
+
+static const struct {
+	uint16_t idVendor;
+	uint16_t idProduct;	// 0 = ALL
+} keyboard_forceBootMode[] = {
+	{0x04D9, 0}
+};
+
+// JoystickController::mapVIDPIDtoJoystickType()
+static JoystickController::joytype_t original_joystick(uint16_t idVendor, uint16_t idProduct, bool exclude_hid_devices)
+{
+	for (uint8_t i = 0; i < (sizeof(joystick_pid_vid_mapping)/sizeof(joystick_pid_vid_mapping[0])); i++) {
+		if ((idVendor == joystick_pid_vid_mapping[i].idVendor) && (idProduct == joystick_pid_vid_mapping[i].idProduct)) {
+			if (exclude_hid_devices && joystick_pid_vid_mapping[i].hidDevice) return JoystickController::UNKNOWN;
+			return joystick_pid_vid_mapping[i].joyType;
+		}
+	}
+	return JoystickController::UNKNOWN; 	// Not in our list
+}
+
+// JoystickController::claim(), for an XBox One
+static bool original_xboxone_s_init(uint16_t idVendor, uint16_t idProduct)
+{
+	return idVendor == 0x045e && (idProduct == 0x02ea || idProduct == 0x0b00);
+}
+
+static bool original_xboxone_pdp_init(uint16_t idVendor, uint16_t idProduct)
+{
+	return idVendor == 0x0e6f;
+}
+
+// USBSerialBase::claim(): the type, and -1 or the type of claim it wants
+static USBSerialBase::sertype_t original_serial(uint16_t idVendor, uint16_t idProduct, int &claim_at_type)
+{
+	claim_at_type = -1;
+	for (uint8_t i = 0; i < (sizeof(serial_pid_vid_mapping)/sizeof(serial_pid_vid_mapping[0])); i++) {
+		if ((idVendor == serial_pid_vid_mapping[i].idVendor) && (idProduct == serial_pid_vid_mapping[i].idProduct)) {
+			claim_at_type = serial_pid_vid_mapping[i].claim_at_type;
+			return serial_pid_vid_mapping[i].sertype;
+		}
+	}
+	return USBSerialBase::UNKNOWN;
+}
+
+// BluetoothController::claim(), for a device not of class 0xE0
+static bool original_bluetooth(uint16_t idVendor, uint16_t idProduct)
+{
+	for (uint8_t i=0; i < (sizeof(bluetooth_pid_vid_mapping)/sizeof(bluetooth_pid_vid_mapping[0])); i++) {
+		if ((bluetooth_pid_vid_mapping[i].idVendor == idVendor) && (bluetooth_pid_vid_mapping[i].idProduct == idProduct)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// KeyboardController::claim()
+static bool original_force_boot(uint16_t idVendor, uint16_t idProduct)
+{
+	for (uint8_t i = 0; i < sizeof(keyboard_forceBootMode)/sizeof(keyboard_forceBootMode[0]); i++) {
+		if (idVendor == keyboard_forceBootMode[i].idVendor) {
+			if ((idProduct == keyboard_forceBootMode[i].idProduct) ||
+					(keyboard_forceBootMode[i].idProduct == 0)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// USBHIDParser::control()
+static bool original_ps3_feature(uint16_t idVendor, uint16_t idProduct)
+{
+	return idVendor == 0x054C &&
+		((idProduct == 0x0268) || (idProduct == 0x042F)/* || (idProduct == 0x03D5)*/);
+}
+
+//--------------------------------------------------------------------------
+// The same, as the drivers find it now
+
+static bool quirk_flag(uint16_t idVendor, uint16_t idProduct, uint8_t driver, uint16_t flag)
+{
+	const usb_quirk_t *q = USBHost::find_quirk(idVendor, idProduct, driver);
+	return q && (q->flags & flag);
+}
+
+static USBSerialBase::sertype_t quirk_serial(uint16_t idVendor, uint16_t idProduct, int &claim_at_type)
+{
+	claim_at_type = -1;
+	const usb_quirk_t *q = USBHost::find_quirk(idVendor, idProduct, QUIRK_DRIVER_SERIAL);
+	if (!q) return USBSerialBase::UNKNOWN;
+	claim_at_type = (q->flags & QUIRK_CLAIM_INTERFACE) ? 1 : 0;
+	return (USBSerialBase::sertype_t)q->type;
+}
+
+// JoystickController::mapVIDPIDtoJoystickType() inlined, for the timing
+static JoystickController::joytype_t quirk_joystick(uint16_t idVendor, uint16_t idProduct, bool exclude_hid_devices)
+{
+	const usb_quirk_t *q = USBHost::find_quirk(idVendor, idProduct, QUIRK_DRIVER_JOYSTICK);
+	if (!q) return JoystickController::UNKNOWN;
+	if (exclude_hid_devices && (q->flags & QUIRK_HID_DEVICE)) return JoystickController::UNKNOWN;
+	return (JoystickController::joytype_t)q->type;
+}
+
+static uint32_t checked = 0;
+
+static void check(uint16_t vid, uint16_t pid)
+{
+	int a, b;
+	const char *what = nullptr;
+	if (joystick1.mapVIDPIDtoJoystickType(vid, pid, false) != original_joystick(vid, pid, false)) {
+		what = "joystick type";
+	} else if (joystick1.mapVIDPIDtoJoystickType(vid, pid, true) != original_joystick(vid, pid, true)) {
+		what = "joystick type, not HID";
+	} else if (quirk_flag(vid, pid, QUIRK_DRIVER_JOYSTICK, QUIRK_XBOXONE_S_INIT) != original_xboxone_s_init(vid, pid)) {
+		what = "XBox One S init";
+	} else if (quirk_flag(vid, pid, QUIRK_DRIVER_JOYSTICK, QUIRK_XBOXONE_PDP_INIT) != original_xboxone_pdp_init(vid, pid)) {
+		what = "XBox One PDP init";
+	} else if (quirk_serial(vid, pid, a) != original_serial(vid, pid, b) || a != b) {
+		what = "serial type";
+	} else if ((USBHost::find_quirk(vid, pid, QUIRK_DRIVER_BLUETOOTH) != NULL) != original_bluetooth(vid, pid)) {
+		what = "bluetooth";
+	} else if (quirk_flag(vid, pid, QUIRK_DRIVER_KEYBOARD, QUIRK_FORCE_BOOT_PROTOCOL) != original_force_boot(vid, pid)) {
+		what = "keyboard boot protocol";
+	} else if (quirk_flag(vid, pid, QUIRK_DRIVER_HID, QUIRK_PS3_FEATURE_F4) != original_ps3_feature(vid, pid)) {
+		what = "PS3 feature report";
+	}
+	if (what && errors++ < 10) printf("%04X:%04X: %s differs\n", vid, pid, what);
+	checked++;
+}
+
+static void test_sorted()
+{
+	const uint32_t count = sizeof(quirk_list) / sizeof(quirk_list[0]);
+	for (uint32_t i=1; i < count; i++) {
+		const usb_quirk_t *a = &quirk_list[i - 1], *b = &quirk_list[i];
+		if (a->vidpid > b->vidpid || (a->vidpid == b->vidpid && a->driver >= b->driver)) {
+			printf("quirk_list[%u] %08X out of order\n", i, b->vidpid);
+			errors++;
+		}
+	}
+	for (uint32_t i=0; i < sizeof(quirk_hash.slot); i++) {
+		if (quirk_hash.slot[i] == QUIRK_SHARED) {
+			printf("two vendors share hash slot %u, change QUIRK_HASH\n", i);
+			errors++;
+		}
+	}
+	for (uint32_t i=0; i < count; i++) {
+		const usb_quirk_t *q = &quirk_list[i];
+		if (USBHost::find_quirk(q->vidpid >> 16, q->vidpid, q->driver) != q) {
+			printf("quirk_list[%u] %08X not found\n", i, q->vidpid);
+			errors++;
+		}
+	}
+}
+
+static void test_lookups()
+{
+	// every vendor and product named anywhere, and their neighbours
+	const uint32_t count = sizeof(quirk_list) / sizeof(quirk_list[0]);
+	static uint16_t vids[count + 1], pids[count * 2];
+	uint32_t nvid = 0, npid = 0;
+	for (uint32_t i=0; i < count; i++) {
+		vids[nvid++] = quirk_list[i].vidpid >> 16;
+		pids[npid++] = quirk_list[i].vidpid;
+		pids[npid++] = quirk_list[i].vidpid + 1;
+	}
+	vids[nvid++] = 0x0B00;		// the XBox One S product, as a vendor
+	for (uint32_t i=0; i < nvid; i++) {
+		for (uint32_t pid=0; pid <= 0xFFFF; pid++) {
+			check(vids[i], pid);
+			check(vids[i] + 1, pid);
+		}
+	}
+	for (uint32_t vid=0; vid <= 0xFFFF; vid++) {
+		for (uint32_t i=0; i < npid; i++) check(vid, pids[i]);
+		check(vid, 0);
+		check(vid, 0xFFFF);
+	}
+	uint32_t seed = 47;
+	for (uint32_t n=0; n < 1000000; n++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t r = seed;
+		seed = seed * 1103515245 + 12345;
+		check(r >> 16, seed >> 16);
+	}
+	printf("%u devices checked\n", checked);
+}
+
+// A plug event of a device which is in no list, then of one which is
+// in the last place of each, by every driver
+static void bench()
+{
+	static const uint16_t devices[][2] = {{0x1234, 0x5678}, {0x046D, 0xC628},
+		{0x10C4, 0xEA60}, {0x0A5C, 0x21E8}, {0x054C, 0x042F}};
+	const uint32_t loops = 200000;
+	volatile uint32_t sink = 0;
+	double best_quirk = 1e9, best_original = 1e9;
+	for (uint32_t round=0; round < 10; round++) {
+		int a;
+		uint64_t t0 = host_nanos();
+		for (uint32_t n=0; n < loops; n++) {
+			uint16_t vid = devices[n % 5][0], pid = devices[n % 5][1];
+			sink = sink + quirk_joystick(vid, pid, false)
+				+ quirk_serial(vid, pid, a)
+				+ (USBHost::find_quirk(vid, pid, QUIRK_DRIVER_BLUETOOTH) != NULL)
+				+ quirk_flag(vid, pid, QUIRK_DRIVER_KEYBOARD, QUIRK_FORCE_BOOT_PROTOCOL);
+		}
+		uint64_t t1 = host_nanos();
+		for (uint32_t n=0; n < loops; n++) {
+			uint16_t vid = devices[n % 5][0], pid = devices[n % 5][1];
+			sink = sink + original_joystick(vid, pid, false)
+				+ original_serial(vid, pid, a)
+				+ original_bluetooth(vid, pid)
+				+ original_force_boot(vid, pid);
+		}
+		uint64_t t2 = host_nanos();
+		double q = (double)(t1 - t0) / loops, o = (double)(t2 - t1) / loops;
+		if (q < best_quirk) best_quirk = q;
+		if (o < best_original) best_original = o;
+	}
+	fprintf(stderr, "quirk_lookup: %.1f ns per device, %.1f ns with the driver's tables\n",
+		best_quirk, best_original);
+}
+
+int main()
+{
+	if (getenv("HOST_DEBUG")) Serial.echo = true;
+	test_sorted();
+	test_lookups();
+	bench();
+	if (errors) printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+// USBSerialEmu printing to a Teensy's Serial emulation.  The device takes
+// one 64 byte report per interval, 1 ms at full speed and 125 us at high
+// speed.  Everything written must arrive once, in order, with partial
+// packets sent after writeTimeout() and whole packets sent back to back.
+//
+// Bytes per second are printed to stderr, for the link and for the CPU:
+// write(buffer, size), write(c), and write(c) as it was, which printed
+// every byte to USBHDBGSerial and restarted the timer.  Its debug output
+// is timed as a 115200 baud UART, as it would be on the Teensy.
+
+#include "host.h"
+
+USBHost myusb;
+USBHIDParser hid1(myusb);
+USBSerialEmu seremu(myusb);
+
+// Teensyduino's usb_desc.c SEREMU_INTERFACE report descriptor
+static const uint8_t seremu_desc[] = {
+	0x06, 0xC9, 0xFF, 0x09, 0x04, 0xA1, 0x5C, 0x75, 0x08, 0x15, 0x00,
+	0x26, 0xFF, 0x00, 0x95, 0x40, 0x09, 0x75, 0x81, 0x02, 0x95, 0x20,
+	0x09, 0x76, 0x91, 0x02, 0x95, 0x04, 0x09, 0x76, 0xB1, 0x02, 0xC0
+};
+
+static int errors = 0;
+#define CHECK(cond) do { if (!(cond)) { \
+	printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); errors++; } } while (0)
+
+// The device: what it received, with the zero padding removed
+static uint8_t received[1 << 18];
+static uint32_t received_len = 0;
+static uint32_t packets = 0, partial_packets = 0;
+static uint32_t interval = 1000;
+static uint32_t next_poll;
+
+static void device_poll()
+{
+	host_transfer_t t;
+	if (host_data_pending(hid1.out_pipe, &t)) {
+		const uint8_t *p = (const uint8_t *)t.buffer;
+		uint32_t len = t.length;
+		while (len > 0 && p[len - 1] == 0) len--;
+		if (received_len + len <= sizeof(received)) {
+			memcpy(received + received_len, p, len);
+			received_len += len;
+		}
+		packets++;
+		if (len < t.length) partial_packets++;
+		host_complete_data(hid1.out_pipe, nullptr, 0);
+	}
+	next_poll += interval;
+}
+
+// Time passes, with the device polling its endpoint as it goes
+static void run_until(uint32_t when)
+{
+	while ((int32_t)(next_poll - when) <= 0) {
+		host_advance(next_poll - micros());
+		device_poll();
+	}
+	if ((int32_t)(when - micros()) > 0) host_advance(when - micros());
+}
+
+// A driver waiting for a buffer: until the next poll
+static void wait_for_poll()
+{
+	run_until(next_poll);
+}
+
+// For the CPU timing, the device takes everything at once
+static void drain()
+{
+	while (host_data_pending(hid1.out_pipe, nullptr)) device_poll();
+}
+
+// write(c) before write(buffer, size).  Each byte went to USBHDBGSerial,
+// which is Serial here, and restarted the timer.
+static bool uart_timing = false;
+static size_t original_write(USBSerialEmu &s, uint8_t c)
+{
+	uint32_t before = USBHDBGSerial.count;
+	if (c >= ' ') USBHDBGSerial.printf("SEMU: %c\n", c);
+	else USBHDBGSerial.printf("SEMU: 0x%x\n", c);
+	// 10 bits per byte at 115200 baud, once the UART's buffer is full
+	if (uart_timing) run_until(micros() + (USBHDBGSerial.count - before) * 87);
+
+	if (!s.driver_) return 0;
+
+	if (s.tx_head_ == s.tx_pipe_size_) {
+		while (!s.sendPacket()) yield();	// wait until the device above queues this packet
+	}
+	s.tx_buffer_[s.tx_head_++] = c;
+
+	// if this character filled it. then try to queue it again
+	if (s.tx_head_ == s.tx_pipe_size_) s.sendPacket();
+	s.driver_->stopTimer();
+	s.driver_->startTimer(s.write_timeout_);
+	return 1;
+}
+
+static uint32_t seed = 43;
+static uint8_t text[4096];
+
+static void make_text()
+{
+	for (uint32_t i=0; i < sizeof(text); i++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t n = (seed >> 16) % 40;
+		text[i] = (n == 0) ? '\n' : ' ' + ((seed >> 8) % 95);
+	}
+}
+
+static void attach()
+{
+	received_len = packets = partial_packets = 0;
+	next_poll = micros() + interval;
+	CHECK(host_hid_attach(&hid1, 0x16C0, 0x0486, seremu_desc, sizeof(seremu_desc), 64, 64) != NULL);
+	CHECK(seremu.usage() == 0xFFC90004);
+	host_complete_all_controls();
+}
+
+// Writes of every size, mixed with single bytes, arrive whole
+static void test_stream()
+{
+	attach();
+	uint32_t sent = 0;
+	static const uint32_t sizes[] = {1, 7, 63, 64, 65, 200, 128, 3, 500, 64};
+	for (uint32_t n=0; n < 30; n++) {
+		uint32_t size = sizes[n % 10];
+		if (n & 1) {
+			CHECK(seremu.write(text + sent, size) == size);
+		} else {
+			for (uint32_t i=0; i < size; i++) CHECK(seremu.write(text[sent + i]) == 1);
+		}
+		sent += size;
+		if (n % 7 == 6) run_until(micros() + 300);
+	}
+	seremu.flush();
+	CHECK(host_queued(hid1.out_pipe) == 0);
+	CHECK(received_len == sent && memcmp(received, text, sent) == 0);
+	printf("stream: %u bytes in %u packets, %u partial\n", sent, packets, partial_packets);
+
+	// A partial packet waits for the timeout, and has nothing stale after it
+	uint32_t before = received_len;
+	CHECK(seremu.write((const uint8_t *)"abc", 3) == 3);
+	run_until(micros() + seremu.writeTimeout() - 1);
+	CHECK(received_len == before);
+	run_until(micros() + interval + 1);
+	CHECK(received_len == before + 3 && memcmp(received + before, "abc", 3) == 0);
+
+	// Whole packets don't start the timer
+	before = received_len;
+	uint32_t before_packets = packets, before_partial = partial_packets;
+	CHECK(seremu.write(text, 128) == 128);
+	CHECK(!host_timer_running(&hid1.hidTimer));
+	run_until(micros() + interval * 2);
+	CHECK(packets == before_packets + 2 && partial_packets == before_partial);
+	CHECK(received_len == before + 128 && memcmp(received + before, text, 128) == 0);
+	host_hid_detach(&hid1);
+}
+
+// Bytes per second through the link, printing a 4 KB text repeatedly
+static double link_rate(int how, uint32_t total)
+{
+	attach();
+	uint32_t start = micros();
+	for (uint32_t sent=0; sent < total; sent += sizeof(text)) {
+		if (how == 0) {
+			seremu.write(text, sizeof(text));
+		} else if (how == 1) {
+			for (uint32_t i=0; i < sizeof(text); i++) seremu.write(text[i]);
+		} else {
+			for (uint32_t i=0; i < sizeof(text); i++) original_write(seremu, text[i]);
+		}
+	}
+	seremu.flush();
+	uint32_t us = micros() - start;
+	CHECK(received_len == total);
+	// back to back: one packet per interval, except for the end
+	if (how < 2) CHECK(us <= (total / 64 + 2) * interval);
+	host_hid_detach(&hid1);
+	return (double)total * 1e6 / us;
+}
+
+// Bytes per second of the CPU, with a device which is never busy
+static double cpu_rate(int how)
+{
+	attach();
+	host_yield = drain;
+	double best = 1e9;
+	for (uint32_t round=0; round < 10; round++) {
+		uint64_t t0 = host_nanos();
+		for (uint32_t n=0; n < 16; n++) {
+			for (uint32_t i=0; i < sizeof(text); i += 32) {
+				if (how == 0) {
+					seremu.write(text + i, 32);
+				} else if (how == 1) {
+					for (uint32_t j=0; j < 32; j++) seremu.write(text[i + j]);
+				} else {
+					for (uint32_t j=0; j < 32; j++) original_write(seremu, text[i + j]);
+				}
+				drain();
+			}
+		}
+		double ns = (double)(host_nanos() - t0) / (16 * sizeof(text));
+		if (ns < best) best = ns;
+	}
+	host_yield = wait_for_poll;
+	seremu.flush();
+	host_hid_detach(&hid1);
+	return 1e9 / best;
+}
+
+int main()
+{
+	if (getenv("HOST_DEBUG")) Serial.echo = true;
+	make_text();
+	host_yield = wait_for_poll;
+	test_stream();
+	static const char *names[3] = {"write(buffer, size)", "write(c)", "write(c) as it was"};
+	for (uint32_t speed=0; speed < 2; speed++) {
+		interval = speed ? 125 : 1000;
+		for (int how=0; how < 3; how++) {
+			uart_timing = true;
+			double rate = link_rate(how, how < 2 ? 65536 : 8192);
+			uart_timing = false;
+			fprintf(stderr, "seremu_write: %s, %u us interval, %.0f bytes/sec\n",
+				names[how], interval, rate);
+		}
+	}
+	for (int how=0; how < 3; how++) {
+		fprintf(stderr, "seremu_write: %s, CPU %.1f Mbytes/sec\n", names[how], cpu_rate(how) / 1e6);
+	}
+	if (errors) printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
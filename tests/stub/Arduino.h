@@ -0,0 +1,109 @@
+// Host build of the parts of Teensyduino used by the library, enough to
+// run the HID parser and drivers on a PC.  Nothing here touches hardware.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+#define constrain(x,a,b) ((x)<(a)?(a):((x)>(b)?(b):(x)))
+#define PROGMEM
+#define DMAMEM
+#define FLASHMEM
+
+class Print {
+public:
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *b, size_t n) {
+		size_t c = 0;
+		while (n--) c += write(*b++);
+		return c;
+	}
+	size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() { }
+	size_t print(const char *s) { return write(s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(int n, int base=DEC) { return print((long)n, base); }
+	size_t print(unsigned int n, int base=DEC) { return print((unsigned long)n, base); }
+	size_t print(long n, int base=DEC) { return (base == DEC) ? printf("%ld", n) : print((unsigned long)n, base); }
+	size_t print(unsigned long n, int base=DEC) { return printf(base == HEX ? "%lX" : "%lu", n); }
+	size_t print(long long n, int base=DEC) { return print((long)n, base); }
+	size_t print(unsigned long long n, int base=DEC) { return print((unsigned long)n, base); }
+	size_t print(double n, int digits=2) { return printf("%.*f", digits, n); }
+	template <typename T> size_t println(T n) { return print(n) + println(); }
+	template <typename T> size_t println(T n, int base) { return print(n, base) + println(); }
+	size_t println() { return write((uint8_t)'\n'); }
+	int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+		char buf[256];
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		write((const uint8_t *)buf, strlen(buf));
+		return n;
+	}
+};
+
+class Stream : public Print {
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+// Serial output is discarded, unless a test sets echo to see debug prints.
+// count is the number of bytes written.
+class HostSerial : public Stream {
+public:
+	size_t write(uint8_t c) { count++; if (echo) fputc(c, stderr); return 1; }
+	using Print::write;
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	operator bool() { return true; }
+	void begin(uint32_t baud) { }
+	bool echo = false;
+	uint32_t count = 0;
+};
+extern HostSerial Serial, Serial1;
+
+// Time is simulated, tests advance it with host_advance() in host.h
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void yield();
+
+static inline void __disable_irq() { }
+static inline void __enable_irq() { }
+#define IRQ_USBHS 1
+#define IRQ_USB1 2
+#define NVIC_ENABLE_IRQ(n) ((void)0)
+#define NVIC_DISABLE_IRQ(n) ((void)0)
+static inline void attachInterruptVector(int irq, void (*f)()) { }
+
+class elapsedMillis {
+	uint32_t ms;
+public:
+	elapsedMillis() { ms = millis(); }
+	elapsedMillis(uint32_t v) { ms = millis() - v; }
+	operator uint32_t() const { return millis() - ms; }
+	elapsedMillis & operator=(uint32_t v) { ms = millis() - v; return *this; }
+};
+class elapsedMicros {
+	uint32_t us;
+public:
+	elapsedMicros() { us = micros(); }
+	operator uint32_t() const { return micros() - us; }
+	elapsedMicros & operator=(uint32_t v) { us = micros() - v; return *this; }
+};
@@ -0,0 +1,425 @@
+// Host copy of the parts of Teensyduino's keylayouts.h used by the
+// keyboard driver, with two of its layouts: US English (the default) and
+// German, selected as in Teensyduino with LAYOUT_GERMAN.  The tables
+// themselves are in keylayouts.cpp.
+#pragma once
+#include <stdint.h>
+
+#define KEY_A		( 4 | 0xF000 )
+#define KEY_B		( 5 | 0xF000 )
+#define KEY_C		( 6 | 0xF000 )
+#define KEY_D		( 7 | 0xF000 )
+#define KEY_E		( 8 | 0xF000 )
+#define KEY_F		( 9 | 0xF000 )
+#define KEY_G		( 10 | 0xF000 )
+#define KEY_H		( 11 | 0xF000 )
+#define KEY_I		( 12 | 0xF000 )
+#define KEY_J		( 13 | 0xF000 )
+#define KEY_K		( 14 | 0xF000 )
+#define KEY_L		( 15 | 0xF000 )
+#define KEY_M		( 16 | 0xF000 )
+#define KEY_N		( 17 | 0xF000 )
+#define KEY_O		( 18 | 0xF000 )
+#define KEY_P		( 19 | 0xF000 )
+#define KEY_Q		( 20 | 0xF000 )
+#define KEY_R		( 21 | 0xF000 )
+#define KEY_S		( 22 | 0xF000 )
+#define KEY_T		( 23 | 0xF000 )
+#define KEY_U		( 24 | 0xF000 )
+#define KEY_V		( 25 | 0xF000 )
+#define KEY_W		( 26 | 0xF000 )
+#define KEY_X		( 27 | 0xF000 )
+#define KEY_Y		( 28 | 0xF000 )
+#define KEY_Z		( 29 | 0xF000 )
+#define KEY_1		( 30 | 0xF000 )
+#define KEY_2		( 31 | 0xF000 )
+#define KEY_3		( 32 | 0xF000 )
+#define KEY_4		( 33 | 0xF000 )
+#define KEY_5		( 34 | 0xF000 )
+#define KEY_6		( 35 | 0xF000 )
+#define KEY_7		( 36 | 0xF000 )
+#define KEY_8		( 37 | 0xF000 )
+#define KEY_9		( 38 | 0xF000 )
+#define KEY_0		( 39 | 0xF000 )
+#define KEY_ENTER	( 40 | 0xF000 )
+#define KEY_ESC	( 41 | 0xF000 )
+#define KEY_BACKSPACE	( 42 | 0xF000 )
+#define KEY_TAB	( 43 | 0xF000 )
+#define KEY_SPACE	( 44 | 0xF000 )
+#define KEY_MINUS	( 45 | 0xF000 )
+#define KEY_EQUAL	( 46 | 0xF000 )
+#define KEY_LEFT_BRACE	( 47 | 0xF000 )
+#define KEY_RIGHT_BRACE	( 48 | 0xF000 )
+#define KEY_BACKSLASH	( 49 | 0xF000 )
+#define KEY_NON_US_NUM	( 50 | 0xF000 )
+#define KEY_SEMICOLON	( 51 | 0xF000 )
+#define KEY_QUOTE	( 52 | 0xF000 )
+#define KEY_TILDE	( 53 | 0xF000 )
+#define KEY_COMMA	( 54 | 0xF000 )
+#define KEY_PERIOD	( 55 | 0xF000 )
+#define KEY_SLASH	( 56 | 0xF000 )
+#define KEY_CAPS_LOCK	( 57 | 0xF000 )
+#define KEY_F1	( 58 | 0xF000 )
+#define KEY_F2	( 59 | 0xF000 )
+#define KEY_F3	( 60 | 0xF000 )
+#define KEY_F4	( 61 | 0xF000 )
+#define KEY_F5	( 62 | 0xF000 )
+#define KEY_F6	( 63 | 0xF000 )
+#define KEY_F7	( 64 | 0xF000 )
+#define KEY_F8	( 65 | 0xF000 )
+#define KEY_F9	( 66 | 0xF000 )
+#define KEY_F10	( 67 | 0xF000 )
+#define KEY_F11	( 68 | 0xF000 )
+#define KEY_F12	( 69 | 0xF000 )
+#define KEY_PRINTSCREEN	( 70 | 0xF000 )
+#define KEY_SCROLL_LOCK	( 71 | 0xF000 )
+#define KEY_PAUSE	( 72 | 0xF000 )
+#define KEY_INSERT	( 73 | 0xF000 )
+#define KEY_HOME	( 74 | 0xF000 )
+#define KEY_PAGE_UP	( 75 | 0xF000 )
+#define KEY_DELETE	( 76 | 0xF000 )
+#define KEY_END	( 77 | 0xF000 )
+#define KEY_PAGE_DOWN	( 78 | 0xF000 )
+#define KEY_RIGHT	( 79 | 0xF000 )
+#define KEY_LEFT	( 80 | 0xF000 )
+#define KEY_DOWN	( 81 | 0xF000 )
+#define KEY_UP	( 82 | 0xF000 )
+#define KEY_NUM_LOCK	( 83 | 0xF000 )
+#define KEYPAD_SLASH	( 84 | 0xF000 )
+#define KEYPAD_ASTERIX	( 85 | 0xF000 )
+#define KEYPAD_MINUS	( 86 | 0xF000 )
+#define KEYPAD_PLUS	( 87 | 0xF000 )
+#define KEYPAD_ENTER	( 88 | 0xF000 )
+#define KEYPAD_1	( 89 | 0xF000 )
+#define KEYPAD_2	( 90 | 0xF000 )
+#define KEYPAD_3	( 91 | 0xF000 )
+#define KEYPAD_4	( 92 | 0xF000 )
+#define KEYPAD_5	( 93 | 0xF000 )
+#define KEYPAD_6	( 94 | 0xF000 )
+#define KEYPAD_7	( 95 | 0xF000 )
+#define KEYPAD_8	( 96 | 0xF000 )
+#define KEYPAD_9	( 97 | 0xF000 )
+#define KEYPAD_0	( 98 | 0xF000 )
+#define KEYPAD_PERIOD	( 99 | 0xF000 )
+#define KEY_NON_US_100	( 100 | 0xF000 )
+
+#if defined(LAYOUT_GERMAN)
+
+#define SHIFT_MASK		0x0040
+#define ALTGR_MASK		0x0080
+#define DEADKEYS_MASK		0x0700
+#define CIRCUMFLEX_BITS		0x0100
+#define ACUTE_ACCENT_BITS	0x0200
+#define GRAVE_ACCENT_BITS	0x0300
+#define KEYCODE_TYPE		uint16_t
+#define KEYCODE_MASK		0x07FF
+#define DEADKEY_CIRCUMFLEX	KEY_TILDE
+#define DEADKEY_ACUTE_ACCENT	KEY_EQUAL
+#define DEADKEY_GRAVE_ACCENT	KEY_EQUAL + SHIFT_MASK
+#undef KEY_NON_US_100
+#define KEY_NON_US_100		63
+
+#define ASCII_20	KEY_SPACE
+#define ASCII_21	KEY_1 + SHIFT_MASK
+#define ASCII_22	KEY_2 + SHIFT_MASK
+#define ASCII_23	KEY_BACKSLASH
+#define ASCII_24	KEY_4 + SHIFT_MASK
+#define ASCII_25	KEY_5 + SHIFT_MASK
+#define ASCII_26	KEY_6 + SHIFT_MASK
+#define ASCII_27	KEY_BACKSLASH + SHIFT_MASK
+#define ASCII_28	KEY_8 + SHIFT_MASK
+#define ASCII_29	KEY_9 + SHIFT_MASK
+#define ASCII_2A	KEY_RIGHT_BRACE + SHIFT_MASK
+#define ASCII_2B	KEY_RIGHT_BRACE
+#define ASCII_2C	KEY_COMMA
+#define ASCII_2D	KEY_SLASH
+#define ASCII_2E	KEY_PERIOD
+#define ASCII_2F	KEY_7 + SHIFT_MASK
+#define ASCII_30	KEY_0
+#define ASCII_31	KEY_1
+#define ASCII_32	KEY_2
+#define ASCII_33	KEY_3
+#define ASCII_34	KEY_4
+#define ASCII_35	KEY_5
+#define ASCII_36	KEY_6
+#define ASCII_37	KEY_7
+#define ASCII_38	KEY_8
+#define ASCII_39	KEY_9
+#define ASCII_3A	KEY_PERIOD + SHIFT_MASK
+#define ASCII_3B	KEY_COMMA + SHIFT_MASK
+#define ASCII_3C	KEY_NON_US_100
+#define ASCII_3D	KEY_0 + SHIFT_MASK
+#define ASCII_3E	KEY_NON_US_100 + SHIFT_MASK
+#define ASCII_3F	KEY_MINUS + SHIFT_MASK
+#define ASCII_40	KEY_Q + ALTGR_MASK
+#define ASCII_41	KEY_A + SHIFT_MASK
+#define ASCII_42	KEY_B + SHIFT_MASK
+#define ASCII_43	KEY_C + SHIFT_MASK
+#define ASCII_44	KEY_D + SHIFT_MASK
+#define ASCII_45	KEY_E + SHIFT_MASK
+#define ASCII_46	KEY_F + SHIFT_MASK
+#define ASCII_47	KEY_G + SHIFT_MASK
+#define ASCII_48	KEY_H + SHIFT_MASK
+#define ASCII_49	KEY_I + SHIFT_MASK
+#define ASCII_4A	KEY_J + SHIFT_MASK
+#define ASCII_4B	KEY_K + SHIFT_MASK
+#define ASCII_4C	KEY_L + SHIFT_MASK
+#define ASCII_4D	KEY_M + SHIFT_MASK
+#define ASCII_4E	KEY_N + SHIFT_MASK
+#define ASCII_4F	KEY_O + SHIFT_MASK
+#define ASCII_50	KEY_P + SHIFT_MASK
+#define ASCII_51	KEY_Q + SHIFT_MASK
+#define ASCII_52	KEY_R + SHIFT_MASK
+#define ASCII_53	KEY_S + SHIFT_MASK
+#define ASCII_54	KEY_T + SHIFT_MASK
+#define ASCII_55	KEY_U + SHIFT_MASK
+#define ASCII_56	KEY_V + SHIFT_MASK
+#define ASCII_57	KEY_W + SHIFT_MASK
+#define ASCII_58	KEY_X + SHIFT_MASK
+#define ASCII_59	KEY_Z + SHIFT_MASK
+#define ASCII_5A	KEY_Y + SHIFT_MASK
+#define ASCII_5B	KEY_8 + ALTGR_MASK
+#define ASCII_5C	KEY_MINUS + ALTGR_MASK
+#define ASCII_5D	KEY_9 + ALTGR_MASK
+#define ASCII_5E	CIRCUMFLEX_BITS + KEY_SPACE
+#define ASCII_5F	KEY_SLASH + SHIFT_MASK
+#define ASCII_60	GRAVE_ACCENT_BITS + KEY_SPACE
+#define ASCII_61	KEY_A
+#define ASCII_62	KEY_B
+#define ASCII_63	KEY_C
+#define ASCII_64	KEY_D
+#define ASCII_65	KEY_E
+#define ASCII_66	KEY_F
+#define ASCII_67	KEY_G
+#define ASCII_68	KEY_H
+#define ASCII_69	KEY_I
+#define ASCII_6A	KEY_J
+#define ASCII_6B	KEY_K
+#define ASCII_6C	KEY_L
+#define ASCII_6D	KEY_M
+#define ASCII_6E	KEY_N
+#define ASCII_6F	KEY_O
+#define ASCII_70	KEY_P
+#define ASCII_71	KEY_Q
+#define ASCII_72	KEY_R
+#define ASCII_73	KEY_S
+#define ASCII_74	KEY_T
+#define ASCII_75	KEY_U
+#define ASCII_76	KEY_V
+#define ASCII_77	KEY_W
+#define ASCII_78	KEY_X
+#define ASCII_79	KEY_Z
+#define ASCII_7A	KEY_Y
+#define ASCII_7B	KEY_7 + ALTGR_MASK
+#define ASCII_7C	KEY_NON_US_100 + ALTGR_MASK
+#define ASCII_7D	KEY_0 + ALTGR_MASK
+#define ASCII_7E	KEY_RIGHT_BRACE + ALTGR_MASK
+#define ASCII_7F	KEY_BACKSPACE
+#define ISO_8859_1_A0	0
+#define ISO_8859_1_A1	0
+#define ISO_8859_1_A2	0
+#define ISO_8859_1_A3	0
+#define ISO_8859_1_A4	0
+#define ISO_8859_1_A5	0
+#define ISO_8859_1_A6	0
+#define ISO_8859_1_A7	KEY_3 + SHIFT_MASK
+#define ISO_8859_1_A8	0
+#define ISO_8859_1_A9	0
+#define ISO_8859_1_AA	0
+#define ISO_8859_1_AB	0
+#define ISO_8859_1_AC	0
+#define ISO_8859_1_AD	0
+#define ISO_8859_1_AE	0
+#define ISO_8859_1_AF	0
+#define ISO_8859_1_B0	KEY_TILDE + SHIFT_MASK
+#define ISO_8859_1_B1	0
+#define ISO_8859_1_B2	KEY_2 + ALTGR_MASK
+#define ISO_8859_1_B3	KEY_3 + ALTGR_MASK
+#define ISO_8859_1_B4	ACUTE_ACCENT_BITS + KEY_SPACE
+#define ISO_8859_1_B5	KEY_M + ALTGR_MASK
+#define ISO_8859_1_B6	0
+#define ISO_8859_1_B7	0
+#define ISO_8859_1_B8	0
+#define ISO_8859_1_B9	0
+#define ISO_8859_1_BA	0
+#define ISO_8859_1_BB	0
+#define ISO_8859_1_BC	0
+#define ISO_8859_1_BD	0
+#define ISO_8859_1_BE	0
+#define ISO_8859_1_BF	0
+#define ISO_8859_1_C0	GRAVE_ACCENT_BITS + KEY_A + SHIFT_MASK
+#define ISO_8859_1_C1	ACUTE_ACCENT_BITS + KEY_A + SHIFT_MASK
+#define ISO_8859_1_C2	CIRCUMFLEX_BITS + KEY_A + SHIFT_MASK
+#define ISO_8859_1_C3	0
+#define ISO_8859_1_C4	KEY_QUOTE + SHIFT_MASK
+#define ISO_8859_1_C5	0
+#define ISO_8859_1_C6	0
+#define ISO_8859_1_C7	0
+#define ISO_8859_1_C8	GRAVE_ACCENT_BITS + KEY_E + SHIFT_MASK
+#define ISO_8859_1_C9	ACUTE_ACCENT_BITS + KEY_E + SHIFT_MASK
+#define ISO_8859_1_CA	CIRCUMFLEX_BITS + KEY_E + SHIFT_MASK
+#define ISO_8859_1_CB	0
+#define ISO_8859_1_CC	GRAVE_ACCENT_BITS + KEY_I + SHIFT_MASK
+#define ISO_8859_1_CD	ACUTE_ACCENT_BITS + KEY_I + SHIFT_MASK
+#define ISO_8859_1_CE	CIRCUMFLEX_BITS + KEY_I + SHIFT_MASK
+#define ISO_8859_1_CF	0
+#define ISO_8859_1_D0	0
+#define ISO_8859_1_D1	0
+#define ISO_8859_1_D2	GRAVE_ACCENT_BITS + KEY_O + SHIFT_MASK
+#define ISO_8859_1_D3	ACUTE_ACCENT_BITS + KEY_O + SHIFT_MASK
+#define ISO_8859_1_D4	CIRCUMFLEX_BITS + KEY_O + SHIFT_MASK
+#define ISO_8859_1_D5	0
+#define ISO_8859_1_D6	KEY_SEMICOLON + SHIFT_MASK
+#define ISO_8859_1_D7	0
+#define ISO_8859_1_D8	0
+#define ISO_8859_1_D9	GRAVE_ACCENT_BITS + KEY_U + SHIFT_MASK
+#define ISO_8859_1_DA	ACUTE_ACCENT_BITS + KEY_U + SHIFT_MASK
+#define ISO_8859_1_DB	CIRCUMFLEX_BITS + KEY_U + SHIFT_MASK
+#define ISO_8859_1_DC	KEY_LEFT_BRACE + SHIFT_MASK
+#define ISO_8859_1_DD	ACUTE_ACCENT_BITS + KEY_Z + SHIFT_MASK
+#define ISO_8859_1_DE	0
+#define ISO_8859_1_DF	KEY_MINUS
+#define ISO_8859_1_E0	GRAVE_ACCENT_BITS + KEY_A
+#define ISO_8859_1_E1	ACUTE_ACCENT_BITS + KEY_A
+#define ISO_8859_1_E2	CIRCUMFLEX_BITS + KEY_A
+#define ISO_8859_1_E3	0
+#define ISO_8859_1_E4	KEY_QUOTE
+#define ISO_8859_1_E5	0
+#define ISO_8859_1_E6	0
+#define ISO_8859_1_E7	0
+#define ISO_8859_1_E8	GRAVE_ACCENT_BITS + KEY_E
+#define ISO_8859_1_E9	ACUTE_ACCENT_BITS + KEY_E
+#define ISO_8859_1_EA	CIRCUMFLEX_BITS + KEY_E
+#define ISO_8859_1_EB	0
+#define ISO_8859_1_EC	GRAVE_ACCENT_BITS + KEY_I
+#define ISO_8859_1_ED	ACUTE_ACCENT_BITS + KEY_I
+#define ISO_8859_1_EE	CIRCUMFLEX_BITS + KEY_I
+#define ISO_8859_1_EF	0
+#define ISO_8859_1_F0	0
+#define ISO_8859_1_F1	0
+#define ISO_8859_1_F2	GRAVE_ACCENT_BITS + KEY_O
+#define ISO_8859_1_F3	ACUTE_ACCENT_BITS + KEY_O
+#define ISO_8859_1_F4	CIRCUMFLEX_BITS + KEY_O
+#define ISO_8859_1_F5	0
+#define ISO_8859_1_F6	KEY_SEMICOLON
+#define ISO_8859_1_F7	0
+#define ISO_8859_1_F8	0
+#define ISO_8859_1_F9	GRAVE_ACCENT_BITS + KEY_U
+#define ISO_8859_1_FA	ACUTE_ACCENT_BITS + KEY_U
+#define ISO_8859_1_FB	CIRCUMFLEX_BITS + KEY_U
+#define ISO_8859_1_FC	KEY_LEFT_BRACE
+#define ISO_8859_1_FD	ACUTE_ACCENT_BITS + KEY_Z
+#define ISO_8859_1_FE	0
+#define ISO_8859_1_FF	0
+
+#else // LAYOUT_US_ENGLISH
+
+#define SHIFT_MASK		0x40
+#define KEYCODE_TYPE		uint8_t
+#define KEYCODE_MASK		0x007F
+
+#define ASCII_20	KEY_SPACE
+#define ASCII_21	KEY_1 + SHIFT_MASK
+#define ASCII_22	KEY_QUOTE + SHIFT_MASK
+#define ASCII_23	KEY_3 + SHIFT_MASK
+#define ASCII_24	KEY_4 + SHIFT_MASK
+#define ASCII_25	KEY_5 + SHIFT_MASK
+#define ASCII_26	KEY_7 + SHIFT_MASK
+#define ASCII_27	KEY_QUOTE
+#define ASCII_28	KEY_9 + SHIFT_MASK
+#define ASCII_29	KEY_0 + SHIFT_MASK
+#define ASCII_2A	KEY_8 + SHIFT_MASK
+#define ASCII_2B	KEY_EQUAL + SHIFT_MASK
+#define ASCII_2C	KEY_COMMA
+#define ASCII_2D	KEY_MINUS
+#define ASCII_2E	KEY_PERIOD
+#define ASCII_2F	KEY_SLASH
+#define ASCII_30	KEY_0
+#define ASCII_31	KEY_1
+#define ASCII_32	KEY_2
+#define ASCII_33	KEY_3
+#define ASCII_34	KEY_4
+#define ASCII_35	KEY_5
+#define ASCII_36	KEY_6
+#define ASCII_37	KEY_7
+#define ASCII_38	KEY_8
+#define ASCII_39	KEY_9
+#define ASCII_3A	KEY_SEMICOLON + SHIFT_MASK
+#define ASCII_3B	KEY_SEMICOLON
+#define ASCII_3C	KEY_COMMA + SHIFT_MASK
+#define ASCII_3D	KEY_EQUAL
+#define ASCII_3E	KEY_PERIOD + SHIFT_MASK
+#define ASCII_3F	KEY_SLASH + SHIFT_MASK
+#define ASCII_40	KEY_2 + SHIFT_MASK
+#define ASCII_41	KEY_A + SHIFT_MASK
+#define ASCII_42	KEY_B + SHIFT_MASK
+#define ASCII_43	KEY_C + SHIFT_MASK
+#define ASCII_44	KEY_D + SHIFT_MASK
+#define ASCII_45	KEY_E + SHIFT_MASK
+#define ASCII_46	KEY_F + SHIFT_MASK
+#define ASCII_47	KEY_G + SHIFT_MASK
+#define ASCII_48	KEY_H + SHIFT_MASK
+#define ASCII_49	KEY_I + SHIFT_MASK
+#define ASCII_4A	KEY_J + SHIFT_MASK
+#define ASCII_4B	KEY_K + SHIFT_MASK
+#define ASCII_4C	KEY_L + SHIFT_MASK
+#define ASCII_4D	KEY_M + SHIFT_MASK
+#define ASCII_4E	KEY_N + SHIFT_MASK
+#define ASCII_4F	KEY_O + SHIFT_MASK
+#define ASCII_50	KEY_P + SHIFT_MASK
+#define ASCII_51	KEY_Q + SHIFT_MASK
+#define ASCII_52	KEY_R + SHIFT_MASK
+#define ASCII_53	KEY_S + SHIFT_MASK
+#define ASCII_54	KEY_T + SHIFT_MASK
+#define ASCII_55	KEY_U + SHIFT_MASK
+#define ASCII_56	KEY_V + SHIFT_MASK
+#define ASCII_57	KEY_W + SHIFT_MASK
+#define ASCII_58	KEY_X + SHIFT_MASK
+#define ASCII_59	KEY_Y + SHIFT_MASK
+#define ASCII_5A	KEY_Z + SHIFT_MASK
+#define ASCII_5B	KEY_LEFT_BRACE
+#define ASCII_5C	KEY_BACKSLASH
+#define ASCII_5D	KEY_RIGHT_BRACE
+#define ASCII_5E	KEY_6 + SHIFT_MASK
+#define ASCII_5F	KEY_MINUS + SHIFT_MASK
+#define ASCII_60	KEY_TILDE
+#define ASCII_61	KEY_A
+#define ASCII_62	KEY_B
+#define ASCII_63	KEY_C
+#define ASCII_64	KEY_D
+#define ASCII_65	KEY_E
+#define ASCII_66	KEY_F
+#define ASCII_67	KEY_G
+#define ASCII_68	KEY_H
+#define ASCII_69	KEY_I
+#define ASCII_6A	KEY_J
+#define ASCII_6B	KEY_K
+#define ASCII_6C	KEY_L
+#define ASCII_6D	KEY_M
+#define ASCII_6E	KEY_N
+#define ASCII_6F	KEY_O
+#define ASCII_70	KEY_P
+#define ASCII_71	KEY_Q
+#define ASCII_72	KEY_R
+#define ASCII_73	KEY_S
+#define ASCII_74	KEY_T
+#define ASCII_75	KEY_U
+#define ASCII_76	KEY_V
+#define ASCII_77	KEY_W
+#define ASCII_78	KEY_X
+#define ASCII_79	KEY_Y
+#define ASCII_7A	KEY_Z
+#define ASCII_7B	KEY_LEFT_BRACE + SHIFT_MASK
+#define ASCII_7C	KEY_BACKSLASH + SHIFT_MASK
+#define ASCII_7D	KEY_RIGHT_BRACE + SHIFT_MASK
+#define ASCII_7E	KEY_TILDE + SHIFT_MASK
+#define ASCII_7F	KEY_BACKSPACE
+
+#endif
+
+extern "C" {
+extern const KEYCODE_TYPE keycodes_ascii[];
+#ifdef ISO_8859_1_A0
+extern const KEYCODE_TYPE keycodes_iso_8859_1[];
+#endif
+}